@@ -10,6 +10,12 @@ blue=$(tput setaf 4)
 
 set -e
 
+echo "${bold}Checking generated payload codecs...${normal}"
+./tools/payload_codec/codegen.py --check
+
+echo "${bold}Running storage master host tests...${normal}"
+make -C signpost/apps/storage_master/test/host_test test
+
 echo "${bold}Building all boards...${normal}"
 pushd signpost/kernel/boards > /dev/null
 ./build_all.sh
@@ -9,6 +9,7 @@ var child_process = require('child_process');
 var fs            = require('fs');
 var ini           = require('ini');
 var mqtt          = require('mqtt');
+var payloads      = require('./payloads');
 
 //check to see if there was a conf file passed in
 var conf_file_location = '';
@@ -45,91 +46,54 @@ function parse (topic, buf) {
         // Controller
         if (message_type == 0x01) {
             // Energy
-            var battery_voltage = buf.readUInt16BE(1);
-            var battery_current = buf.readInt32BE(3);
-            var solar_voltage = buf.readUInt16BE(7);
-            var solar_current = buf.readInt32BE(9);
-            var battery_percent = buf.readUInt8(13);
-            var battery_energy = buf.readUInt16BE(14);
-            var battery_capacity = buf.readUInt16BE(16);
-
-            var energy_module0 = buf.readUInt16BE(18);
-            var energy_module1 = buf.readUInt16BE(20);
-            var energy_module2 = buf.readUInt16BE(22);
-            var energy_controller = buf.readUInt16BE(24);
-            var energy_linux   = buf.readUInt16BE(26);
-            var energy_module5 = buf.readUInt16BE(28);
-            var energy_module6 = buf.readUInt16BE(30);
-            var energy_module7 = buf.readUInt16BE(32);
-
-            if(buf.length > 45) {
-                var average_module0 = buf.readUInt16BE(34);
-                var average_module1 = buf.readUInt16BE(36);
-                var average_module2 = buf.readUInt16BE(38);
-                var average_controller = buf.readUInt16BE(40);
-                var average_linux   = 0;
-                var average_module5 = buf.readUInt16BE(42);
-                var average_module6 = buf.readUInt16BE(44);
-                var average_module7 = buf.readUInt16BE(46);
+            var energy = payloads.energy.decode(buf);
+            if (energy == null) return;
+
+            var json = {
+                device: "signpost_energy",
+                battery_voltage_mV: energy.battery_voltage_mV,
+                battery_current_uA: energy.battery_current_uA,
+                solar_voltage_mV: energy.solar_voltage_mV,
+                solar_current_uA: energy.solar_current_uA,
+                battery_capacity_percent_remaining: energy.battery_capacity_percent_remaining,
+                battery_capacity_remaining_mAh: energy.battery_capacity_remaining_mAh,
+                battery_capacity_full_mAh: energy.battery_capacity_full_mAh,
+                controller_energy_remaining_mWh: energy.controller_energy_remaining_mWh,
+                module0_energy_remaining_mWh: energy.module0_energy_remaining_mWh,
+                module1_energy_remaining_mWh: energy.module1_energy_remaining_mWh,
+                module2_energy_remaining_mWh: energy.module2_energy_remaining_mWh,
+                module5_energy_remaining_mWh: energy.module5_energy_remaining_mWh,
+                module6_energy_remaining_mWh: energy.module6_energy_remaining_mWh,
+                module7_energy_remaining_mWh: energy.module7_energy_remaining_mWh,
             }
 
-            if(typeof average_module0 !== 'undefined') {
-                return {
-                    device: "signpost_energy",
-                    battery_voltage_mV: battery_voltage,
-                    battery_current_uA: battery_current,
-                    solar_voltage_mV: solar_voltage,
-                    solar_current_uA: solar_current,
-                    battery_capacity_percent_remaining: battery_percent,
-                    battery_capacity_remaining_mAh: battery_energy,
-                    battery_capacity_full_mAh: battery_capacity,
-                    controller_energy_remaining_mWh: energy_controller,
-                    module0_energy_remaining_mWh: energy_module0,
-                    module1_energy_remaining_mWh: energy_module1,
-                    module2_energy_remaining_mWh: energy_module2,
-                    module5_energy_remaining_mWh: energy_module5,
-                    module6_energy_remaining_mWh: energy_module6,
-                    module7_energy_remaining_mWh: energy_module7,
-                    controller_energy_average_mW: average_controller,
-                    module0_energy_average_mW: average_module0,
-                    module1_energy_average_mW: average_module1,
-                    module2_energy_average_mW: average_module2,
-                    module5_energy_average_mW: average_module5,
-                    module6_energy_average_mW: average_module6,
-                    module7_energy_average_mW: average_module7,
-                }
-            } else {
-                return {
-                    device: "signpost_energy",
-                    battery_voltage_mV: battery_voltage,
-                    battery_current_uA: battery_current,
-                    solar_voltage_mV: solar_voltage,
-                    solar_current_uA: solar_current,
-                    battery_capacity_percent_remaining: battery_percent,
-                    battery_capacity_remaining_mAh: battery_energy,
-                    battery_capacity_full_mAh: battery_capacity,
-                    controller_energy_remaining_mWh: energy_controller,
-                    module0_energy_remaining_mWh: energy_module0,
-                    module1_energy_remaining_mWh: energy_module1,
-                    module2_energy_remaining_mWh: energy_module2,
-                    module5_energy_remaining_mWh: energy_module5,
-                    module6_energy_remaining_mWh: energy_module6,
-                    module7_energy_remaining_mWh: energy_module7,
-                }
+            if(typeof energy.module0_energy_average_mW !== 'undefined') {
+                json.controller_energy_average_mW = energy.controller_energy_average_mW;
+                json.module0_energy_average_mW = energy.module0_energy_average_mW;
+                json.module1_energy_average_mW = energy.module1_energy_average_mW;
+                json.module2_energy_average_mW = energy.module2_energy_average_mW;
+                json.module5_energy_average_mW = energy.module5_energy_average_mW;
+                json.module6_energy_average_mW = energy.module6_energy_average_mW;
+                json.module7_energy_average_mW = energy.module7_energy_average_mW;
             }
+
+            return json;
         }
     } else if (topic.endsWith('signpost/control/gps') || topic.endsWith('lab11/gps')) {
         // GPS
-        var day = buf.readUInt8(1);
-        var month = buf.readUInt8(2);
-        var year = buf.readUInt8(3);
-        var hours = buf.readUInt8(4);
-        var minutes = buf.readUInt8(5);
-        var seconds = buf.readUInt8(6);
-        var latitude = buf.readInt32BE(7)/(10000*100.0);
-        var longitude = buf.readInt32BE(11)/(10000*100.0);
-        var fix = ['', 'No Fix', '2D', '3D'][buf.readUInt8(15)];
-        var satellite_count = buf.readUInt8(16);
+        var gps = payloads.gps.decode(buf);
+        if (gps == null) return;
+
+        var day = gps.day;
+        var month = gps.month;
+        var year = gps.year;
+        var hours = gps.hours;
+        var minutes = gps.minutes;
+        var seconds = gps.seconds;
+        var latitude = gps.latitude/(10000*100.0);
+        var longitude = gps.longitude/(10000*100.0);
+        var fix = ['', 'No Fix', '2D', '3D'][gps.fix];
+        var satellite_count = gps.satellite_count;
 
         if (year >= 80) {
           year += 1900;
@@ -163,19 +127,41 @@ function parse (topic, buf) {
             timestamp: utcDate.toISOString(),
             satellite_count: satellite_count,
         }
+    } else if (topic.endsWith('signpost/control/memory')) {
+        // Stack and heap high-water marks, one module per message
+        var memory = payloads.memory.decode(buf);
+        if (memory == null) return;
+
+        var json = {
+            device: 'signpost_memory',
+            module: memory.module,
+            stack_free_bytes: memory.stack_free,
+            stack_peak_bytes: memory.stack_peak,
+            heap_current_bytes: memory.heap_current,
+            heap_peak_bytes: memory.heap_peak,
+            heap_failures: memory.heap_failures,
+        };
+        // only report apis that were used, indexed by signbus api type
+        var apis = ['', 'initialization', 'storage', 'networking', 'processing',
+                    'energy', 'timelocation', 'edison', 'json', 'watchdog', 'debug'];
+        for (var i = 1; i < memory.api_stack_peak.length; i++) {
+            if (memory.api_stack_peak[i] == 0) continue;
+            var name = apis[i] || ('api' + i);
+            json[name + '_stack_peak_bytes'] = memory.api_stack_peak[i];
+        }
+        return json;
     } else if (topic.endsWith('lab11/ambient/tphl') || topic.endsWith('tphl') || 
                 topic.endsWith('lab11/ambient') || topic.endsWith('ambient')) {
         if (message_type == 0x01) {
-                        var temp = buf.readInt16BE(1) / 100.0;
-            var humi = buf.readInt16BE(3) / 100.0;
-            var ligh = buf.readInt16BE(5);
-            // app returns pressure in uBar in 3 bytes, left aligned
-                        // pascal = 1x10^-5 Bar = 10 uBar
-            var pres;
-            var pres1 =  buf.readUInt8(7);
-            var pres2 =  buf.readUInt8(8);
-            var pres3 =  buf.readUInt8(9);
-            pres = ((pres1 << 16) + (pres2 << 8) + pres3) /10.0
+            var ambient = payloads.ambient.decode(buf);
+            if (ambient == null) return;
+
+            var temp = ambient.temperature / 100.0;
+            var humi = ambient.humidity / 100.0;
+            var ligh = ambient.light;
+            // app returns pressure in uBar
+            // pascal = 1x10^-5 Bar = 10 uBar
+            var pres = ambient.pressure / 10.0;
 
             return {
                 device: 'signpost_ambient',
@@ -198,13 +184,18 @@ function parse (topic, buf) {
             //(20*log(output/43.75))+35.5
             //for right now this is happening here, but I'm trying to move it
             //to the app itself
-            var f_63_hz = Number(((Math.log10(buf.readUInt16BE(1)/43.75)*20)+35.5).toFixed(0));
-            var f_160_hz = Number(((Math.log10(buf.readUInt16BE(3)/43.75)*20)+35.5).toFixed(0));
-            var f_400_hz = Number(((Math.log10(buf.readUInt16BE(5)/43.75)*20)+35.5).toFixed(0));
-            var f_1000_hz = Number(((Math.log10(buf.readUInt16BE(7)/43.75)*20)+35.5).toFixed(0));
-            var f_2500_hz = Number(((Math.log10(buf.readUInt16BE(9)/43.75)*20)+35.5).toFixed(0));
-            var f_6250_hz = Number(((Math.log10(buf.readUInt16BE(11)/43.75)*20)+35.5).toFixed(0));
-            var f_16000_hz = Number(((Math.log10(buf.readUInt16BE(13)/43.75)*20)+35.5).toFixed(0));
+            var audio = payloads.audio_spectrum.decode(buf);
+            if (audio == null) return;
+            var db = function (value) {
+                return Number(((Math.log10(value/43.75)*20)+35.5).toFixed(0));
+            }
+            var f_63_hz = db(audio.bands[0]);
+            var f_160_hz = db(audio.bands[1]);
+            var f_400_hz = db(audio.bands[2]);
+            var f_1000_hz = db(audio.bands[3]);
+            var f_2500_hz = db(audio.bands[4]);
+            var f_6250_hz = db(audio.bands[5]);
+            var f_16000_hz = db(audio.bands[6]);
 
             return {
                 device: 'signpost_audio_frequency',
@@ -216,61 +207,28 @@ function parse (topic, buf) {
                 '6250Hz': f_6250_hz,
                 '16000Hz': f_16000_hz,
             }
-        } else if (message_type == 0x02) {
-            //read unix time
-            var utime = buf.readUInt32BE(1);
-            values = [];
-            var i = 0;
-            for(; i < 10; i++) {
-                var date = new Date((utime+i)*1000).toISOString();
-                var f_63_hz = buf.readUInt8(4+i*7+1)
-                var f_160_hz = buf.readUInt8(4+i*7+2)
-                var f_400_hz = buf.readUInt8(4+i*7+3)
-                var f_1000_hz = buf.readUInt8(4+i*7+4)
-                var f_2500_hz = buf.readUInt8(4+i*7+5)
-                var f_6250_hz = buf.readUInt8(4+i*7+6)
-                var f_16000_hz = buf.readUInt8(4+i*7+7)
-                freq = {
-                    device: 'signpost_audio_frequency',
-                     "63Hz": f_63_hz,
-                    '160Hz': f_160_hz,
-                    '400Hz': f_400_hz,
-                    '1000Hz': f_1000_hz,
-                    '2500Hz': f_2500_hz,
-                    '6250Hz': f_6250_hz,
-                    '16000Hz': f_16000_hz,
-                    '_meta': {
-                        'received_time': date,
-                    }
-                }
+        } else if (message_type == 0x02 || message_type == 0x03) {
+            var batch = payloads.audio_spectrum_batch.decode(buf);
+            if (batch == null) return;
 
-                values.push(freq);
+            //type 3 packs dB SPL as (dB-50)*10, type 2 sends it directly
+            var band = function (value) {
+                return (message_type == 0x03) ? value/10 + 50 : value;
             }
 
-            return values;
-        } else if (message_type == 0x03) {
-            //read unix time
-            var utime = buf.readUInt32BE(1);
             values = [];
             var i = 0;
             for(; i < 10; i++) {
-                var date = new Date((utime+i)*1000).toISOString();
-                var f_63_hz = buf.readUInt8(4+i*7+1)/10 + 50
-                var f_160_hz = buf.readUInt8(4+i*7+2)/10 + 50
-                var f_400_hz = buf.readUInt8(4+i*7+3)/10 + 50
-                var f_1000_hz = buf.readUInt8(4+i*7+4)/10 + 50
-                var f_2500_hz = buf.readUInt8(4+i*7+5)/10 + 50
-                var f_6250_hz = buf.readUInt8(4+i*7+6)/10 + 50
-                var f_16000_hz = buf.readUInt8(4+i*7+7)/10 + 50
+                var date = new Date((batch.time+i)*1000).toISOString();
                 freq = {
                     device: 'signpost_audio_frequency',
-                     "63Hz": f_63_hz,
-                    '160Hz': f_160_hz,
-                    '400Hz': f_400_hz,
-                    '1000Hz': f_1000_hz,
-                    '2500Hz': f_2500_hz,
-                    '6250Hz': f_6250_hz,
-                    '16000Hz': f_16000_hz,
+                     "63Hz": band(batch.bands[i*7]),
+                    '160Hz': band(batch.bands[i*7+1]),
+                    '400Hz': band(batch.bands[i*7+2]),
+                    '1000Hz': band(batch.bands[i*7+3]),
+                    '2500Hz': band(batch.bands[i*7+4]),
+                    '6250Hz': band(batch.bands[i*7+5]),
+                    '16000Hz': band(batch.bands[i*7+6]),
                     '_meta': {
                         'received_time': date,
                     }
@@ -284,9 +242,11 @@ function parse (topic, buf) {
 
     } else if (topic.endsWith('lab11/radar/motion') || topic.endsWith('lab11/radar')) {
         if (message_type == 0x01) {
-            var motion = buf.readInt8(1) > 0;
-            var speed = buf.readUInt32BE(2) / 1000.0;
-            var motion_confidence = buf.readUInt8(6);
+            var radar = payloads.radar_motion.decode(buf);
+            if (radar == null) return;
+            var motion = radar.motion > 0;
+            var speed = radar.speed / 1000.0;
+            var motion_confidence = radar.motion_confidence;
 
             return {
                 device: 'signpost_microwave_radar',
@@ -295,15 +255,16 @@ function parse (topic, buf) {
                 'motion_confidence': motion_confidence,
             }
         } else if (message_type == 0x02) {
-            var utime = buf.readUInt32BE(1);
+            var batch = payloads.radar_motion_batch.decode(buf);
+            if (batch == null) return;
+
             values = [];
             var i = 0;
             for(; i < 20; i++) {
-                var date = new Date((utime+i)*1000).toISOString();
-                var motion = buf.readUInt8(5+i);
+                var date = new Date((batch.time+i)*1000).toISOString();
                 freq = {
                     device: 'signpost_microwave_radar',
-                     "motion_index": motion,
+                     "motion_index": batch.motion_index[i],
                     '_meta': {
                         'received_time': date,
                     }
@@ -316,18 +277,16 @@ function parse (topic, buf) {
         }
     } else if (topic.endsWith('lab11/aqm')) {
         if (message_type == 0x01) {
-            var co2_ppm = buf.readUInt16BE(1);
-            var VOC_PID_ppb = buf.readUInt32BE(3);
-            var VOC_IAQ_ppb = buf.readUInt32BE(7);
-            var barometric_millibar = buf.readUInt16BE(11);
-            var humidity_percent = buf.readUInt16BE(13);
+            var aqm = payloads.aqm.decode(buf);
+            if (aqm == null) return;
+
             return {
                 device: 'signpost_ucsd_air_quality',
-                co2_ppm: co2_ppm,
-                VOC_PID_ppb: VOC_PID_ppb,
-                VOC_IAQ_ppb: VOC_IAQ_ppb,
-                barometric_millibar: barometric_millibar,
-                humidity_percent: humidity_percent,
+                co2_ppm: aqm.co2_ppm,
+                VOC_PID_ppb: aqm.VOC_PID_ppb,
+                VOC_IAQ_ppb: aqm.VOC_IAQ_ppb,
+                barometric_millibar: aqm.barometric_millibar,
+                humidity_percent: aqm.humidity_percent,
             }
         }
     } else if (topic.endsWith('signpost/radio/status') || topic.endsWith('lab11/radio-status')) {
@@ -473,11 +432,14 @@ function parse (topic, buf) {
             datastr = "stddev";
             retobj['device'] = 'signpost_rf_spectrum_stddev';
         }
+        // the same channels as ws_spectrum, after the type byte
+        var spectrum = payloads.ws_spectrum.decode(buf.slice(1));
+        if (spectrum == null) return;
         for (var i = 0; i < 80; i++) {
             var lowend = 470+i*6;
             var highend = 470+6+i*6;
             var fullstr = lowend.toString()+"MHz"+"-"+highend.toString()+"MHz"+"_"+datastr;
-            retobj[fullstr] = buf.readInt8(1 + i);
+            retobj[fullstr] = spectrum.channels[i];
         }
         return retobj;
     } else if (topic.endsWith('lab11/spectrum/ws_max')) {
@@ -485,11 +447,13 @@ function parse (topic, buf) {
         var retobj = {};
         datastr = "max";
         retobj['device'] = 'signpost_rf_spectrum_max';
+        var spectrum = payloads.ws_spectrum.decode(buf);
+        if (spectrum == null) return;
         for (var i = 0; i < 80; i++) {
             var lowend = 470+i*6;
             var highend = 470+6+i*6;
             var fullstr = lowend.toString()+"MHz"+"-"+highend.toString()+"MHz"+"_"+datastr;
-            retobj[fullstr] = buf.readInt8(i);
+            retobj[fullstr] = spectrum.channels[i];
         }
         return retobj;
     } else if (topic.endsWith('lab11/spectrum/ws_mean')) {
@@ -497,11 +461,13 @@ function parse (topic, buf) {
         var retobj = {};
         datastr = "mean";
         retobj['device'] = 'signpost_rf_spectrum_mean';
+        var spectrum = payloads.ws_spectrum.decode(buf);
+        if (spectrum == null) return;
         for (var i = 0; i < 80; i++) {
             var lowend = 470+i*6;
             var highend = 470+6+i*6;
             var fullstr = lowend.toString()+"MHz"+"-"+highend.toString()+"MHz"+"_"+datastr;
-            retobj[fullstr] = buf.readInt8(i);
+            retobj[fullstr] = spectrum.channels[i];
         }
         return retobj;
     } else if (topic.endsWith('lab11/spectrum/ws_std')) {
@@ -509,11 +475,13 @@ function parse (topic, buf) {
         var retobj = {};
         datastr = "stddev";
         retobj['device'] = 'signpost_rf_spectrum_stddev';
+        var spectrum = payloads.ws_spectrum.decode(buf);
+        if (spectrum == null) return;
         for (var i = 0; i < 80; i++) {
             var lowend = 470+i*6;
             var highend = 470+6+i*6;
             var fullstr = lowend.toString()+"MHz"+"-"+highend.toString()+"MHz"+"_"+datastr;
-            retobj[fullstr] = buf.readInt8(i);
+            retobj[fullstr] = spectrum.channels[i];
         }
         return retobj;
     }
@@ -0,0 +1,189 @@
+// Generated by tools/payload_codec/codegen.py from payloads.schema.
+// Do not edit, change the schema and regenerate.
+//
+// Each decoder returns the raw field values, or null if the buffer is too
+// short for the required fields. Optional fields are left out if missing.
+// Message types are not checked here, the caller picks the layout.
+
+exports.energy = {
+    type: 0x01,
+    length: 50,
+    min_length: 34,
+    decode: function (buf) {
+        if (buf.length < 34) return null;
+        var msg = {};
+        msg.battery_voltage_mV = buf.readUInt16BE(1);
+        msg.battery_current_uA = buf.readInt32BE(3);
+        msg.solar_voltage_mV = buf.readUInt16BE(7);
+        msg.solar_current_uA = buf.readInt32BE(9);
+        msg.battery_capacity_percent_remaining = buf.readUInt8(13);
+        msg.battery_capacity_remaining_mAh = buf.readUInt16BE(14);
+        msg.battery_capacity_full_mAh = buf.readUInt16BE(16);
+        msg.module0_energy_remaining_mWh = buf.readUInt16BE(18);
+        msg.module1_energy_remaining_mWh = buf.readUInt16BE(20);
+        msg.module2_energy_remaining_mWh = buf.readUInt16BE(22);
+        msg.controller_energy_remaining_mWh = buf.readUInt16BE(24);
+        msg.linux_energy_remaining_mWh = buf.readUInt16BE(26);
+        msg.module5_energy_remaining_mWh = buf.readUInt16BE(28);
+        msg.module6_energy_remaining_mWh = buf.readUInt16BE(30);
+        msg.module7_energy_remaining_mWh = buf.readUInt16BE(32);
+        if (buf.length < 50) return msg;
+        msg.module0_energy_average_mW = buf.readUInt16BE(34);
+        msg.module1_energy_average_mW = buf.readUInt16BE(36);
+        msg.module2_energy_average_mW = buf.readUInt16BE(38);
+        msg.controller_energy_average_mW = buf.readUInt16BE(40);
+        msg.linux_energy_average_mW = buf.readUInt16BE(42);
+        msg.module5_energy_average_mW = buf.readUInt16BE(44);
+        msg.module6_energy_average_mW = buf.readUInt16BE(46);
+        msg.module7_energy_average_mW = buf.readUInt16BE(48);
+        return msg;
+    },
+};
+
+exports.gps = {
+    type: 0x02,
+    length: 17,
+    min_length: 17,
+    decode: function (buf) {
+        if (buf.length < 17) return null;
+        var msg = {};
+        msg.day = buf.readUInt8(1);
+        msg.month = buf.readUInt8(2);
+        msg.year = buf.readUInt8(3);
+        msg.hours = buf.readUInt8(4);
+        msg.minutes = buf.readUInt8(5);
+        msg.seconds = buf.readUInt8(6);
+        msg.latitude = buf.readInt32BE(7);
+        msg.longitude = buf.readInt32BE(11);
+        msg.fix = buf.readUInt8(15);
+        msg.satellite_count = buf.readUInt8(16);
+        return msg;
+    },
+};
+
+exports.memory = {
+    type: 0x01,
+    length: 44,
+    min_length: 44,
+    decode: function (buf) {
+        if (buf.length < 44) return null;
+        var msg = {};
+        msg.module = buf.readUInt8(1);
+        msg.stack_free = buf.readUInt16BE(2);
+        msg.stack_peak = buf.readUInt16BE(4);
+        msg.heap_current = buf.readUInt16BE(6);
+        msg.heap_peak = buf.readUInt16BE(8);
+        msg.heap_failures = buf.readUInt16BE(10);
+        msg.api_stack_peak = new Array(16);
+        for (var i = 0; i < 16; i++) {
+            msg.api_stack_peak[i] = buf.readUInt16BE(12 + i*2);
+        }
+        return msg;
+    },
+};
+
+exports.ambient = {
+    type: 0x01,
+    length: 10,
+    min_length: 10,
+    decode: function (buf) {
+        if (buf.length < 10) return null;
+        var msg = {};
+        msg.temperature = buf.readInt16BE(1);
+        msg.humidity = buf.readInt16BE(3);
+        msg.light = buf.readInt16BE(5);
+        msg.pressure = buf.readUIntBE(7, 3);
+        return msg;
+    },
+};
+
+exports.audio_spectrum = {
+    type: 0x01,
+    length: 15,
+    min_length: 15,
+    decode: function (buf) {
+        if (buf.length < 15) return null;
+        var msg = {};
+        msg.bands = new Array(7);
+        for (var i = 0; i < 7; i++) {
+            msg.bands[i] = buf.readUInt16BE(1 + i*2);
+        }
+        return msg;
+    },
+};
+
+exports.audio_spectrum_batch = {
+    type: 0x03,
+    length: 75,
+    min_length: 75,
+    decode: function (buf) {
+        if (buf.length < 75) return null;
+        var msg = {};
+        msg.time = buf.readUInt32BE(1);
+        msg.bands = new Array(70);
+        for (var i = 0; i < 70; i++) {
+            msg.bands[i] = buf.readUInt8(5 + i*1);
+        }
+        return msg;
+    },
+};
+
+exports.radar_motion = {
+    type: 0x01,
+    length: 7,
+    min_length: 7,
+    decode: function (buf) {
+        if (buf.length < 7) return null;
+        var msg = {};
+        msg.motion = buf.readInt8(1);
+        msg.speed = buf.readUInt32BE(2);
+        msg.motion_confidence = buf.readUInt8(6);
+        return msg;
+    },
+};
+
+exports.radar_motion_batch = {
+    type: 0x02,
+    length: 25,
+    min_length: 25,
+    decode: function (buf) {
+        if (buf.length < 25) return null;
+        var msg = {};
+        msg.time = buf.readUInt32BE(1);
+        msg.motion_index = new Array(20);
+        for (var i = 0; i < 20; i++) {
+            msg.motion_index[i] = buf.readUInt8(5 + i*1);
+        }
+        return msg;
+    },
+};
+
+exports.aqm = {
+    type: 0x01,
+    length: 15,
+    min_length: 15,
+    decode: function (buf) {
+        if (buf.length < 15) return null;
+        var msg = {};
+        msg.co2_ppm = buf.readUInt16BE(1);
+        msg.VOC_PID_ppb = buf.readUInt32BE(3);
+        msg.VOC_IAQ_ppb = buf.readUInt32BE(7);
+        msg.barometric_millibar = buf.readUInt16BE(11);
+        msg.humidity_percent = buf.readUInt16BE(13);
+        return msg;
+    },
+};
+
+exports.ws_spectrum = {
+    length: 80,
+    min_length: 80,
+    decode: function (buf) {
+        if (buf.length < 80) return null;
+        var msg = {};
+        msg.channels = new Array(80);
+        for (var i = 0; i < 80; i++) {
+            msg.channels[i] = buf.readInt8(0 + i*1);
+        }
+        return msg;
+    },
+};
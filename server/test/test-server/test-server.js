@@ -44,6 +44,39 @@ function build_lora_packet_buffer(addr, topic, data) {
     return pBuf;
 }
 
+// records as the radio sends them once a topic has been interned
+function build_define_record(id, epoch, topic, data) {
+    topicBuf = Buffer.from(topic);
+    rBuf = Buffer.alloc(topicBuf.length + data.length + 5);
+    rBuf[0] = 0xFF;
+    rBuf[1] = id;
+    rBuf[2] = epoch;
+    rBuf[3] = topicBuf.length;
+    topicBuf.copy(rBuf, 4);
+    rBuf[topicBuf.length + 4] = data.length;
+    data.copy(rBuf, topicBuf.length + 5);
+    return rBuf;
+}
+
+function build_interned_record(id, epoch, data) {
+    rBuf = Buffer.alloc(data.length + 3);
+    rBuf[0] = 0x80 | id;
+    rBuf[1] = epoch;
+    rBuf[2] = data.length;
+    data.copy(rBuf, 3);
+    return rBuf;
+}
+
+function build_lora_record_buffer(addr, record) {
+    addrBuf = Buffer.from(addr, 'hex');
+    pBuf = Buffer.alloc(addrBuf.length + record.length + 1);
+    addrBuf.copy(pBuf);
+    pBuf[6] = seq;
+    seq += 1;
+    record.copy(pBuf, 7);
+    return pBuf;
+}
+
 function build_http_packet_buffer(addr, dlist) {
     addrBuf = Buffer.from(addr, 'hex');
     if(addrBuf.length != 6) {
@@ -54,6 +87,10 @@ function build_http_packet_buffer(addr, dlist) {
     
     var len = 7;
     for (var i = 0; i < dlist.length; i++) {
+        if(dlist[i].record) {
+            len += 2 + dlist[i].record.length;
+            continue;
+        }
         len += 4;
         len += dlist[i].topic.length;
         len += dlist[i].data.length;
@@ -65,6 +102,13 @@ function build_http_packet_buffer(addr, dlist) {
     seq += 1;
     var index = 7;
     for (var i = 0; i < dlist.length; i++) {
+        if(dlist[i].record) {
+            pBuf.writeUInt16BE(dlist[i].record.length,index);
+            index += 2;
+            dlist[i].record.copy(pBuf, index);
+            index += dlist[i].record.length;
+            continue;
+        }
         topicBuf = Buffer.from(dlist[i].topic);
         dataBuf = Buffer.from(dlist[i].data);
         var tlen = topicBuf.length + dataBuf.length + 2;
@@ -88,7 +132,7 @@ var answerQueue = [];
 var httpList = [];
 
 function build_test_queue() {
-    energy = Buffer.alloc(48);
+    energy = Buffer.alloc(50);
     energy.writeUInt8(0x01, 0);
     energy.writeUInt16BE(12000, 1);
     energy.writeInt32BE(-20000, 3);
@@ -109,9 +153,10 @@ function build_test_queue() {
     energy.writeUInt16BE(90, 36);
     energy.writeUInt16BE(100, 38);
     energy.writeUInt16BE(110, 40);
-    energy.writeUInt16BE(120, 42);
-    energy.writeUInt16BE(130, 44);
-    energy.writeUInt16BE(140, 46);
+    energy.writeUInt16BE(0, 42);
+    energy.writeUInt16BE(120, 44);
+    energy.writeUInt16BE(130, 46);
+    energy.writeUInt16BE(140, 48);
 
     testQueue.push(build_lora_packet_buffer('c098e5120000', 'lab11/energy', energy));
     testQueue.push(build_lora_packet_buffer('c098e5120000', 'signpost/control/energy', energy));
@@ -252,6 +297,37 @@ function build_test_queue() {
     httpList.push({'topic': 'lab11/spectrum', 'data': spectrum});
     httpList.push({'topic': 'lab11/spectrum/ws_max', 'data': spectrum2});
 
+    // interned topics, including an id from another epoch that must be dropped
+    testQueue.push(build_lora_record_buffer('c098e5120000', build_define_record(3, 0x5a, 'lab11/ambient/tphl', ambient)));
+    testQueue.push(build_lora_record_buffer('c098e5120000', build_interned_record(3, 0x5a, ambient)));
+    testQueue.push(build_lora_record_buffer('c098e5120000', build_interned_record(3, 0x5b, ambient)));
+    httpList.push({'record': build_define_record(4, 0x21, 'lab11/ambient/tphl', ambient)});
+    httpList.push({'record': build_interned_record(4, 0x21, ambient)});
+    httpList.push({'record': build_interned_record(4, 0x22, ambient)});
+
+    memory = Buffer.alloc(44);
+    memory.writeUInt8(0x01, 0);
+    memory.writeUInt8(3, 1);
+    memory.writeUInt16BE(1200, 2);
+    memory.writeUInt16BE(2400, 4);
+    memory.writeUInt16BE(300, 6);
+    memory.writeUInt16BE(600, 8);
+    memory.writeUInt16BE(0, 10);
+    memory.writeUInt16BE(1800, 12+2*3);
+    testQueue.push(build_lora_packet_buffer('c098e5120000', 'signpost/control/memory', memory));
+    httpList.push({'topic': 'signpost/control/memory', 'data': memory});
+
+    memory_answer = {
+                    device: 'signpost_memory',
+                    module: 3,
+                    stack_free_bytes: 1200,
+                    stack_peak_bytes: 2400,
+                    heap_current_bytes: 300,
+                    heap_peak_bytes: 600,
+                    heap_failures: 0,
+                    networking_stack_peak_bytes: 1800,
+    }
+
     spectrum_answer = {};
     spectrum_answer['device'] = 'signpost_rf_spectrum_max';
     for (var i = 0; i < 80; i++) {
@@ -282,6 +358,9 @@ function build_test_queue() {
     }
     answerQueue.push(spectrum_answer);
     answerQueue.push(spectrum_answer);
+    answerQueue.push(ambient_answer);
+    answerQueue.push(ambient_answer);
+    answerQueue.push(memory_answer);
 
     //now add the http part of the answer queue
     answerQueue.push(energy_answer);
@@ -304,6 +383,9 @@ function build_test_queue() {
     }
     answerQueue.push(spectrum_answer);
     answerQueue.push(spectrum_answer);
+    answerQueue.push(ambient_answer);
+    answerQueue.push(ambient_answer);
+    answerQueue.push(memory_answer);
 }
 
 
@@ -12,6 +12,7 @@ var mqtt          = require('mqtt');
 var addr          = require('os').networkInterfaces();
 var express       = require('express');
 var expressBodyParser       = require('body-parser');
+var uplink_record = require('../uplink-record/uplink-record');
 
 //check to see if there was a conf file passed in
 var http_conf_file_location = '';
@@ -81,29 +82,22 @@ function parse (buf) {
         //console.log('total len: ' + total_len);
         index += 2;
         var start_index = index;
-        var tlen = buf.readUInt8(index);
-        if(tlen + 2 > total_len) {
-            console.log("Topic length parsing error - continuing");
+        var record = uplink_record.parse_record(addr, buf, index);
+        if(record.index != start_index + total_len) {
+            console.log("Record length parsing error - continuing");
             index = start_index + total_len;
             continue;
         }
-
-        //console.log("Topic length is: " + tlen);
-        index += 1;
-        var topic = buf.toString('utf-8',index, index+tlen);
-        //console.log("topic: " + topic.toString("utf8"));
-        index += tlen;
-        var dlen = buf.readUInt8(index);
-        if(tlen + dlen + 2 > total_len) {
-            console.log("Data length parsing error - continuing");
-            index = start_index + total_len;
+        index = record.index;
+        if(record.topic === undefined) {
+            console.log("Unknown topic id from " + addr + " - dropping");
+            if(buf.length <= index) {
+                done = true;
+            }
             continue;
         }
-
-        //console.log("Data length is: " + dlen);
-        index += 1;
-        var data = buf.slice(index,index+dlen);
-        index += dlen;
+        var topic = record.topic;
+        var data = record.data;
         pcount += 1;
         ret[pcount.toString()] = {};
         ret[pcount.toString()].topic = topic;
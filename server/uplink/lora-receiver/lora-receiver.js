@@ -10,6 +10,7 @@ var fs            = require('fs');
 var ini           = require('ini');
 var mqtt          = require('mqtt');
 var addr          = require('os').networkInterfaces();
+var uplink_record = require('../uplink-record/uplink-record');
 
 //check to see if there was a conf file passed in
 var lora_conf_file_location = '';
@@ -91,14 +92,17 @@ function parse (buf) {
     var pcount = 0;
     var ret = {};
     while(done == false) {
-        var tlen = buf.readUInt8(index);
-        index += 1;
-        var topic = buf.toString('utf-8',index, index+tlen);
-        index += tlen;
-        var dlen = buf.readUInt8(index);
-        index += 1;
-        var data = buf.slice(index,index+dlen);
-        index += dlen;
+        var record = uplink_record.parse_record(addr, buf, index);
+        index = record.index;
+        if(buf.length <= index) {
+            done = true;
+        }
+        if(record.topic === undefined) {
+            console.log('Unknown topic id from ' + addr + ' - dropping');
+            continue;
+        }
+        var topic = record.topic;
+        var data = record.data;
         pcount += 1;
         ret[pcount.toString()] = {}; 
         ret[pcount.toString()].topic = topic; 
@@ -108,10 +112,6 @@ function parse (buf) {
         ret[pcount.toString()].topublish.received_time = new Date().toISOString();
         ret[pcount.toString()].topublish.device_id = addr;
         ret[pcount.toString()].topublish.sequence_number = sequence_number;
-
-        if(buf.length <= index) {
-            done = true;
-        }
     }
 
     return ret;
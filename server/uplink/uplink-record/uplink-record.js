@@ -0,0 +1,50 @@
+//
+// Uplink record parsing shared by the LoRa and HTTP receivers
+//
+
+// Topic interning. The radio replaces the topic string with a small id
+// once it has defined that id. A record is one of
+//   [tlen][topic][dlen][data]                    tlen < 0x80
+//   [0xFF][id][epoch][tlen][topic][dlen][data]   defines id for this epoch
+//   [0x80|id][epoch][dlen][data]                 uses a defined id
+// The epoch changes each time the radio boots.
+var TOPIC_INTERNED = 0x80;
+var TOPIC_DEFINE = 0xFF;
+var topic_ids = {};
+
+// Returns {topic, data, index} where index is just past the record.
+// topic is undefined if the record uses an id we haven't seen defined.
+exports.parse_record = function (addr, buf, index) {
+    var first = buf.readUInt8(index);
+    var id, epoch, topic, tlen;
+    if(first == TOPIC_DEFINE) {
+        id = buf.readUInt8(index+1);
+        epoch = buf.readUInt8(index+2);
+        index += 3;
+        tlen = buf.readUInt8(index);
+        index += 1;
+        topic = buf.toString('utf-8', index, index+tlen);
+        index += tlen;
+        topic_ids[addr] = topic_ids[addr] || {};
+        topic_ids[addr][epoch] = topic_ids[addr][epoch] || {};
+        topic_ids[addr][epoch][id] = topic;
+    } else if(first & TOPIC_INTERNED) {
+        id = first & ~TOPIC_INTERNED;
+        epoch = buf.readUInt8(index+1);
+        index += 2;
+        if(topic_ids[addr] && topic_ids[addr][epoch]) {
+            topic = topic_ids[addr][epoch][id];
+        }
+    } else {
+        tlen = first;
+        index += 1;
+        topic = buf.toString('utf-8', index, index+tlen);
+        index += tlen;
+    }
+
+    var dlen = buf.readUInt8(index);
+    index += 1;
+    var data = buf.slice(index, index+dlen);
+    index += dlen;
+    return {topic: topic, data: data, index: index};
+};
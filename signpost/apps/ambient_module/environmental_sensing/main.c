@@ -20,6 +20,8 @@
 // signpost includes
 #include "app_watchdog.h"
 #include "signpost_api.h"
+#include "signpost_payloads.h"
+#include "signpost_reactor.h"
 
 // module-specific settings
 #define AMBIENT_MODULE_I2C_ADDRESS 0x32
@@ -35,7 +37,7 @@ typedef struct {
 } Sensor_Data_t;
 static Sensor_Data_t samples = {0};
 
-uint8_t message_buf[20] = {0};
+uint8_t message_buf[SIGNPOST_PAYLOAD_AMBIENT_LEN] = {0};
 
 // keep track of whether functions succeeded
 static bool sample_sensors_successful = true;
@@ -87,15 +89,13 @@ static void sample_sensors (void) {
   samples.err_code = err_code;
 
   //also put them in the send buffer
-  message_buf[1] = (uint8_t) ((temperature >> 8) & 0xFF);
-  message_buf[2] = (uint8_t) (temperature & 0xFF);
-  message_buf[3] = (uint8_t) ((humidity >> 8) & 0xFF);
-  message_buf[4] = (uint8_t) (humidity & 0xFF);
-  message_buf[5] = (uint8_t) ((light >> 8) & 0xFF);
-  message_buf[6] = (uint8_t) (light & 0xFF);
-  message_buf[7] = (uint8_t) ((pressure >> 16) & 0xFF);
-  message_buf[8] = (uint8_t) ((pressure >> 8) & 0xFF);
-  message_buf[9] = (uint8_t) (pressure & 0xFF);
+  signpost_payload_ambient_t message = {
+    .temperature = temperature,
+    .humidity = humidity,
+    .light = light,
+    .pressure = pressure,
+  };
+  signpost_payload_ambient_encode(&message, message_buf, sizeof(message_buf));
 
   // track success
   if (err_code != TOCK_SUCCESS) {
@@ -109,7 +109,7 @@ static void post_to_radio (void) {
 
   //send radio the data
   printf("--Sending data--\n");
-  int response = signpost_networking_publish("tphl", message_buf, 10);
+  int response = signpost_networking_publish("tphl", message_buf, sizeof(message_buf));
   if (response < TOCK_SUCCESS) {
     printf("Error posting: %d\n", response);
     post_to_radio_successful = false;
@@ -132,7 +132,6 @@ int main (void) {
   } while (rc < 0);
   printf(" * Bus initialized\n");
 
-  message_buf[0] = 0x01;
   // set up watchdog
   // Resets after 30 seconds without a valid response
   app_watchdog_set_kernel_timeout(10000);
@@ -144,13 +143,13 @@ int main (void) {
   // sample from onboard sensors
   sample_sensors();
   printf("Done sampling sensors\n");
-  delay_ms(2000);
+  signpost_reactor_delay_ms(2000);
 
   // send HTTP POST over Signpost API
     do {
         post_to_radio();
         if(post_to_radio_successful == false) {
-            delay_ms(1000);
+            signpost_reactor_delay_ms(1000);
         }
 
     } while(post_to_radio_successful == false);
@@ -159,7 +158,7 @@ int main (void) {
   printf("requesting duty cycle\n");
   while(true) {
     signpost_energy_duty_cycle(180000);
-    delay_ms(1000);
+    signpost_reactor_delay_ms(1000);
   }
 }
 
@@ -17,6 +17,8 @@
 #include "i2c_master_slave.h"
 #include "timer.h"
 #include "signpost_api.h"
+#include "signpost_payloads.h"
+#include "signpost_reactor.h"
 
 #define STROBE 3
 #define RESET 4
@@ -25,8 +27,8 @@
 #define RED_LED 3
 #define BUFFER_SIZE 20
 
-uint8_t send_buf[100];
-uint8_t send_buf2[100];
+static signpost_payload_audio_spectrum_batch_t batch;
+uint8_t send_buf[SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_LEN];
 bool sample_done = false;
 bool still_sampling = false;
 
@@ -145,10 +147,10 @@ static void timer_callback (
     static int count = 0;
 
     //calculate the band averages over the timer period
-    //and pack them into the send buf
+    //and add them to the batch
 
     for(uint8_t j = 0; j < 7; j++) {
-        send_buf[5+count*7+j] = (uint8_t)(((uint8_t)(bands_total[j]/(float)bands_num[j])) & 0xff);
+        batch.bands[count*7+j] = (uint8_t)(((uint8_t)(bands_total[j]/(float)bands_num[j])) & 0xff);
     }
 
     //reset all the variables for the next period
@@ -163,11 +165,11 @@ static void timer_callback (
     count++;
 
     if(count == 10) {
-        memcpy(send_buf2,send_buf,100);
+        int len = signpost_payload_audio_spectrum_batch_encode(&batch, send_buf, sizeof(send_buf));
         count = 0;
 
         printf("About to send data to radio\n");
-        rc = signpost_networking_publish("spectrum",send_buf2,75);
+        rc = signpost_networking_publish("spectrum",send_buf,len);
         printf("Sent data with return code %d\n\n\n",rc);
 
         if(rc >= 0 && still_sampling == true) {
@@ -180,17 +182,10 @@ static void timer_callback (
         if(rc < 0) {
             printf("Failed to get time - assuming 10 seconds\n");
             utime += 10;
-            send_buf[1] = (uint8_t)((utime & 0xff000000) >> 24);
-            send_buf[2] = (uint8_t)((utime & 0xff0000) >> 16);
-            send_buf[3] = (uint8_t)((utime & 0xff00) >> 8);
-            send_buf[4] = (uint8_t)((utime & 0xff));
         } else {
             printf("Got time with %d satellites\n",rc);
-            send_buf[1] = (uint8_t)((utime & 0xff000000) >> 24);
-            send_buf[2] = (uint8_t)((utime & 0xff0000) >> 16);
-            send_buf[3] = (uint8_t)((utime & 0xff00) >> 8);
-            send_buf[4] = (uint8_t)((utime & 0xff));
         }
+        batch.time = utime;
     }
 }
 
@@ -213,8 +208,6 @@ int main (void) {
     gpio_clear(8);
     gpio_clear(9);
 
-    send_buf[0] = 0x03;
-
     gpio_enable_output(STROBE);
     gpio_enable_output(RESET);
     gpio_enable_output(POWER);
@@ -236,4 +229,7 @@ int main (void) {
     printf("Starting timer\n");
     static tock_timer_t send_timer;
     timer_every(1000, timer_callback, NULL, &send_timer);
+
+    // handle messages from the loop while the timer does the work
+    signpost_reactor_run();
 }
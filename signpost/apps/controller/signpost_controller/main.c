@@ -16,12 +16,15 @@
 #include "gps.h"
 #include "minmea.h"
 #include "signpost_api.h"
+#include "signpost_payloads.h"
+#include "signpost_reactor.h"
 #include "signpost_energy_policy.h"
 #include "signpost_energy_monitors.h"
 #include "signpost_controller.h"
 
-uint8_t gps_buf[20];
-uint8_t energy_buf[60];
+uint8_t gps_buf[SIGNPOST_PAYLOAD_GPS_LEN];
+uint8_t energy_buf[SIGNPOST_PAYLOAD_ENERGY_LEN];
+uint8_t memory_buf[SIGNPOST_PAYLOAD_MEMORY_LEN];
 
 static void send_gps_update (__attribute__((unused)) int now,
                                 __attribute__((unused)) int experation,
@@ -34,32 +37,28 @@ static void send_gps_update (__attribute__((unused)) int now,
   printf("Getting time location\n");
   signpost_controller_get_gps(&time,&location);
 
-  gps_buf[1] = time.day;
-  gps_buf[2] = time.month;
+  signpost_payload_gps_t gps;
+  gps.day = time.day;
+  gps.month = time.month;
   //currently represented as a full year (i.e. uint16_t: 2017)
   //convert to uint8_t by subtracting 2000
-  gps_buf[3] = (time.year - 2000);
-  gps_buf[4] = time.hours;
-  gps_buf[5] = time.minutes;
-  gps_buf[6] = time.seconds;
-  gps_buf[7] = ((location.latitude & 0xFF000000) >> 24);
-  gps_buf[8] = ((location.latitude & 0x00FF0000) >> 16);
-  gps_buf[9] = ((location.latitude & 0x0000FF00) >> 8);
-  gps_buf[10] = ((location.latitude & 0x000000FF));
-  gps_buf[11] = ((location.longitude & 0xFF000000) >> 24);
-  gps_buf[12] = ((location.longitude & 0x00FF0000) >> 16);
-  gps_buf[13] = ((location.longitude & 0x0000FF00) >> 8);
-  gps_buf[14] = ((location.longitude & 0x000000FF));
+  gps.year = (time.year - 2000);
+  gps.hours = time.hours;
+  gps.minutes = time.minutes;
+  gps.seconds = time.seconds;
+  gps.latitude = location.latitude;
+  gps.longitude = location.longitude;
   if(time.satellite_count >= 3) {
-    gps_buf[15] = 0x02;
+    gps.fix = 0x02;
   } else if (time.satellite_count >=4) {
-    gps_buf[15] = 0x03;
+    gps.fix = 0x03;
   } else {
-    gps_buf[15] = 0x01;
+    gps.fix = 0x01;
   }
-  gps_buf[16] = time.satellite_count;
+  gps.satellite_count = time.satellite_count;
+  int len = signpost_payload_gps_encode(&gps, gps_buf, sizeof(gps_buf));
   printf("Sending GPS packet\n");
-  int rc = signpost_networking_publish("gps",gps_buf,18);
+  int rc = signpost_networking_publish("gps",gps_buf,len);
   if(rc < 0) printf("Error sending GPS packet\n");
   else {
     signpost_controller_app_watchdog_tickle();
@@ -85,23 +84,14 @@ static void send_energy_update (__attribute__((unused)) int now,
   printf("\tSolar Voltage (mV): %d\tcurrent (uA): %d\n",solar_voltage,solar_current);
   printf("/**************************************/\n");
 
-  energy_buf[1] = ((battery_voltage & 0xFF00) >> 8);
-  energy_buf[2] = ((battery_voltage & 0xFF));
-  energy_buf[3] = ((battery_current & 0xFF000000) >> 24);
-  energy_buf[4] = ((battery_current & 0xFF0000) >> 16);
-  energy_buf[5] = ((battery_current & 0xFF00) >> 8);
-  energy_buf[6] = ((battery_current & 0xFF));
-  energy_buf[7] = ((solar_voltage & 0xFF00) >> 8);
-  energy_buf[8] = ((solar_voltage & 0xFF));
-  energy_buf[9] = ((solar_current & 0xFF000000) >> 24);
-  energy_buf[10] = ((solar_current & 0xFF0000) >> 16);
-  energy_buf[11] = ((solar_current & 0xFF00) >> 8);
-  energy_buf[12] = ((solar_current & 0xFF));
-  energy_buf[13] = battery_percent;
-  energy_buf[14] = ((battery_energy & 0xFF00) >> 8);
-  energy_buf[15] = ((battery_energy & 0xFF));
-  energy_buf[16] = ((battery_full & 0xFF00) >> 8);
-  energy_buf[17] = ((battery_full & 0xFF));
+  signpost_payload_energy_t energy;
+  energy.battery_voltage_mV = battery_voltage;
+  energy.battery_current_uA = battery_current;
+  energy.solar_voltage_mV = solar_voltage;
+  energy.solar_current_uA = solar_current;
+  energy.battery_capacity_percent_remaining = battery_percent;
+  energy.battery_capacity_remaining_mAh = battery_energy;
+  energy.battery_capacity_full_mAh = battery_full;
 
   signpost_energy_remaining_t rem;
   printf("/**************************************/\n");
@@ -116,22 +106,14 @@ static void send_energy_update (__attribute__((unused)) int now,
   printf("/**************************************/\n");
 
   //send this data to the radio module
-  energy_buf[18] = (((rem.module_energy_remaining[0]/1000) & 0xFF00) >> 8 );
-  energy_buf[19] = (((rem.module_energy_remaining[0]/1000) & 0xFF));
-  energy_buf[20] = (((rem.module_energy_remaining[1]/1000) & 0xFF00) >> 8 );
-  energy_buf[21] = (((rem.module_energy_remaining[1]/1000) & 0xFF));
-  energy_buf[22] = (((rem.module_energy_remaining[2]/1000) & 0xFF00) >> 8 );
-  energy_buf[23] = (((rem.module_energy_remaining[2]/1000) & 0xFF));
-  energy_buf[24] = (((rem.controller_energy_remaining/1000) & 0xFF00) >> 8 );
-  energy_buf[25] = (((rem.controller_energy_remaining/1000) & 0xFF));
-  energy_buf[26] = 0;
-  energy_buf[27] = 0;
-  energy_buf[28] = (((rem.module_energy_remaining[5]/1000) & 0xFF00) >> 8 );
-  energy_buf[29] = (((rem.module_energy_remaining[5]/1000) & 0xFF));
-  energy_buf[30] = (((rem.module_energy_remaining[6]/1000) & 0xFF00) >> 8 );
-  energy_buf[31] = (((rem.module_energy_remaining[6]/1000) & 0xFF));
-  energy_buf[32] = (((rem.module_energy_remaining[7]/1000) & 0xFF00) >> 8 );
-  energy_buf[33] = (((rem.module_energy_remaining[7]/1000) & 0xFF));
+  energy.module0_energy_remaining_mWh = rem.module_energy_remaining[0]/1000;
+  energy.module1_energy_remaining_mWh = rem.module_energy_remaining[1]/1000;
+  energy.module2_energy_remaining_mWh = rem.module_energy_remaining[2]/1000;
+  energy.controller_energy_remaining_mWh = rem.controller_energy_remaining/1000;
+  energy.linux_energy_remaining_mWh = 0;
+  energy.module5_energy_remaining_mWh = rem.module_energy_remaining[5]/1000;
+  energy.module6_energy_remaining_mWh = rem.module_energy_remaining[6]/1000;
+  energy.module7_energy_remaining_mWh = rem.module_energy_remaining[7]/1000;
 
   //signpost energy average
   signpost_energy_average_t av;
@@ -145,26 +127,19 @@ static void send_energy_update (__attribute__((unused)) int now,
     printf("\t\tModule %d Energy Average: %d uW\n",i,av.module_energy_average[i]);
   }
   printf("/**************************************/\n");
-  energy_buf[34] = (((av.module_energy_average[0]/1000) & 0xFF00) >> 8 );
-  energy_buf[35] = (((av.module_energy_average[0]/1000) & 0xFF));
-  energy_buf[36] = (((av.module_energy_average[1]/1000) & 0xFF00) >> 8 );
-  energy_buf[37] = (((av.module_energy_average[1]/1000) & 0xFF));
-  energy_buf[38] = (((av.module_energy_average[2]/1000) & 0xFF00) >> 8 );
-  energy_buf[39] = (((av.module_energy_average[2]/1000) & 0xFF));
-  energy_buf[40] = (((av.controller_energy_average/1000) & 0xFF00) >> 8 );
-  energy_buf[41] = (((av.controller_energy_average/1000) & 0xFF));
-  energy_buf[42] = 0;
-  energy_buf[43] = 0;
-  energy_buf[44] = (((av.module_energy_average[5]/1000) & 0xFF00) >> 8 );
-  energy_buf[45] = (((av.module_energy_average[5]/1000) & 0xFF));
-  energy_buf[46] = (((av.module_energy_average[6]/1000) & 0xFF00) >> 8 );
-  energy_buf[47] = (((av.module_energy_average[6]/1000) & 0xFF));
-  energy_buf[48] = (((av.module_energy_average[7]/1000) & 0xFF00) >> 8 );
-  energy_buf[49] = (((av.module_energy_average[7]/1000) & 0xFF));
+  energy.module0_energy_average_mW = av.module_energy_average[0]/1000;
+  energy.module1_energy_average_mW = av.module_energy_average[1]/1000;
+  energy.module2_energy_average_mW = av.module_energy_average[2]/1000;
+  energy.controller_energy_average_mW = av.controller_energy_average/1000;
+  energy.linux_energy_average_mW = 0;
+  energy.module5_energy_average_mW = av.module_energy_average[5]/1000;
+  energy.module6_energy_average_mW = av.module_energy_average[6]/1000;
+  energy.module7_energy_average_mW = av.module_energy_average[7]/1000;
 
   int rc;
+  int len = signpost_payload_energy_encode(&energy, energy_buf, sizeof(energy_buf));
   printf("Sending energy update packet\n");
-  rc = signpost_networking_publish("energy",energy_buf,51);
+  rc = signpost_networking_publish("energy",energy_buf,len);
   if(rc < 0) printf("Error sending energy packet\n");
   else {
     signpost_controller_app_watchdog_tickle();
@@ -173,6 +148,36 @@ static void send_energy_update (__attribute__((unused)) int now,
 
 }
 
+static void send_memory_update (__attribute__((unused)) int now,
+                                __attribute__((unused)) int experation,
+                                __attribute__((unused)) int unused,
+                                __attribute__((unused)) void* ud) {
+
+  for(uint8_t i = 0; i < 8; i++) {
+    signpost_memstats_t stats;
+    int rc = signpost_controller_get_memstats(i, &stats);
+    if(rc < 0) continue;
+
+    printf("Module %d stack free %u peak %u, heap %u peak %u\n", i,
+        stats.stack_free, stats.stack_peak, stats.heap_current, stats.heap_peak);
+
+    signpost_payload_memory_t memory;
+    memory.module = i;
+    memory.stack_free = stats.stack_free;
+    memory.stack_peak = stats.stack_peak;
+    memory.heap_current = stats.heap_current;
+    memory.heap_peak = stats.heap_peak;
+    memory.heap_failures = stats.heap_failures;
+    for(uint8_t j = 0; j < SIGNPOST_MEMSTATS_API_SLOTS; j++) {
+      memory.api_stack_peak[j] = stats.api_stack_peak[j];
+    }
+
+    int len = signpost_payload_memory_encode(&memory, memory_buf, sizeof(memory_buf));
+    rc = signpost_networking_publish("memory",memory_buf,len);
+    if(rc < 0) printf("Error sending memory packet\n");
+  }
+}
+
 
 int main (void) {
   printf("[Controller] ** Main App **\n");
@@ -181,24 +186,19 @@ int main (void) {
   signpost_controller_init();
 
   printf("Done initializing\n");
-
-  ///////////////////
-  // Local Operations
-  // ================
-  //
-  // Initializations that only touch the controller board
-  energy_buf[0] = 0x01;
-
-  gps_buf[0] = 0x02;
-
   printf("Everything intialized\n");
 
 
   //setup timers to send status updates to the radio
   static tock_timer_t energy_send_timer;
   timer_every(60000, send_energy_update, NULL, &energy_send_timer);
-  delay_ms(30000);
+  signpost_reactor_delay_ms(30000);
   static tock_timer_t gps_send_timer;
   timer_every(60000, send_gps_update, NULL, &gps_send_timer);
+  static tock_timer_t memory_send_timer;
+  timer_every(600000, send_memory_update, NULL, &memory_send_timer);
+
+  // handle messages from the loop while the timers do the work
+  signpost_reactor_run();
 }
 
@@ -8,6 +8,7 @@
 
 #include "controller.h"
 #include "signpost_controller.h"
+#include "signpost_reactor.h"
 
 int main (void) {
   printf("[Controller] ** Main App **\n");
@@ -23,5 +24,8 @@ int main (void) {
   //app_watchdog_start();
 
   printf("Everything intialized\n");
+
+  // handle messages from the loop
+  signpost_reactor_run();
 }
 
@@ -15,6 +15,7 @@
 #include "app_watchdog.h"
 #include "gpio_async.h"
 #include "gps.h"
+#include "signpost_reactor.h"
 
 
 static uint8_t src;
@@ -153,4 +154,6 @@ int main (void) {
   app_watchdog_set_kernel_timeout(500);
   app_watchdog_start();
 
+  // handle messages from the loop
+  signpost_reactor_run();
 }
@@ -15,7 +15,7 @@
 static DigitalOut Debug(DEBUG_LED);
 static DigitalOut ModOut(MOD_OUT);
 static InterruptIn ModIn(MOD_IN);
-static DigitalIn pps(PPS);
+static InterruptIn pps(PPS);
 static Serial DBG(SERIAL_TX, SERIAL_RX, 115200);
 static I2CSlave* I2Creader = NULL;
 static uint8_t address;
@@ -189,6 +189,26 @@ int port_signpost_mod_in_disable_interrupt(void) {
     return PORT_SUCCESS;
 }
 
+static port_signpost_callback pps_cb = NULL;
+static void pps_rising() {
+    if(pps_cb) {
+        pps_cb(PORT_SUCCESS);
+    }
+}
+
+int port_signpost_pps_enable_interrupt_rising(port_signpost_callback cb) {
+    pps.rise(&pps_rising);
+    pps_cb = cb;
+    pps.enable_irq();
+    return PORT_SUCCESS;
+}
+
+int port_signpost_pps_disable_interrupt(void) {
+    pps.disable_irq();
+    pps_cb = NULL;
+    return PORT_SUCCESS;
+}
+
 void port_signpost_wait_for(void* wait_on_true){
     while(!(*((bool*)wait_on_true))) {
         Thread::wait(1);
@@ -219,6 +239,14 @@ void port_signpost_delay_ms(unsigned ms) {
     Thread::wait(ms);
 }
 
+uint32_t port_signpost_timer_read(void) {
+    return us_ticker_read();
+}
+
+uint32_t port_signpost_timer_frequency(void) {
+    return 1000000;
+}
+
 int port_signpost_debug_led_on(void) {
     Debug = 1;
     return PORT_SUCCESS;
@@ -229,6 +257,11 @@ int port_signpost_debug_led_off(void){
     return PORT_SUCCESS;
 }
 
+int port_signpost_stack_bottom(uintptr_t* bottom) {
+    //threads each have their own stack, not measured for now
+    return PORT_ENOSUPPORT;
+}
+
 int port_rng_init(void) {
     return PORT_SUCCESS;
 }
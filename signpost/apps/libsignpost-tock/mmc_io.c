@@ -2,10 +2,36 @@
 #include "diskio.h"
 #include "ff.h"
 
+// A block that fails is tried this many times before the transfer fails
+#define SDCARD_BLOCK_TRIES 2
+
 static uint32_t block_size;
 static uint32_t card_kb;
 static DSTATUS status = STA_NOINIT;
 
+// The Tock sdcard driver moves one block per command, so multi-sector
+// transfers are issued block by block. Each block is checked so a failed
+// transfer is reported to FatFs rather than silently leaving stale data.
+static DRESULT read_block (BYTE* buff, DWORD sector) {
+  int err = -1;
+  for (int tries = 0; tries < SDCARD_BLOCK_TRIES && err < 0; tries++) {
+    err = sdcard_set_read_buffer(buff, _MAX_SS);
+    if (err < 0) continue;
+    err = sdcard_read_block_sync(sector);
+  }
+  return err < 0 ? RES_ERROR : RES_OK;
+}
+
+static DRESULT write_block (const BYTE* buff, DWORD sector) {
+  int err = -1;
+  for (int tries = 0; tries < SDCARD_BLOCK_TRIES && err < 0; tries++) {
+    err = sdcard_set_write_buffer((BYTE*) buff, _MAX_SS);
+    if (err < 0) continue;
+    err = sdcard_write_block_sync(sector);
+  }
+  return err < 0 ? RES_ERROR : RES_OK;
+}
+
 
 DSTATUS disk_initialize (BYTE pdrv) {
   if (pdrv != 0) {
@@ -40,8 +66,8 @@ DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count) {
   }
 
   for (UINT i = 0; i < count; i++) {
-    sdcard_set_read_buffer(buff + (_MAX_SS * i), _MAX_SS);
-    sdcard_read_block_sync(sector + i);
+    DRESULT res = read_block(buff + (_MAX_SS * i), sector + i);
+    if (res != RES_OK) return res;
   }
   return RES_OK;
 }
@@ -56,8 +82,8 @@ DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count) {
   }
 
   for (UINT i = 0; i < count; i++) {
-    sdcard_set_write_buffer((BYTE*)(buff + (_MAX_SS * i)), _MAX_SS);
-    sdcard_write_block_sync(sector + i);
+    DRESULT res = write_block(buff + (_MAX_SS * i), sector + i);
+    if (res != RES_OK) return res;
   }
   return RES_OK;
 }
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdarg.h>
 
+#include "alarm.h"
 #include "gpio.h"
 #include "console.h"
 #include "i2c_master_slave.h"
@@ -47,15 +48,20 @@ static void i2c_master_slave_callback(
     }
 }
 
-// Should be a linked list of callbacks and pins, but for now just keep track
-// of a single interrupt callback
+// Tock has one gpio interrupt callback per app, so it is shared between
+// mod_in and pps and dispatched on the pin
 static port_signpost_callback global_gpio_interrupt_cb;
+static port_signpost_callback global_pps_interrupt_cb;
 static void port_signpost_gpio_interrupt_callback(
-        __attribute__ ((unused)) int pin,
+        int pin,
         __attribute__ ((unused)) int state,
         __attribute__ ((unused)) int unused,
         __attribute__ ((unused)) void* callback_args) {
-    global_gpio_interrupt_cb(TOCK_SUCCESS);
+    if (pin == PPS) {
+        if (global_pps_interrupt_cb) global_pps_interrupt_cb(TOCK_SUCCESS);
+    } else if (global_gpio_interrupt_cb) {
+        global_gpio_interrupt_cb(TOCK_SUCCESS);
+    }
 }
 
 static uint8_t master_write_buf[PORT_I2C_MAX_LEN];
@@ -177,6 +183,26 @@ int port_signpost_mod_in_disable_interrupt(void) {
     return PORT_SUCCESS;
 }
 
+int port_signpost_pps_enable_interrupt_rising(port_signpost_callback cb) {
+    int rc;
+    global_pps_interrupt_cb = cb;
+    rc = gpio_interrupt_callback(port_signpost_gpio_interrupt_callback, NULL);
+    if (rc < 0) return PORT_FAIL;
+    rc = gpio_enable_input(PPS, PullNone);
+    if (rc < 0) return PORT_FAIL;
+    rc = gpio_enable_interrupt(PPS, RisingEdge);
+    if (rc < 0) return PORT_FAIL;
+    return PORT_SUCCESS;
+}
+
+int port_signpost_pps_disable_interrupt(void) {
+    int rc;
+    rc = gpio_disable_interrupt(PPS);
+    global_pps_interrupt_cb = NULL;
+    if (rc < 0) return PORT_FAIL;
+    return PORT_SUCCESS;
+}
+
 void port_signpost_wait_for(void* wait_on_true){
     yield_for(wait_on_true);
 }
@@ -192,6 +218,14 @@ void port_signpost_delay_ms(unsigned ms) {
     delay_ms(ms);
 }
 
+uint32_t port_signpost_timer_read(void) {
+    return alarm_read();
+}
+
+uint32_t port_signpost_timer_frequency(void) {
+    return alarm_internal_frequency();
+}
+
 int port_signpost_debug_led_on(void) {
     int rc;
     rc = led_on(DEBUG_LED);
@@ -206,6 +240,12 @@ int port_signpost_debug_led_off(void){
     return PORT_SUCCESS;
 }
 
+// Tock places the stack at the start of process memory, growing down to it
+int port_signpost_stack_bottom(uintptr_t* bottom) {
+    *bottom = (uintptr_t)tock_app_memory_begins_at();
+    return PORT_SUCCESS;
+}
+
 int port_rng_init(void) {
     return PORT_SUCCESS;
 }
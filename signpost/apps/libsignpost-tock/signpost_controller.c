@@ -5,6 +5,7 @@
 #include "port_signpost.h"
 #include "controller.h"
 #include "timer.h"
+#include "alarm.h"
 #include "gps.h"
 #include "fm25cl.h"
 #include <stdio.h>
@@ -36,6 +37,13 @@ typedef struct module_state {
     uint8_t watchdog_subscribed;
     uint8_t watchdog_tickled;
     uint8_t module_init_failures;
+    uint32_t init_start_time;
+    uint32_t declare_latency_ms;
+    uint32_t key_exchange_latency_ms;
+    uint8_t energy_subscribed;
+    uint8_t energy_level;
+    uint32_t energy_period_s;
+    uint32_t energy_notify_time;
 } signpost_controller_module_state_t;
 
 signpost_controller_module_state_t module_state[8] = {0};
@@ -46,10 +54,14 @@ int mod_isolated_in = -1;
 int last_mod_isolated_out = -1;
 size_t isolated_count = 0;
 size_t isolation_timeout_seconds = 10;
+// isolating a module cuts everyone else off the bus, so hold off while a
+// key exchange reply is still being sent
+static bool key_exchange_in_progress = false;
 uint8_t last_mod_out_state[NUM_MOD_IO] = {0};
 
 //time and location local
 static signpost_timelocation_time_t current_time;
+static uint32_t current_time_tick;
 static signpost_timelocation_location_t current_location;
 
 //FRAM and persistent energy storage data
@@ -88,6 +100,19 @@ static void enable_all_enabled_i2c(void) {
     }
 }
 
+static uint32_t ms_since(uint32_t start) {
+    // unsigned subtraction handles a wrapped counter
+    return (uint32_t)(((uint64_t)(alarm_read() - start) * 1000) / alarm_internal_frequency());
+}
+
+// Give the bus back to everyone once the isolated module is done with it
+static void release_isolation(void) {
+    gpio_set(mod_isolated_in);
+    mod_isolated_out = -1;
+    mod_isolated_in  = -1;
+    enable_all_enabled_i2c();
+}
+
 static void initialization_api_callback(uint8_t source_address,
     signbus_frame_type_t frame_type, signbus_api_type_t api_type,
     uint8_t message_type, __attribute__ ((unused)) size_t message_length,
@@ -126,7 +151,40 @@ static void initialization_api_callback(uint8_t source_address,
                     if (rc < 0) {
                       //printf(" - %d: Error responding to initialization declare request for module %d at address 0x%02x. Dropping.\n",
                        //   __LINE__, req_mod_num, source_address);
+                      break;
                     }
+
+                    // Isolation is only needed to hand out the address, any
+                    // key exchange happens afterwards on the shared bus so
+                    // the next module can be isolated in the meantime
+                    module_state[req_mod_num].declare_latency_ms = ms_since(module_state[req_mod_num].init_start_time);
+                    module_state[req_mod_num].module_init_failures = 0;
+                    // a module that declares again has restarted
+                    module_state[req_mod_num].energy_subscribed = 0;
+                    printf("INIT: Module %d declared as %s in %lu ms\n", req_mod_num, name,
+                        module_state[req_mod_num].declare_latency_ms);
+                    release_isolation();
+                    break;
+                }
+                case InitializationKeyExchange: {
+                    int mod_num = signpost_api_addr_to_mod_num(source_address);
+                    if (mod_num < 0) {
+                      signpost_api_error_reply_repeating(source_address, api_type, message_type, PORT_EINVAL, true, true, 1);
+                      break;
+                    }
+
+                    key_exchange_in_progress = true;
+                    rc = signpost_initialization_key_exchange_respond(source_address, message, message_length);
+                    key_exchange_in_progress = false;
+                    if (rc < 0) {
+                      printf("INIT: Key exchange with module %d failed: %d\n", mod_num, rc);
+                      signpost_api_error_reply_repeating(source_address, api_type, message_type, rc, true, true, 1);
+                      break;
+                    }
+
+                    module_state[mod_num].key_exchange_latency_ms = ms_since(module_state[mod_num].init_start_time);
+                    printf("INIT: Module %d exchanged keys %lu ms after isolation\n", mod_num,
+                        module_state[mod_num].key_exchange_latency_ms);
                     break;
                 }
                 case InitializationGetState: {
@@ -161,7 +219,7 @@ static void check_module_init_cb( __attribute__ ((unused)) int now,
     //tickle watchdog
     app_watchdog_combine(WATCH_LIB_INIT);
 
-    if (mod_isolated_out < 0) {
+    if (mod_isolated_out < 0 && !key_exchange_in_progress) {
         for (size_t i = 0; i < NUM_MOD_IO; i++) {
             if (gpio_read(MOD_OUTS[i]) == 0 && last_mod_isolated_out != MOD_OUTS[i] && last_mod_out_state[i] == 1 &&
                                                 module_state[MODOUT_pin_to_mod_name(MOD_OUTS[i])].isolation_state == ModuleEnabled) {
@@ -173,6 +231,7 @@ static void check_module_init_cb( __attribute__ ((unused)) int now,
                 last_mod_isolated_out = MOD_OUTS[i];
                 last_mod_out_state[i] = 0;
                 isolated_count = 0;
+                module_state[MODOUT_pin_to_mod_name(MOD_OUTS[i])].init_start_time = alarm_read();
 
                 // create private channel for this module
                 //XXX warn modules of i2c disable
@@ -182,26 +241,21 @@ static void check_module_init_cb( __attribute__ ((unused)) int now,
                 // XXX this should be a controller function operating on the
                 // module number, not index
                 gpio_clear(mod_isolated_in);
-                delay_ms(1000);
                 break;
             }
             // didn't isolate anyone, reset last_mod_isolated_out
             last_mod_isolated_out = -1;
         }
-    } else {
+    } else if (mod_isolated_out >= 0) {
         if (gpio_read(mod_isolated_out) == 1) {
             printf("ISOLATION: Module %d done with isolation\n", MODOUT_pin_to_mod_name(mod_isolated_out));
-            gpio_set(mod_isolated_in);
-            mod_isolated_out = -1;
-            mod_isolated_in  = -1;
-            enable_all_enabled_i2c();
             module_state[MODOUT_pin_to_mod_name(mod_isolated_out)].module_init_failures = 0;
+            release_isolation();
         }
         // this module took too long to talk to controller
         // XXX need more to police bad modules (repeat offenders)
         else if (isolated_count > isolation_timeout_seconds) {
             printf("ISOLATION: Module %d took too long\n", MODOUT_pin_to_mod_name(mod_isolated_out));
-            gpio_set(mod_isolated_in);
             module_state[MODOUT_pin_to_mod_name(mod_isolated_out)].module_init_failures++;
             if(module_state[MODOUT_pin_to_mod_name(mod_isolated_out)].module_init_failures > 4) {
                 //power cycle the module
@@ -211,9 +265,7 @@ static void check_module_init_cb( __attribute__ ((unused)) int now,
                 controller_module_enable_power(MODOUT_pin_to_mod_name(mod_isolated_out));
                 module_state[MODOUT_pin_to_mod_name(mod_isolated_out)].module_init_failures = 0;
             }
-            mod_isolated_out = -1;
-            mod_isolated_in  = -1;
-            enable_all_enabled_i2c();
+            release_isolation();
         } else {
           isolated_count++;
         }
@@ -258,9 +310,54 @@ static void duty_cycle_timer_cb( __attribute__ ((unused)) int now,
     free(dc);
 }
 
+static void get_energy_information(int mod_num, signpost_energy_information_t* info) {
+    info->energy_limit_uWh = (int)(signpost_energy_policy_get_module_energy_remaining_uwh(mod_num));
+    info->energy_used_since_reset_uWh = (int)(signpost_energy_policy_get_module_energy_used_uwh(mod_num));
+    info->time_since_reset_s = (int)(signpost_energy_policy_get_time_since_module_reset_ms(mod_num)/1000.0);
+    info->energy_limit_warning_threshold = (info->energy_limit_uWh < 1000000);
+    info->energy_limit_critical_threshold = (info->energy_limit_uWh < 200000);
+}
+
+// 0 for normal, 1 past the warning threshold, 2 past the critical threshold
+static uint8_t get_energy_level(signpost_energy_information_t* info) {
+    return info->energy_limit_warning_threshold + info->energy_limit_critical_threshold;
+}
+
+static void energy_notify_cb( __attribute__ ((unused)) int now,
+                            __attribute__ ((unused)) int expiration,
+                            __attribute__ ((unused)) int unused,
+                            __attribute__ ((unused)) void* ud) {
+
+    // push to subscribed modules when they cross a threshold in either
+    // direction, or when their period is up
+    for(uint8_t i = 0; i < 8; i++) {
+        if(i == 3 || i == 4) continue;
+        if(!module_state[i].energy_subscribed ||
+                module_state[i].isolation_state != ModuleEnabled) continue;
+
+        signpost_energy_information_t info;
+        get_energy_information(i, &info);
+        uint8_t level = get_energy_level(&info);
+
+        bool crossed = (level != module_state[i].energy_level);
+        bool period_up = (module_state[i].energy_period_s > 0 &&
+                ms_since(module_state[i].energy_notify_time)/1000 >= module_state[i].energy_period_s);
+        if(!crossed && !period_up) continue;
+
+        int rc = signpost_energy_notify(module_info.i2c_address_mods[i], &info);
+        if(rc < 0) {
+            // try again on the next check
+            printf("ENERGY: Failed to notify module %d: %d\n", i, rc);
+            continue;
+        }
+        module_state[i].energy_level = level;
+        module_state[i].energy_notify_time = alarm_read();
+    }
+}
+
 static void energy_api_callback(uint8_t source_address,
     signbus_frame_type_t frame_type, signbus_api_type_t api_type,
-    uint8_t message_type, __attribute__((unused)) size_t message_length, uint8_t* message) {
+    uint8_t message_type, size_t message_length, uint8_t* message) {
 
   //printf("CALLBACK_ENERGY: received energy api callback of type %d\n",message_type);
 
@@ -302,12 +399,7 @@ static void energy_api_callback(uint8_t source_address,
       signpost_energy_information_t info;
 
       int mod_num = signpost_api_addr_to_mod_num(source_address);
-
-      info.energy_limit_uWh = (int)(signpost_energy_policy_get_module_energy_remaining_uwh(mod_num));
-      info.energy_used_since_reset_uWh = (int)(signpost_energy_policy_get_module_energy_used_uwh(mod_num));
-      info.time_since_reset_s = (int)(signpost_energy_policy_get_time_since_module_reset_ms(mod_num)/1000.0);
-      info.energy_limit_warning_threshold = (info.energy_limit_uWh < 1000000);
-      info.energy_limit_critical_threshold = (info.energy_limit_uWh < 200000);
+      get_energy_information(mod_num, &info);
       //printf("Got energy query:\n");
       printf("\tLimit: %lu uWh\n",info.energy_limit_uWh);
       printf("\tUsed: %lu uWh\n",info.energy_used_since_reset_uWh);
@@ -344,6 +436,29 @@ static void energy_api_callback(uint8_t source_address,
 
         //reply to the report
         signpost_energy_report_reply(source_address, 1);
+    } else if (message_type == EnergySubscribeMessage) {
+        int mod_num = signpost_api_addr_to_mod_num(source_address);
+        if (mod_num < 0 || message_length < sizeof(uint32_t)) {
+          signpost_api_error_reply_repeating(source_address, api_type, message_type, PORT_EINVAL, true, true, 1);
+          return;
+        }
+
+        uint32_t period_s;
+        memcpy(&period_s, message, sizeof(uint32_t));
+        printf("CALLBACK_ENERGY: Module %d subscribed, period %lus\n", mod_num, period_s);
+
+        // the reply carries the current state, notifications start from it
+        signpost_energy_information_t info;
+        get_energy_information(mod_num, &info);
+        module_state[mod_num].energy_subscribed = 1;
+        module_state[mod_num].energy_period_s = period_s;
+        module_state[mod_num].energy_level = get_energy_level(&info);
+        module_state[mod_num].energy_notify_time = alarm_read();
+
+        rc = signpost_energy_subscribe_reply(source_address, &info);
+        if (rc < 0) {
+          signpost_api_error_reply_repeating(source_address, api_type, message_type, PORT_EI2C_WRITE, true, true, 1);
+        }
     } else if (message_type == EnergyResetMessage) {
         printf("CALLBACK_ENERGY: Received energy reset message from 0x%.2x\n", source_address);
 
@@ -386,6 +501,20 @@ static void timelocation_api_callback(uint8_t source_address,
         signpost_api_error_reply_repeating(source_address, api_type, message_type, PORT_EI2C_WRITE, true, true, 1);
       }
 
+    } else if (message_type == TimeLocationGetTimeNextPpsMessage) {
+      // The GPS reports the time of the PPS edge just before each fix. Say
+      // which edge that was and how long ago the fix came in, and let the
+      // module count edges from there against its own PPS line, rather than
+      // guess here which edge it will see next.
+      signpost_timelocation_pps_time_t pps_time;
+      memcpy(&pps_time.time,&current_time,sizeof(signpost_timelocation_time_t));
+      pps_time.ms_since_fix = ms_since(current_time_tick);
+      rc = signpost_timelocation_get_time_next_pps_reply(source_address, &pps_time);
+      if (rc < 0) {
+        printf(" - %d: Error sending TimeLocationGetTimeNextPpsMessage reply (code: %d).\n", __LINE__, rc);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, PORT_EI2C_WRITE, true, true, 1);
+      }
+
     } else if (message_type == TimeLocationGetLocationMessage) {
       signpost_timelocation_location_t location;
       memcpy(&location,&current_location,sizeof(signpost_timelocation_location_t));
@@ -435,6 +564,22 @@ void signpost_controller_get_gps(signpost_timelocation_time_t* time,
     memcpy(location, &current_location, sizeof(signpost_timelocation_location_t));
 }
 
+int signpost_controller_get_memstats(uint8_t mod_num, signpost_memstats_t* stats) {
+    if (mod_num >= NUM_MODULES) return PORT_EINVAL;
+
+    if (mod_num == 3) {
+        signpost_memstats_get(stats);
+        return PORT_SUCCESS;
+    }
+    // storage is always there, other modules only once they are up
+    if (mod_num != 4 && module_state[mod_num].isolation_state != ModuleEnabled) {
+        return PORT_FAIL;
+    }
+    if (module_info.i2c_address_mods[mod_num] == 0xff) return PORT_FAIL;
+
+    return signpost_debug_memstats_query(module_info.i2c_address_mods[mod_num], stats);
+}
+
 static void gps_callback (gps_data_t* gps_data) {
   //tickle watchdog
   app_watchdog_combine(WATCH_LIB_GPS);
@@ -450,6 +595,7 @@ static void gps_callback (gps_data_t* gps_data) {
   current_time.minutes = gps_data->minutes;
   current_time.seconds = gps_data->seconds;
   current_time.satellite_count = gps_data->satellite_count;
+  current_time_tick = alarm_read();
   current_location.latitude = gps_data->latitude;
   current_location.longitude = gps_data->longitude;
   current_location.satellite_count = gps_data->satellite_count;
@@ -563,70 +709,71 @@ enum DownlinkCommand {
     RESET
 };
 
-static void downlink_cb(char* topic, uint8_t* data, uint8_t data_len) {
+static int downlink_command(uint8_t* data, uint8_t data_len) {
     //what commands do we know how to handler
-    //topic = [module_name] on/off/reset
-    //topic = signpost reset
-    uint8_t command;
     if(!strncmp("on",(char*)data,data_len)) {
-        command = ON;
+        return ON;
     } else if(!strncmp("off",(char*)data,data_len)) {
-        command = OFF;
+        return OFF;
     } else if(!strncmp("reset",(char*)data,data_len)) {
-        command = RESET;
-    } else {
-        //we don't know this command
+        return RESET;
+    }
+    //we don't know this command
+    return -1;
+}
+
+static void downlink_signpost_cb(__attribute__ ((unused)) char* topic,
+        uint8_t* data, uint8_t data_len) {
+    //topic = signpost reset
+    if(downlink_command(data, data_len) == RESET) {
+        //go into failure mode and stop tickling the watchdog
+        hard_reset = true;
+    }
+    //can't do anything else for the whole signpost
+}
+
+static void downlink_module_cb(char* topic, uint8_t* data, uint8_t data_len) {
+    //topic = [module_name] on/off/reset
+    int command = downlink_command(data, data_len);
+    if(command < 0) {
         return;
     }
 
+    //search for a module info that we can do something about
+    int mod_num = signpost_api_module_name_to_mod_num(topic);
+    if(mod_num < 0) {
+        return;
+    }
 
-    if(!strncmp("signpost",topic,NAME_LEN)) {
-        if(command == RESET) {
-            //go into failure mode and stop tickling the watchdog
-            hard_reset = true;
+    switch(command) {
+    case ON:
+        if(signpost_energy_policy_get_module_energy_remaining_uwh(mod_num) > 0) {
+            //printf("Turning on %d\n",mod_num);
+            module_state[mod_num].isolation_state = ModuleEnabled;
+            controller_module_enable_power(mod_num);
+            controller_module_enable_i2c(mod_num);
         } else {
-            //can't do anything else for the whole signpost
-            return;
+            module_state[mod_num].isolation_state = ModuleDisabledEnergy;
         }
-    } else {
-        //search for a module info that we can do something about
-        int mod_num = signpost_api_module_name_to_mod_num(topic);
-        if(mod_num >= 0) {
-            switch(command) {
-            case ON:
-                if(signpost_energy_policy_get_module_energy_remaining_uwh(mod_num) > 0) {
-                    //printf("Turning on %d\n",mod_num);
-                    module_state[mod_num].isolation_state = ModuleEnabled;
-                    controller_module_enable_power(mod_num);
-                    controller_module_enable_i2c(mod_num);
-                } else {
-                    module_state[mod_num].isolation_state = ModuleDisabledEnergy;
-                }
-            break;
-            case OFF:
-                module_state[mod_num].isolation_state = ModuleDisabledOff;
+    break;
+    case OFF:
+        module_state[mod_num].isolation_state = ModuleDisabledOff;
 
-                //turn it off
-                controller_module_disable_power(mod_num);
-                controller_module_disable_i2c(mod_num);
-            break;
-            case RESET:
-                //printf("Resetting %d\n",mod_num);
-                if(signpost_energy_policy_get_module_energy_remaining_uwh(mod_num) > 0 &&
-                        module_state[mod_num].isolation_state == ModuleEnabled) {
-                    controller_module_disable_power(mod_num);
-                    delay_ms(300);
-                    controller_module_enable_power(mod_num);
-                }
-            break;
-            default:
-                return;
-            break;
-            }
-
-        } else {
-            return;
+        //turn it off
+        controller_module_disable_power(mod_num);
+        controller_module_disable_i2c(mod_num);
+    break;
+    case RESET:
+        //printf("Resetting %d\n",mod_num);
+        if(signpost_energy_policy_get_module_energy_remaining_uwh(mod_num) > 0 &&
+                module_state[mod_num].isolation_state == ModuleEnabled) {
+            controller_module_disable_power(mod_num);
+            delay_ms(300);
+            controller_module_enable_power(mod_num);
         }
+    break;
+    default:
+    break;
     }
 }
 
@@ -702,8 +849,15 @@ int signpost_controller_init (void) {
     static tock_timer_t check_watchdogs_timer;
     timer_every(60000, check_watchdogs_cb, NULL, &check_watchdogs_timer);
 
-    //setup the networking callback for radio downlink
-    rc = signpost_networking_subscribe(downlink_cb);
+    static tock_timer_t energy_notify_timer;
+    timer_every(1000, energy_notify_cb, NULL, &energy_notify_timer);
+
+    //setup the networking callbacks for radio downlink, module names
+    //are org/module so they never collide with the signpost topic
+    rc = signpost_networking_subscribe_topic("signpost", downlink_signpost_cb);
+    if(rc >= TOCK_SUCCESS) {
+        rc = signpost_networking_subscribe_topic("+/+", downlink_module_cb);
+    }
     if(rc < TOCK_SUCCESS) {
         //printf("Downlink callback registration failed\n");
     }
@@ -10,6 +10,9 @@ int signpost_controller_init (void);
 void signpost_controller_get_gps(signpost_timelocation_time_t* time, signpost_timelocation_location_t* location);
 void signpost_controller_app_watchdog_tickle (void);
 void signpost_controller_hardware_watchdog_tickle (void);
+// Stack and heap high-water marks of a module, or of the controller itself
+// for module 3. Returns PORT_FAIL for modules that are not up.
+int signpost_controller_get_memstats(uint8_t mod_num, signpost_memstats_t* stats);
 
 #ifdef __cplusplus
 }
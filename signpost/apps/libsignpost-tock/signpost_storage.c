@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <led.h>
 #include <timer.h>
 #include <sdcard.h>
@@ -8,10 +9,351 @@
 #include "ff.h"
 
 #include "signpost_api.h"
+#include "signpost_reactor.h"
 #include "signpost_storage.h"
+#include "signpost_trace.h"
 
 FATFS fs;           /* File system object */
 
+// Open files are kept in a small LRU cache, so a stream of appends to the
+// same log does not walk the directory and flush the FAT on every write.
+// Each handle keeps FatFs's own sector buffer, so small appends collect in
+// RAM and the card only sees whole sectors, plus the partial last one when
+// the file is synced. A file is synced once it has STORAGE_SYNC_BYTES
+// unsynced bytes, and all files are synced STORAGE_SYNC_PERIOD_MS after
+// their first unsynced write.
+typedef struct {
+  bool open;
+  char filename[STORAGE_LOG_LEN+1];
+  FIL fp;
+  uint32_t last_used;
+  size_t unsynced;
+  // timed records written since the last index entry
+  uint32_t since_index;
+  // circular logs, see below
+  bool circular;
+  bool header_dirty;
+  uint32_t capacity;
+  uint32_t start;
+  uint32_t end;
+} file_cache_t;
+
+static file_cache_t file_cache[STORAGE_FILE_CACHE_LEN];
+static uint32_t file_cache_clock = 0;
+static signpost_reactor_timer_t sync_timer;
+// set while only lazy writes are waiting on the timer
+static bool sync_timer_lazy = false;
+
+// Circular logs
+//
+// A circular log keeps at most its capacity of the newest data. The file is
+// preallocated as one contiguous block when it is made circular, so writes
+// never allocate clusters or grow the FAT however long it runs. The first
+// sector holds a header with the logical offsets of the oldest and next
+// bytes. Data byte n lives at CIRCULAR_DATA_OFFSET + n % capacity. Offsets
+// handed out are logical, so records stay valid until they are overwritten.
+//
+// The header must never cover data that is being overwritten, so before a
+// write reuses live space the new oldest offset is synced to the header,
+// and only then is the data written. The next offset follows when the file
+// is synced. The oldest offset moves a sector at a time, so the header is
+// not rewritten for every record once the log is full, at the cost of
+// dropping up to a sector of the oldest data early.
+#define CIRCULAR_MAGIC 0x4C435053   // "SPCL"
+#define CIRCULAR_DATA_OFFSET _MAX_SS
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t capacity;
+  uint32_t start;
+  uint32_t end;
+  uint32_t check;
+} circular_header_t;
+
+static uint32_t circular_check(circular_header_t* header) {
+  return ~(header->magic ^ header->capacity ^ header->start ^ header->end);
+}
+
+static FRESULT circular_write_header(file_cache_t* entry) {
+  if (!entry->header_dirty) return FR_OK;
+
+  circular_header_t header = {
+    .magic = CIRCULAR_MAGIC,
+    .capacity = entry->capacity,
+    .start = entry->start,
+    .end = entry->end,
+  };
+  header.check = circular_check(&header);
+
+  FRESULT res = f_lseek(&entry->fp, 0);
+  if (res != FR_OK) return res;
+  UINT written = 0;
+  res = f_write(&entry->fp, &header, sizeof(header), &written);
+  if (res != FR_OK) return res;
+  if (written < sizeof(header)) return FR_DENIED;
+  entry->header_dirty = false;
+  return FR_OK;
+}
+
+static void circular_read_header(file_cache_t* entry) {
+  entry->circular = false;
+  if (f_size(&entry->fp) < CIRCULAR_DATA_OFFSET) return;
+
+  circular_header_t header;
+  UINT bytes_read = 0;
+  if (f_lseek(&entry->fp, 0) != FR_OK ||
+      f_read(&entry->fp, &header, sizeof(header), &bytes_read) != FR_OK ||
+      bytes_read < sizeof(header)) return;
+  if (header.magic != CIRCULAR_MAGIC || header.check != circular_check(&header) ||
+      header.capacity == 0 || header.end - header.start > header.capacity) return;
+
+  entry->circular = true;
+  entry->header_dirty = false;
+  entry->capacity = header.capacity;
+  entry->start = header.start;
+  entry->end = header.end;
+}
+
+// Move len bytes between buf and the data region at logical offset,
+// wrapping at the end of the region
+static FRESULT circular_transfer(file_cache_t* entry, uint32_t offset, uint8_t* buf, size_t len, bool write) {
+  while (len > 0) {
+    size_t pos = offset % entry->capacity;
+    size_t n = entry->capacity - pos;
+    if (n > len) n = len;
+
+    FRESULT res = f_lseek(&entry->fp, CIRCULAR_DATA_OFFSET + pos);
+    if (res != FR_OK) return res;
+    UINT done = 0;
+    if (write) {
+      SIGNPOST_TRACE_BEGIN(SignpostTraceStorageWrite, n);
+      res = f_write(&entry->fp, buf, n, &done);
+      SIGNPOST_TRACE_END(SignpostTraceStorageWrite, done);
+    } else {
+      res = f_read(&entry->fp, buf, n, &done);
+    }
+    if (res != FR_OK) return res;
+    if (done < n) return FR_DENIED;
+
+    offset += n;
+    buf += n;
+    len -= n;
+  }
+  return FR_OK;
+}
+
+static FRESULT file_cache_close(file_cache_t* entry) {
+  if (!entry->open) return FR_OK;
+  FRESULT res = circular_write_header(entry);
+  entry->open = false;
+  entry->unsynced = 0;
+  FRESULT close_res = f_close(&entry->fp);
+  return res != FR_OK ? res : close_res;
+}
+
+static FRESULT file_cache_sync(file_cache_t* entry) {
+  if (!entry->open || entry->unsynced == 0) return FR_OK;
+  FRESULT res = circular_write_header(entry);
+  if (res == FR_OK) res = f_sync(&entry->fp);
+  if (res != FR_OK) {
+    // drop the handle rather than keep using one in an unknown state
+    file_cache_close(entry);
+    return res;
+  }
+  entry->unsynced = 0;
+  return FR_OK;
+}
+
+static void file_cache_sync_timer_cb(__attribute__ ((unused)) int arg,
+    __attribute__ ((unused)) void* ud) {
+  storage_sync();
+}
+
+static file_cache_t* file_cache_find(const char* filename) {
+  for (size_t i = 0; i < STORAGE_FILE_CACHE_LEN; i++) {
+    if (file_cache[i].open && !strncmp(file_cache[i].filename, filename, STORAGE_LOG_LEN)) {
+      file_cache[i].last_used = ++file_cache_clock;
+      return &file_cache[i];
+    }
+  }
+  return NULL;
+}
+
+// Logical size of an open file
+static size_t file_cache_size(file_cache_t* entry) {
+  return entry->circular ? entry->end : f_size(&entry->fp);
+}
+
+// Directory index
+//
+// Names and sizes of the files in the root directory, sorted by name, so
+// scans are answered from RAM. It is read from the card the first time it
+// is needed and then kept up to date as files are opened, written and
+// deleted. Sizes are logical, like storage_file_size.
+
+typedef struct {
+  char name[STORAGE_LOG_LEN+1];
+  size_t size;
+} dir_index_entry_t;
+
+static dir_index_entry_t* dir_index = NULL;
+static size_t dir_index_len = 0;
+static size_t dir_index_cap = 0;
+static bool dir_index_loaded = false;
+
+static void dir_index_drop(void) {
+  free(dir_index);
+  dir_index = NULL;
+  dir_index_len = 0;
+  dir_index_cap = 0;
+  dir_index_loaded = false;
+}
+
+// Position of name, or where it would be inserted
+static size_t dir_index_search(const char* name, bool* found) {
+  size_t lo = 0;
+  size_t hi = dir_index_len;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strncmp(dir_index[mid].name, name, STORAGE_LOG_LEN);
+    if (cmp == 0) {
+      *found = true;
+      return mid;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *found = false;
+  return lo;
+}
+
+static void dir_index_set(const char* name, size_t size) {
+  if (!dir_index_loaded) return;
+
+  bool found;
+  size_t i = dir_index_search(name, &found);
+  if (!found) {
+    if (dir_index_len == dir_index_cap) {
+      size_t cap = dir_index_cap + STORAGE_DIR_INDEX_GROW;
+      dir_index_entry_t* grown = realloc(dir_index, cap * sizeof(dir_index_entry_t));
+      if (grown == NULL) {
+        // read it from the card again when there is room
+        dir_index_drop();
+        return;
+      }
+      dir_index = grown;
+      dir_index_cap = cap;
+    }
+    memmove(&dir_index[i+1], &dir_index[i], (dir_index_len - i) * sizeof(dir_index_entry_t));
+    dir_index_len++;
+    strncpy(dir_index[i].name, name, STORAGE_LOG_LEN);
+    dir_index[i].name[STORAGE_LOG_LEN] = '\0';
+  }
+  dir_index[i].size = size;
+}
+
+static void dir_index_remove(const char* name) {
+  if (!dir_index_loaded) return;
+
+  bool found;
+  size_t i = dir_index_search(name, &found);
+  if (!found) return;
+  dir_index_len--;
+  memmove(&dir_index[i], &dir_index[i+1], (dir_index_len - i) * sizeof(dir_index_entry_t));
+}
+
+static int32_t dir_index_load(void) {
+  if (dir_index_loaded) return TOCK_SUCCESS;
+
+  DIR dir;
+  static FILINFO fno;
+  if (f_opendir(&dir, "") != FR_OK) return TOCK_FAIL;
+
+  dir_index_loaded = true;
+  FRESULT res;
+  while (1) {
+    res = f_readdir(&dir, &fno);
+    if (res != FR_OK || fno.fname[0] == 0) break;
+    if (fno.fattrib & AM_DIR) continue;
+
+    // the directory entry is behind for anything written since its sync
+    file_cache_t* entry = file_cache_find(fno.fname);
+    dir_index_set(fno.fname, entry != NULL ? file_cache_size(entry) : fno.fsize);
+    if (!dir_index_loaded) break;
+  }
+  f_closedir(&dir);
+
+  if (!dir_index_loaded) return TOCK_ENOMEM;
+  if (res != FR_OK) {
+    dir_index_drop();
+    return TOCK_FAIL;
+  }
+  return TOCK_SUCCESS;
+}
+
+// Get an open handle for filename, opening it in place of the least
+// recently used file if needed. Files are opened for both reading and
+// writing so one handle serves both. Only creates the file if create is set.
+static FRESULT file_cache_open(const char* filename, bool create, file_cache_t** entry_out) {
+  file_cache_t* entry = file_cache_find(filename);
+  if (entry != NULL) {
+    *entry_out = entry;
+    return FR_OK;
+  }
+
+  entry = &file_cache[0];
+  for (size_t i = 0; i < STORAGE_FILE_CACHE_LEN; i++) {
+    if (!file_cache[i].open) {
+      entry = &file_cache[i];
+      break;
+    }
+    if (file_cache[i].last_used < entry->last_used) {
+      entry = &file_cache[i];
+    }
+  }
+  // the evicted file's last writes land here, so a failure is this call's
+  FRESULT res = file_cache_close(entry);
+  if (res != FR_OK) return res;
+
+  BYTE mode = FA_READ | FA_WRITE | (create ? FA_OPEN_ALWAYS : FA_OPEN_EXISTING);
+  res = f_open(&entry->fp, filename, mode);
+  if (res != FR_OK) return res;
+
+  entry->open = true;
+  strncpy(entry->filename, filename, STORAGE_LOG_LEN);
+  entry->filename[STORAGE_LOG_LEN] = '\0';
+  entry->unsynced = 0;
+  // the count is lost when a file is closed, so index the next record
+  entry->since_index = STORAGE_INDEX_INTERVAL;
+  circular_read_header(entry);
+  entry->last_used = ++file_cache_clock;
+  // new files, and the logical size of circular ones
+  dir_index_set(filename, file_cache_size(entry));
+  *entry_out = entry;
+  return FR_OK;
+}
+
+int32_t storage_flush_data (const char* filename) {
+  if (filename[0] == '\0') return storage_sync();
+
+  file_cache_t* entry = file_cache_find(filename);
+  if (entry == NULL) return TOCK_SUCCESS;
+  if (file_cache_sync(entry) != FR_OK) return TOCK_FAIL;
+  return TOCK_SUCCESS;
+}
+
+int32_t storage_sync (void) {
+  int32_t rc = TOCK_SUCCESS;
+  for (size_t i = 0; i < STORAGE_FILE_CACHE_LEN; i++) {
+    if (file_cache_sync(&file_cache[i]) != FR_OK) rc = TOCK_FAIL;
+  }
+  if (sync_timer.active) signpost_reactor_timer_cancel(&sync_timer);
+  return rc;
+}
+
 static FRESULT scan_files (const char* path) {
     FRESULT res;
     DIR dir;
@@ -35,43 +377,57 @@ static FRESULT scan_files (const char* path) {
 }
 
 int32_t storage_scan_files(Storage_Record_t* list, size_t* list_len, size_t max_list_len) {
-    FRESULT res;
-    DIR dir;
-    static FILINFO fno;
+  bool more;
+  return storage_scan_page("", "", list, list_len, max_list_len, &more);
+}
 
-    *list_len = 0;
-    res = f_opendir(&dir, "");                       // Open the directory
-    if (res == FR_OK) {
-      while(1) {
-        res = f_readdir(&dir, &fno);                   // Read a directory item
-        if (res != FR_OK || fno.fname[0] == 0) break;  // Break on error or end of dir
-        if (!(fno.fattrib & AM_DIR)) {                    // It's not a directory
-          // if we're at the max, finish
-          if (*list_len >= max_list_len) break;
-          printf("  %s\n", fno.fname);
-          // copy the file info into a record
-          strncpy(list[*list_len].logname, fno.fname, STORAGE_LOG_LEN);
-          list[*list_len].offset = 0;
-          list[*list_len].length = fno.fsize;
-          // increment the current record number
-          *list_len += 1;
-        }
-      }
-      f_closedir(&dir);
+int32_t storage_scan_page(const char* after, const char* prefix, Storage_Record_t* list, size_t* list_len,
+    size_t max_list_len, bool* more) {
+  *list_len = 0;
+  *more = false;
+  int32_t rc = dir_index_load();
+  if (rc < TOCK_SUCCESS) return rc;
+
+  bool found;
+  size_t i = 0;
+  if (after[0] != '\0') {
+    i = dir_index_search(after, &found);
+    if (found) i++;
+  }
+  // names with the prefix sort together, from where the prefix would go
+  size_t prefix_len = strnlen(prefix, STORAGE_LOG_LEN);
+  size_t first = dir_index_search(prefix, &found);
+  if (first > i) i = first;
+
+  for (; i < dir_index_len; i++) {
+    if (strncmp(dir_index[i].name, prefix, prefix_len) != 0) break;
+    if (*list_len == max_list_len) {
+      *more = true;
+      break;
     }
+    Storage_Record_t* record = &list[*list_len];
+    memset(record, 0, sizeof(Storage_Record_t));
+    strncpy(record->logname, dir_index[i].name, STORAGE_LOG_LEN);
+    record->offset = 0;
+    record->length = dir_index[i].size;
+    *list_len += 1;
+  }
 
-    return res;
-
+  return TOCK_SUCCESS;
 }
 
 int32_t storage_write_data (const char* filename, uint8_t* buf, size_t buf_len, size_t bytes_to_write, size_t* bytes_written, size_t* offset)
+{
+  return storage_write_durable(filename, buf, buf_len, bytes_to_write, bytes_written, offset, StorageDurabilityGroup);
+}
+
+int32_t storage_write_durable (const char* filename, uint8_t* buf, size_t buf_len, size_t bytes_to_write, size_t* bytes_written, size_t* offset, uint8_t durability)
 {
   size_t len = buf_len < bytes_to_write? buf_len : bytes_to_write;
-  FIL fp;
   FRESULT res;
 
   // XXX check valid filename
-  for (int i = 0; i < STORAGE_LOG_LEN; i++) {
+  for (int i = 0; i < STORAGE_LOG_LEN && filename[i] != '\0'; i++) {
     if (filename[i] == '/') return TOCK_EINVAL;
   }
   if (strnlen(filename, STORAGE_LOG_LEN) == STORAGE_LOG_LEN) return TOCK_ESIZE;
@@ -111,21 +467,71 @@ int32_t storage_write_data (const char* filename, uint8_t* buf, size_t buf_len,
   //}
   //free(temp_filename);
 
-  // open file for append and write
-  res = f_open(&fp, filename, FA_OPEN_APPEND | FA_WRITE);
-  printf("%d\n", res);
+  // get a handle for the file
+  file_cache_t* entry;
+  res = file_cache_open(filename, true, &entry);
   if (res != FR_OK) return TOCK_FAIL;
 
-  // copy file pointer to offset
-  *offset = fp.fptr;
+  if (entry->circular) {
+    // overwrite the oldest data in place, no allocation
+    if (len > entry->capacity) return TOCK_ESIZE;
+    *offset = entry->end;
+    if (entry->end + len - entry->start > entry->capacity) {
+      uint32_t start = entry->end + len - entry->capacity;
+      start += (_MAX_SS - start % _MAX_SS) % _MAX_SS;
+      if (start > entry->end) start = entry->end;
+      entry->start = start;
+      entry->header_dirty = true;
+      res = circular_write_header(entry);
+      if (res == FR_OK) res = f_sync(&entry->fp);
+    }
+    if (res == FR_OK) res = circular_transfer(entry, entry->end, buf, len, true);
+    if (res != FR_OK) {
+      file_cache_close(entry);
+      return TOCK_FAIL;
+    }
+    *bytes_written = len;
+    entry->end += len;
+    entry->header_dirty = true;
+  } else {
+    // move to the end to append
+    res = f_lseek(&entry->fp, f_size(&entry->fp));
+    if (res != FR_OK) {
+      file_cache_close(entry);
+      return TOCK_FAIL;
+    }
+    *offset = entry->fp.fptr;
 
-  // write len bytes of buf to file
-  res = f_write(&fp, buf, len, bytes_written);
-  if (res != FR_OK) return TOCK_FAIL;
+    UINT written = 0;
+    SIGNPOST_TRACE_BEGIN(SignpostTraceStorageWrite, len);
+    res = f_write(&entry->fp, buf, len, &written);
+    SIGNPOST_TRACE_END(SignpostTraceStorageWrite, written);
+    *bytes_written = written;
+  }
+  if (res != FR_OK) {
+    file_cache_close(entry);
+    return TOCK_FAIL;
+  }
 
-  // close file
-  res = f_close(&fp);
-  if (res != FR_OK) return TOCK_FAIL;
+  dir_index_set(filename, file_cache_size(entry));
+  entry->unsynced += *bytes_written;
+  if (entry->unsynced == 0) return TOCK_SUCCESS;
+
+  if (durability == StorageDurabilityLazy) {
+    // only bound how long it can wait, it also goes with any other sync
+    if (!sync_timer.active) {
+      signpost_reactor_timer_start(&sync_timer, STORAGE_LAZY_SYNC_PERIOD_MS, file_cache_sync_timer_cb, NULL);
+      sync_timer_lazy = true;
+    }
+  } else if (entry->unsynced >= STORAGE_SYNC_BYTES) {
+    // sync once enough has been written, otherwise soon
+    res = file_cache_sync(entry);
+    if (res != FR_OK) return TOCK_FAIL;
+  } else if (!sync_timer.active || sync_timer_lazy) {
+    // one sync commits everything written until it fires
+    signpost_reactor_timer_start(&sync_timer, STORAGE_SYNC_PERIOD_MS, file_cache_sync_timer_cb, NULL);
+    sync_timer_lazy = false;
+  }
 
   return TOCK_SUCCESS;
 }
@@ -133,30 +539,331 @@ int32_t storage_write_data (const char* filename, uint8_t* buf, size_t buf_len,
 int32_t storage_read_data (const char* filename, size_t offset, uint8_t* buf, size_t buf_len, size_t bytes_to_read, size_t* bytes_read)
 {
   size_t len = buf_len < bytes_to_read? buf_len : bytes_to_read;
-  FIL fp;
 
-  // open file for read
-  FRESULT res = f_open(&fp, filename, FA_READ);
+  // get a handle for the file
+  file_cache_t* entry;
+  FRESULT res = file_cache_open(filename, false, &entry);
   if (res != FR_OK) return TOCK_FAIL;
 
+  if (entry->circular) {
+    // the data was overwritten
+    if (offset < entry->start) return TOCK_FAIL;
+    *bytes_read = 0;
+    if (offset >= entry->end) return TOCK_SUCCESS;
+    if (len > entry->end - offset) len = entry->end - offset;
+    res = circular_transfer(entry, offset, buf, len, false);
+    if (res != FR_OK) {
+      file_cache_close(entry);
+      return TOCK_FAIL;
+    }
+    *bytes_read = len;
+    return TOCK_SUCCESS;
+  }
+
+  // nothing past the end, and seeking there would grow the file
+  if (offset >= f_size(&entry->fp)) {
+    *bytes_read = 0;
+    return TOCK_SUCCESS;
+  }
+
   // advance pointer to offset
-  res = f_lseek(&fp, offset);
+  res = f_lseek(&entry->fp, offset);
   if (res != FR_OK) return TOCK_FAIL;
 
   // perform read of len bytes to buf
-  res = f_read(&fp, buf, len, bytes_read);
-  if (res != FR_OK) return TOCK_FAIL;
-
-  // close file
-  res = f_close(&fp);
-  if (res != FR_OK) return TOCK_FAIL;
+  UINT read = 0;
+  res = f_read(&entry->fp, buf, len, &read);
+  if (res != FR_OK) {
+    file_cache_close(entry);
+    return TOCK_FAIL;
+  }
+  *bytes_read = read;
 
   return TOCK_SUCCESS;
 }
 
+// Forward declaration, timed logs are below
+static int32_t index_filename (const char* filename, char* index_name);
+
 int32_t storage_del_data (const char* filename) {
+  // never unlink a file that is still open
+  file_cache_t* entry = file_cache_find(filename);
+  if (entry != NULL) file_cache_close(entry);
+
   FRESULT res = f_unlink(filename);
   if (res != FR_OK) return TOCK_FAIL;
+  dir_index_remove(filename);
+
+  // and the index, if it was a timed log
+  char index_name[STORAGE_LOG_LEN+1] = {0};
+  if (index_filename(filename, index_name) == TOCK_SUCCESS) {
+    entry = file_cache_find(index_name);
+    if (entry != NULL) file_cache_close(entry);
+    if (f_unlink(index_name) == FR_OK) dir_index_remove(index_name);
+  }
+
+  return TOCK_SUCCESS;
+}
+
+int32_t storage_circular_create (const char* filename, size_t capacity, size_t* start, size_t* end) {
+  if (capacity == 0 || capacity > UINT32_MAX - CIRCULAR_DATA_OFFSET) return TOCK_ESIZE;
+
+  file_cache_t* entry;
+  if (file_cache_open(filename, true, &entry) != FR_OK) return TOCK_FAIL;
+
+  if (entry->circular) {
+    // already made, asking again is fine
+    if (entry->capacity != capacity) return TOCK_EINVAL;
+  } else {
+    // the data region has to be one contiguous block, which only an empty
+    // file can be given
+    if (f_size(&entry->fp) > 0) return TOCK_EINVAL;
+    FRESULT res = f_expand(&entry->fp, CIRCULAR_DATA_OFFSET + capacity, 1);
+    if (res == FR_DENIED) return TOCK_ENOMEM;
+    if (res != FR_OK) return TOCK_FAIL;
+
+    entry->circular = true;
+    entry->capacity = capacity;
+    entry->start = 0;
+    entry->end = 0;
+    entry->header_dirty = true;
+    res = circular_write_header(entry);
+    if (res == FR_OK) res = f_sync(&entry->fp);
+    if (res != FR_OK) {
+      file_cache_close(entry);
+      return TOCK_FAIL;
+    }
+  }
+
+  *start = entry->start;
+  *end = entry->end;
+  return TOCK_SUCCESS;
+}
+
+// Timed logs
+//
+// A timed log is a sequence of [timestamp][length][data] records. Every
+// STORAGE_INDEX_INTERVAL records, a [timestamp][offset] entry for the record
+// is appended to a sparse index in "<log>.idx". A range query binary
+// searches the index and then walks at most an interval of record headers
+// at each end, rather than reading the whole log.
+
+#define INDEX_SUFFIX ".idx"
+#define INDEX_ENTRY_LEN (2*sizeof(uint32_t))
+
+static int32_t index_filename (const char* filename, char* index_name) {
+  size_t len = strnlen(filename, STORAGE_LOG_LEN);
+  if (len + strlen(INDEX_SUFFIX) >= STORAGE_LOG_LEN) return TOCK_ESIZE;
+  memcpy(index_name, filename, len);
+  strcpy(index_name + len, INDEX_SUFFIX);
+  return TOCK_SUCCESS;
+}
+
+static int32_t storage_file_size (const char* filename, size_t* size) {
+  file_cache_t* entry;
+  if (file_cache_open(filename, false, &entry) != FR_OK) return TOCK_FAIL;
+  *size = file_cache_size(entry);
+  return TOCK_SUCCESS;
+}
+
+int32_t storage_write_timed (const char* filename, uint32_t timestamp, uint8_t* buf, size_t len, size_t* offset, size_t* record_len) {
+  char index_name[STORAGE_LOG_LEN+1] = {0};
+  int32_t rc = index_filename(filename, index_name);
+  if (rc < TOCK_SUCCESS) return rc;
+  if (len > UINT16_MAX) return TOCK_ESIZE;
+
+  // records could be cut by the wrap, and the index would point at
+  // overwritten data
+  file_cache_t* entry;
+  if (file_cache_open(filename, true, &entry) != FR_OK) return TOCK_FAIL;
+  if (entry->circular) return TOCK_EINVAL;
+
+  // frame the record so it goes out as one append
+  *record_len = SIGNPOST_STORAGE_TIMED_HEADER_LEN + len;
+  uint8_t* record = malloc(*record_len);
+  if (record == NULL) return TOCK_ENOMEM;
+  uint16_t len16 = len;
+  memcpy(record, &timestamp, sizeof(timestamp));
+  memcpy(record + sizeof(timestamp), &len16, sizeof(len16));
+  memcpy(record + SIGNPOST_STORAGE_TIMED_HEADER_LEN, buf, len);
+
+  size_t bytes_written = 0;
+  rc = storage_write_data(filename, record, *record_len, *record_len, &bytes_written, offset);
+  free(record);
+  if (rc < TOCK_SUCCESS) return rc;
+  if (bytes_written < *record_len) return TOCK_FAIL;
+
+  // the log was just used, so it is still cached
+  entry = file_cache_find(filename);
+  if (entry == NULL || ++entry->since_index < STORAGE_INDEX_INTERVAL) return TOCK_SUCCESS;
+  entry->since_index = 0;
+
+  uint32_t index_entry[2] = {timestamp, *offset};
+  size_t index_offset;
+  rc = storage_write_data(index_name, (uint8_t*) index_entry, INDEX_ENTRY_LEN, INDEX_ENTRY_LEN,
+      &bytes_written, &index_offset);
+  // a missed index entry only makes queries walk further
+  if (rc < TOCK_SUCCESS) printf("Failed to index %s: %d\n", filename, (int) rc);
+  return TOCK_SUCCESS;
+}
+
+// Offset of the last indexed record stamped before bound, or 0
+static size_t index_search (const char* index_name, uint64_t bound) {
+  size_t index_size = 0;
+  if (storage_file_size(index_name, &index_size) < TOCK_SUCCESS) return 0;
+
+  size_t offset = 0;
+  size_t lo = 0;
+  size_t hi = index_size / INDEX_ENTRY_LEN;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    uint32_t index_entry[2];
+    size_t bytes_read = 0;
+    if (storage_read_data(index_name, mid * INDEX_ENTRY_LEN, (uint8_t*) index_entry,
+          INDEX_ENTRY_LEN, INDEX_ENTRY_LEN, &bytes_read) < TOCK_SUCCESS ||
+        bytes_read < INDEX_ENTRY_LEN) {
+      break;
+    }
+    if (index_entry[0] < bound) {
+      offset = index_entry[1];
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return offset;
+}
+
+// Read the header of the timed record at offset. Returns TOCK_FAIL at the
+// end of the log.
+static int32_t timed_header (const char* filename, size_t offset, uint32_t* timestamp, uint16_t* len) {
+  uint8_t header[SIGNPOST_STORAGE_TIMED_HEADER_LEN];
+  size_t bytes_read = 0;
+  int32_t rc = storage_read_data(filename, offset, header, sizeof(header), sizeof(header), &bytes_read);
+  if (rc < TOCK_SUCCESS) return rc;
+  if (bytes_read < sizeof(header)) return TOCK_FAIL;
+
+  memcpy(timestamp, header, sizeof(*timestamp));
+  memcpy(len, header + sizeof(*timestamp), sizeof(*len));
+  return TOCK_SUCCESS;
+}
+
+// Walk records from offset to the first stamped at or after bound
+static int32_t timed_walk (const char* filename, size_t offset, size_t log_size, uint64_t bound, size_t* found) {
+  while (offset + SIGNPOST_STORAGE_TIMED_HEADER_LEN <= log_size) {
+    uint32_t timestamp;
+    uint16_t len;
+    if (timed_header(filename, offset, &timestamp, &len) < TOCK_SUCCESS) break;
+    if (timestamp >= bound) break;
+    offset += SIGNPOST_STORAGE_TIMED_HEADER_LEN + len;
+  }
+
+  *found = offset < log_size ? offset : log_size;
+  return TOCK_SUCCESS;
+}
+
+int32_t storage_query_range (const char* filename, uint32_t start, uint32_t end, size_t* offset, size_t* length) {
+  char index_name[STORAGE_LOG_LEN+1] = {0};
+  int32_t rc = index_filename(filename, index_name);
+  if (rc < TOCK_SUCCESS) return rc;
+
+  size_t log_size;
+  rc = storage_file_size(filename, &log_size);
+  if (rc < TOCK_SUCCESS) return rc;
+
+  size_t first;
+  rc = timed_walk(filename, index_search(index_name, start), log_size, start, &first);
+  if (rc < TOCK_SUCCESS) return rc;
+
+  // the range ends at the first record stamped after end
+  uint64_t bound = (uint64_t) end + 1;
+  size_t last = index_search(index_name, bound);
+  if (last < first) last = first;
+  rc = timed_walk(filename, last, log_size, bound, &last);
+  if (rc < TOCK_SUCCESS) return rc;
+
+  *offset = first;
+  *length = last - first;
+  return TOCK_SUCCESS;
+}
+
+// Aggregates
+//
+// Reads one field from each record in a range and folds it into a count,
+// sum, min, max and optional histogram. Fields are read through the file
+// cache, so records that share a sector cost one card read between them.
+
+static const uint8_t field_sizes[] = {
+  [StorageFieldU8] = 1, [StorageFieldI8] = 1,
+  [StorageFieldU16] = 2, [StorageFieldI16] = 2,
+  [StorageFieldU32] = 4, [StorageFieldI32] = 4,
+};
+
+static int64_t field_value (uint8_t type, uint8_t* raw) {
+  switch (type) {
+    case StorageFieldU8:  return *raw;
+    case StorageFieldI8:  return (int8_t) *raw;
+    case StorageFieldU16: { uint16_t v; memcpy(&v, raw, sizeof(v)); return v; }
+    case StorageFieldI16: { int16_t v; memcpy(&v, raw, sizeof(v)); return v; }
+    case StorageFieldU32: { uint32_t v; memcpy(&v, raw, sizeof(v)); return v; }
+    default:              { int32_t v; memcpy(&v, raw, sizeof(v)); return v; }
+  }
+}
+
+static void aggregate_add (signpost_storage_aggregate_query_t* query, signpost_storage_aggregate_t* result, int64_t value) {
+  if (result->count == 0 || value < result->min) result->min = value;
+  if (result->count == 0 || value > result->max) result->max = value;
+  result->count++;
+  result->sum += value;
+
+  if (query->histogram_bins > 0) {
+    int64_t span = (int64_t) query->histogram_max - query->histogram_min;
+    int64_t bin = 0;
+    if (span > 0 && value >= query->histogram_min) {
+      bin = ((value - query->histogram_min) * query->histogram_bins) / span;
+    }
+    if (bin >= query->histogram_bins) bin = query->histogram_bins - 1;
+    result->histogram[bin]++;
+  }
+}
+
+int32_t storage_aggregate (const char* filename, size_t offset, size_t length,
+    signpost_storage_aggregate_query_t* query, signpost_storage_aggregate_t* result) {
+  memset(result, 0, sizeof(*result));
+  if (query->field_type > StorageFieldI32 ||
+      query->histogram_bins > SIGNPOST_STORAGE_HISTOGRAM_BINS) return TOCK_EINVAL;
+  size_t field_size = field_sizes[query->field_type];
+
+  size_t log_size;
+  int32_t rc = storage_file_size(filename, &log_size);
+  if (rc < TOCK_SUCCESS) return rc;
+  size_t end = offset + length < log_size ? offset + length : log_size;
+
+  while (offset < end) {
+    // find this record's data and length
+    size_t data_offset = offset;
+    size_t data_len = query->record_len;
+    if (query->record_len == 0) {
+      uint32_t timestamp;
+      uint16_t len;
+      if (timed_header(filename, offset, &timestamp, &len) < TOCK_SUCCESS) break;
+      data_offset += SIGNPOST_STORAGE_TIMED_HEADER_LEN;
+      data_len = len;
+    }
+    size_t next = data_offset + data_len;
+    if (next > end) break;
+
+    // records too short for the field are skipped
+    if (query->field_offset + field_size <= data_len) {
+      uint8_t raw[4];
+      size_t bytes_read = 0;
+      rc = storage_read_data(filename, data_offset + query->field_offset, raw, field_size, field_size, &bytes_read);
+      if (rc < TOCK_SUCCESS) return rc;
+      if (bytes_read < field_size) break;
+      aggregate_add(query, result, field_value(query->field_type, raw));
+    }
+    offset = next;
+  }
 
   return TOCK_SUCCESS;
 }
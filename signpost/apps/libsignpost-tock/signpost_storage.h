@@ -6,20 +6,78 @@ extern "C" {
 
 #include "signpost_api.h"
 
+// Number of files kept open between requests
+#ifndef STORAGE_FILE_CACHE_LEN
+#define STORAGE_FILE_CACHE_LEN 4
+#endif
+// Entries the directory index grows by when it is full
+#ifndef STORAGE_DIR_INDEX_GROW
+#define STORAGE_DIR_INDEX_GROW 16
+#endif
+// Records between entries in the index of a timed log
+#ifndef STORAGE_INDEX_INTERVAL
+#define STORAGE_INDEX_INTERVAL 32
+#endif
+// Sync an open file once this many bytes are written to it
+#ifndef STORAGE_SYNC_BYTES
+#define STORAGE_SYNC_BYTES 4096
+#endif
+// Sync all open files this long after a group commit write
+#ifndef STORAGE_SYNC_PERIOD_MS
+#define STORAGE_SYNC_PERIOD_MS 5000
+#endif
+// Sync all open files at most this long after a lazy write
+#ifndef STORAGE_LAZY_SYNC_PERIOD_MS
+#define STORAGE_LAZY_SYNC_PERIOD_MS 60000
+#endif
+
 // function prototypes
 
 // scan files in root directory, return list of records and length of records
 int32_t storage_scan_files(Storage_Record_t* list, size_t* list_len, size_t max_list_len);
 
-// opens a file for writing and appends data to file
+// lists files in name order, starting after the name after and keeping only
+// names starting with prefix. Either may be empty. more is set if there are
+// further names past the last returned.
+int32_t storage_scan_page(const char* after, const char* prefix, Storage_Record_t* list, size_t* list_len,
+    size_t max_list_len, bool* more);
+
+// opens a file for writing and appends data to file, synced as a group commit
 int32_t storage_write_data (const char* filename, uint8_t* buf, size_t buf_len, size_t bytes_to_write, size_t* bytes_written, size_t* offset);
 
+// appends like storage_write_data, scheduling the sync for a
+// signpost_storage_durability_e. Immediate writes are scheduled like group
+// writes, the caller syncs them with storage_flush_data once it has recorded
+// the write, so a resend can retry the sync without appending again.
+int32_t storage_write_durable (const char* filename, uint8_t* buf, size_t buf_len, size_t bytes_to_write, size_t* bytes_written, size_t* offset, uint8_t durability);
+
 // opens a file for reading and returns bytes_read number of bytes from offset in file
 int32_t storage_read_data (const char* filename, size_t offset, uint8_t* buf, size_t buf_len, size_t bytes_to_read, size_t* bytes_read);
 
 // deletes filename
 int32_t storage_del_data (const char* filename);
 
+// preallocates filename as a circular log keeping the newest capacity bytes,
+// and returns the logical range of data it holds
+int32_t storage_circular_create (const char* filename, size_t capacity, size_t* start, size_t* end);
+
+// appends a timestamped record to a timed log and indexes it when due
+int32_t storage_write_timed (const char* filename, uint32_t timestamp, uint8_t* buf, size_t len, size_t* offset, size_t* record_len);
+
+// finds the range of a timed log with records stamped from start to end
+int32_t storage_query_range (const char* filename, uint32_t start, uint32_t end, size_t* offset, size_t* length);
+
+// aggregates one field over the records in a range of a log
+int32_t storage_aggregate (const char* filename, size_t offset, size_t length,
+    signpost_storage_aggregate_query_t* query, signpost_storage_aggregate_t* result);
+
+// writes everything buffered for filename through to the SD card, or for
+// every file if filename is empty
+int32_t storage_flush_data (const char* filename);
+
+// writes everything buffered in open files through to the SD card
+int32_t storage_sync (void);
+
 // initializes the SD card and storage system on top of it
 int32_t storage_initialize (void);
 
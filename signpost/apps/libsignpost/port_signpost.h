@@ -78,6 +78,10 @@ int port_signpost_mod_in_enable_interrupt_falling(port_signpost_callback cb);
 int port_signpost_mod_in_enable_interrupt_rising(port_signpost_callback cb);
 int port_signpost_mod_in_disable_interrupt(void);
 
+//This function is used to get an interrupt on the rising edge of pps
+int port_signpost_pps_enable_interrupt_rising(port_signpost_callback cb);
+int port_signpost_pps_disable_interrupt(void);
+
 //This is a way to wait on a variable in a platform specific way
 void port_signpost_wait_for(void* wait_on_true);
 
@@ -87,10 +91,19 @@ int port_signpost_wait_for_with_timeout(void* wait_on_true, uint32_t ms);
 
 void port_signpost_delay_ms(unsigned ms);
 
+//A free running counter used for local timekeeping
+//It should count at port_signpost_timer_frequency() Hz and wrap at 2^32
+uint32_t port_signpost_timer_read(void);
+uint32_t port_signpost_timer_frequency(void);
+
 //An optional debug led
 int port_signpost_debug_led_on(void);
 int port_signpost_debug_led_off(void);
 
+//The lowest address the stack can grow down to, used to measure stack use
+//Return PORT_ENOSUPPORT if the platform cannot tell
+int port_signpost_stack_bottom(uintptr_t* bottom);
+
 
 /*  port_rng_init
  *  Sets up rng
@@ -5,6 +5,8 @@
 
 #include "signbus_io_interface.h"
 #include "port_signpost.h"
+#include "signpost_reactor.h"
+#include "signpost_trace.h"
 
 #pragma GCC diagnostic ignored "-Wstack-usage="
 
@@ -39,14 +41,8 @@ typedef struct {
     uint8_t data[MAX_DATA_LEN];
 } __attribute__((__packed__)) Packet;
 
-typedef struct {
-    bool new;
-    uint8_t len;
-} new_packet;
-
 static uint8_t this_device_address;
 static uint16_t sequence_number = 0;
-static new_packet newpkt = { .new = false };
 
 __attribute__((const))
 static uint16_t htons(uint16_t in) {
@@ -62,45 +58,134 @@ static uint16_t htons(uint16_t in) {
  * Receiving is a little more tricky. We pass a 255 byte buffer that we own to
  * the I2C driver which is always re-used to get individual messages from the
  * I2C bus. When an upper layer wishes to recieve a message, it passes a buffer
- * to copy into, which we copy I2C data into until we get a complete message.
+ * to copy into, and each fragment is copied in from the driver callback as it
+ * arrives. Once the message is complete an event is posted to the reactor,
+ * which calls up the layers from its loop rather than from the callback.
  *
  ***************************************************************************/
 
-// Internal helper that copies data from the I2C driver buffer to the packet
-// buffer. Forward declaration here so callback can use it.
-static int get_message(
-        uint8_t* recv_buf,
-        size_t recv_buflen,
-        bool*   is_encrypted,
-        uint8_t* src_address
-        );
-
 // Internal helper for supporting slave reads. Forward declaration here so
 // callback can use it.
 static void signbus_iterate_slave_read(void);
 
-// State for an active async event
-bool                    async_active = false;
-uint8_t*                async_recv_buf;
-size_t                  async_recv_buflen;
-bool*                   async_encrypted;
-uint8_t*                async_src_address;
-signbus_app_callback_t* async_callback = NULL;
+// The receive currently posted by an upper layer, and the message being
+// reassembled into it
+typedef struct {
+    bool                  active;
+    uint8_t*              buf;
+    size_t                buflen;
+    bool*                 encrypted;
+    uint8_t*              src;
+    signbus_io_callback_t callback;
+
+    bool                  in_progress;
+    uint16_t              sequence_number;
+    uint8_t               source;
+    size_t                received;
+} reassembly_t;
+
+static reassembly_t rx = { .active = false };
+
+// A fragment that arrived while no receive was posted. Only the latest one
+// is kept, it is fed in when the next receive is posted.
+static bool stashed = false;
+static uint8_t stashed_len;
+
+static void rx_complete_event(int len, __attribute__ ((unused)) void* ud) {
+    signbus_io_callback_t callback = rx.callback;
+    rx.callback = NULL;
+    if (callback != NULL) {
+        callback(len);
+    }
+}
 
-// flag to indicate if callback is for async operation
-static bool async = false;
+// Copy one fragment into the posted receive buffer. This never blocks.
+static void rx_fragment(const uint8_t* fragment, size_t fragment_len) {
+    if (fragment_len < sizeof(signbus_network_header_t)) return;
+
+    Packet packet;
+    memcpy(&packet, fragment, fragment_len);
+    size_t data_len = fragment_len - sizeof(signbus_network_header_t);
+
+    if (!rx.in_progress) {
+        //this is the first packet
+        //save the message_sequence_number
+        rx.in_progress = true;
+        rx.received = 0;
+        rx.sequence_number = packet.header.sequence_number;
+        rx.source = packet.header.src;
+        *rx.encrypted = packet.header.flags.is_encrypted;
+        SIGNPOST_TRACE_BEGIN(SignpostTraceIoGetMessage, 0);
+    } else if (rx.sequence_number != packet.header.sequence_number ||
+            rx.source != packet.header.src) {
+        //we should drop this packet
+        return;
+    }
+    SIGNBUS_DEBUG("packet.header.src: 0x%x\n", packet.header.src);
+    *rx.src = packet.header.src;
+
+    //are there more fragments?
+    bool moreFragments = packet.header.flags.is_fragment;
+    uint16_t fragmentOffset = htons(packet.header.fragment_offset);
+    bool done = !moreFragments;
+
+    //is there room to copy into the buffer?
+    if (fragmentOffset >= rx.buflen) {
+        //this is too long, end with what we have
+        done = true;
+    } else {
+        if (fragmentOffset + data_len > rx.buflen) {
+            //just copy what we can and end
+            data_len = rx.buflen - fragmentOffset;
+            done = true;
+        }
+        memcpy(rx.buf + fragmentOffset, packet.data, data_len);
+        rx.received += data_len;
+    }
+
+    if (done) {
+        SIGNBUS_DEBUG_DUMP_BUF(rx.buf, rx.received);
+        SIGNPOST_TRACE_END(SignpostTraceIoGetMessage, rx.received);
+        rx.active = false;
+        rx.in_progress = false;
+        signpost_reactor_post(rx_complete_event, rx.received, NULL);
+    }
+}
 
 void signbus_io_slave_write_callback(int len_or_rc);
 void signbus_io_slave_write_callback(int len_or_rc) {
-    if(len_or_rc >= 0) {
+    if (len_or_rc < 0) return;
+
+    if (rx.active) {
+        rx_fragment(slave_write_buf, len_or_rc);
+    } else {
         memcpy(packet_buf, slave_write_buf, len_or_rc);
-        new_packet* packet = (new_packet*) &newpkt;
-        packet->new = true;
-        packet->len = len_or_rc;
-        if (async_active) {
-            get_message(async_recv_buf, async_recv_buflen, async_encrypted, async_src_address);
-        }
+        stashed_len = len_or_rc;
+        stashed = true;
+    }
+}
+
+static int rx_post(signbus_io_callback_t callback, size_t recv_buflen, uint8_t* recv_buf,
+        bool* encrypted, uint8_t* src) {
+    rx.callback = callback;
+    rx.buf = recv_buf;
+    rx.buflen = recv_buflen;
+    rx.encrypted = encrypted;
+    rx.src = src;
+    rx.in_progress = false;
+    rx.active = true;
+
+    int rc = port_signpost_i2c_slave_listen(signbus_io_slave_write_callback, slave_write_buf, PORT_I2C_MAX_LEN);
+    if (rc < 0) {
+        rx.active = false;
+        return rc;
+    }
+
+    if (stashed) {
+        stashed = false;
+        rx_fragment(packet_buf, stashed_len);
     }
+    return PORT_SUCCESS;
 }
 
 
@@ -117,6 +202,7 @@ void signbus_io_init(uint8_t address) {
 // synchronous send call
 int signbus_io_send(uint8_t dest, bool encrypted, uint8_t* data, size_t len) {
     SIGNBUS_DEBUG("dest %02x data %p packet len %d\n", dest, data, len);
+    SIGNPOST_TRACE_BEGIN(SignpostTraceIoSend, len);
 
     sequence_number++;
     Packet packet = {0};
@@ -172,156 +258,69 @@ int signbus_io_send(uint8_t dest, bool encrypted, uint8_t* data, size_t len) {
 
         //send the packet
         if(morePackets) {
+            SIGNPOST_TRACE_BEGIN(SignpostTraceIoFragmentWrite, PORT_I2C_MAX_LEN);
             rc = port_signpost_i2c_master_write(dest,(uint8_t *) &packet,PORT_I2C_MAX_LEN);
+            SIGNPOST_TRACE_END(SignpostTraceIoFragmentWrite, PORT_I2C_MAX_LEN);
 
-            if (rc < 0) return rc;
+            if (rc < 0) {
+                SIGNPOST_TRACE_END(SignpostTraceIoSend, len);
+                return rc;
+            }
 
             toSend -= MAX_DATA_LEN;
         } else {
             //SIGNBUS_DEBUG_DUMP_BUF(&packet, sizeof(signbus_network_header_t)+toSend);
 
+            SIGNPOST_TRACE_BEGIN(SignpostTraceIoFragmentWrite, sizeof(signbus_network_header_t)+toSend);
             rc = port_signpost_i2c_master_write(dest, (uint8_t *) &packet,sizeof(signbus_network_header_t)+toSend);
+            SIGNPOST_TRACE_END(SignpostTraceIoFragmentWrite, sizeof(signbus_network_header_t)+toSend);
 
-            if (rc < 0) return rc;
+            if (rc < 0) {
+                SIGNPOST_TRACE_END(SignpostTraceIoSend, len);
+                return rc;
+            }
 
             toSend = 0;
         }
     }
 
     SIGNBUS_DEBUG("dest %02x data %p packet len %d -- COMPLETE\n", dest, data, len);
+    SIGNPOST_TRACE_END(SignpostTraceIoSend, len);
     return len;
 }
 
-// get_message is called either from a synchronous context, or from the
-// callback path of an async request. In either case, this method can
-// safely call blocking methods until it is ready to either return or
-// call up the callback chain.
-//
-// This function will return the number of bytes received or < 0 for rcor.
-// For async invocation, the return value is passed as the callback argument.
-static int get_message(uint8_t* data, size_t len, bool* encrypted, uint8_t* src) {
-    uint8_t done = 0;
-    size_t lengthReceived = 0;
-    uint16_t message_sequence_number;
-    uint8_t message_source_address;
-
-    // Mark async as inactive so this call stack can block
-    async_active = false;
-
-    //loop receiving packets until we get the whole datagram
-    while(!done) {
-        //wait and receive a packet
-        if (!newpkt.new) {
-            port_signpost_wait_for(&newpkt.new);
-        }
-        newpkt.new = 0;
-
-        //a new packet is in the packet buf
-
-        //copy the packet into a header struct
-        Packet packet;
-        memcpy(&packet,packet_buf,PORT_I2C_MAX_LEN);
-        if(lengthReceived == 0) {
-            //this is the first packet
-            //save the message_sequence_number
-            message_sequence_number = packet.header.sequence_number;
-            message_source_address = packet.header.src;
-            *encrypted = packet.header.flags.is_encrypted;
-        } else {
-            //this is not the first packet
-            //is this the same message_sequence_number?
-            if(message_sequence_number == packet.header.sequence_number
-                    && message_source_address == packet.header.src) {
-                //yes it is - proceed
-            } else {
-                //we should drop this packet
-                continue;
-            }
-        }
-        SIGNBUS_DEBUG("packet.header.src: 0x%x\n", packet.header.src);
-        *src = packet.header.src;
-
-        //are there more fragments?
-        uint8_t moreFragments = packet.header.flags.is_fragment;
-        uint16_t fragmentOffset = htons(packet.header.fragment_offset);
-        if(moreFragments) {
-            //is there room to copy into the buffer?
-            if(fragmentOffset + MAX_DATA_LEN > len) {
-                //this is too long
-                //just copy what we can and end
-                uint16_t remainder = len - fragmentOffset;
-                memcpy(data+fragmentOffset,packet.data,remainder);
-                lengthReceived += remainder;
-                done = 1;
-            } else {
-                memcpy(data+fragmentOffset,packet.data,MAX_DATA_LEN);
-                lengthReceived += MAX_DATA_LEN;
-            }
-        } else {
-            //is there room to copy into the buffer?
-            if(fragmentOffset + (newpkt.len - sizeof(signbus_network_header_t)) > len) {
-                //this is too long
-                //just copy what we can and end
-                uint16_t remainder = len - fragmentOffset;
-                memcpy(data+fragmentOffset,packet.data,remainder);
-                lengthReceived += remainder;
-            } else {
-                //copy the rest of the packet
-                memcpy(data+fragmentOffset,packet.data,(newpkt.len - sizeof(signbus_network_header_t)));
-                lengthReceived += newpkt.len - sizeof(signbus_network_header_t);
-            }
-
-            //no more fragments end
-            done = 1;
-        }
-    }
-
-    SIGNBUS_DEBUG_DUMP_BUF(data, lengthReceived);
-
-    if (async_callback != NULL) {
-        // allow recursion
-        signbus_app_callback_t* temp = async_callback;
-        async_callback = NULL;
-        temp(lengthReceived);
-    }
+// blocking receive call
+static bool sync_recv_done;
+static int sync_recv_len_or_rc;
 
-    return lengthReceived;
+static void sync_recv_callback(int len_or_rc) {
+    sync_recv_len_or_rc = len_or_rc;
+    sync_recv_done = true;
 }
 
-// blocking receive call
 int signbus_io_recv(
         size_t recv_buflen,
         uint8_t* recv_buf,
         bool*    encrypted,
         uint8_t* src_address
         ) {
-
-    async = false;
-
-    int rc;
-    rc = port_signpost_i2c_slave_listen(signbus_io_slave_write_callback, slave_write_buf, PORT_I2C_MAX_LEN);
+    sync_recv_done = false;
+    int rc = rx_post(sync_recv_callback, recv_buflen, recv_buf, encrypted, src_address);
     if (rc < 0) return rc;
 
-    return get_message(recv_buf, recv_buflen, encrypted, src_address);
+    signpost_reactor_wait_for(&sync_recv_done, 0);
+    return sync_recv_len_or_rc;
 }
 
 // async receive call
 int signbus_io_recv_async(
-        signbus_app_callback_t callback,
+        signbus_io_callback_t callback,
         size_t recv_buflen,
         uint8_t* recv_buf,
         bool*    encrypted,
         uint8_t* src
         ) {
-
-    async_callback = callback;
-    async_recv_buflen = recv_buflen;
-    async_recv_buf = recv_buf;
-    async_src_address = src;
-    async_encrypted = encrypted;
-    async_active = true;
-
-    return port_signpost_i2c_slave_listen(signbus_io_slave_write_callback, slave_write_buf, PORT_I2C_MAX_LEN);
+    return rx_post(callback, recv_buflen, recv_buf, encrypted, src);
 }
 
 
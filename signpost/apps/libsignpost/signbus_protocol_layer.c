@@ -10,6 +10,7 @@
 #include "signbus_app_layer.h"
 #include "signbus_io_interface.h"
 #include "signbus_protocol_layer.h"
+#include "signpost_trace.h"
 
 #pragma GCC diagnostic ignored "-Wstack-usage="
 
@@ -129,9 +130,11 @@ int signbus_protocol_send(
         // encrypt buf
         size_t encrypted_buf_used;
         uint8_t* encrypted_buf = protocol_buf + MBEDTLS_MAX_IV_LENGTH;
+        SIGNPOST_TRACE_BEGIN(SignpostTraceCipher, clear_buflen);
         ret = cipher(MBEDTLS_ENCRYPT, key, iv,
                 clear_buf, clear_buflen,
                 encrypted_buf, &encrypted_buf_used);
+        SIGNPOST_TRACE_END(SignpostTraceCipher, clear_buflen);
         if (ret < 0) return PORT_FAIL;
 
         protocol_buf_used += encrypted_buf_used;
@@ -146,7 +149,9 @@ int signbus_protocol_send(
 
     // hmac over current protocol payload
     uint8_t* hmac = protocol_buf + protocol_buf_used;
+    SIGNPOST_TRACE_BEGIN(SignpostTraceMessageDigest, protocol_buf_used);
     ret = message_digest(key, protocol_buf, protocol_buf_used, hmac);
+    SIGNPOST_TRACE_END(SignpostTraceMessageDigest, protocol_buf_used);
     if (ret < 0) return PORT_FAIL;
     protocol_buf_used += SHA256_LEN;
 
@@ -177,7 +182,9 @@ static int protocol_encrypted_buffer_received(
 
     // Check HMAC or hash
     uint8_t hmac_or_hash[SHA256_LEN];
+    SIGNPOST_TRACE_BEGIN(SignpostTraceMessageDigest, protocol_buflen-SHA256_LEN);
     message_digest(key, protocol_buf, protocol_buflen-SHA256_LEN, hmac_or_hash);
+    SIGNPOST_TRACE_END(SignpostTraceMessageDigest, protocol_buflen-SHA256_LEN);
     if (memcmp(hmac_or_hash, protocol_buf+(protocol_buflen-SHA256_LEN), SHA256_LEN) != 0) {
         // TODO: Meaningful return codes. Let's at least try to be unique
         return PORT_ENOMEM;
@@ -200,10 +207,12 @@ static int protocol_encrypted_buffer_received(
         }
 
         int ret;
+        SIGNPOST_TRACE_BEGIN(SignpostTraceCipher, encrypted_buflen);
         ret = cipher(MBEDTLS_DECRYPT,
                 key, iv,
                 encrypted_buf, encrypted_buflen,
                 output_buf, &clear_len);
+        SIGNPOST_TRACE_END(SignpostTraceCipher, encrypted_buflen);
         if (ret < 0) return PORT_FAIL;
     } else {
         clear_len = protocol_buflen - SHA256_LEN;
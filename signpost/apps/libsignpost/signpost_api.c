@@ -8,6 +8,9 @@
 #include "signpost_api.h"
 #include "port_signpost.h"
 #include "signpost_entropy.h"
+#include "signpost_memstats.h"
+#include "signpost_reactor.h"
+#include "signpost_trace.h"
 
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/ecdh.h"
@@ -24,8 +27,10 @@
 
 extern mbedtls_ctr_drbg_context ctr_drbg_context;
 
+// Handlers indexed by api type, filled in from the handler list the
+// application passes at init so dispatch is a single lookup
 struct module_api_struct {
-    api_handler_t**         api_handlers;
+    api_handler_t*          api_handlers[HighestApiType+1];
 } module_api = {0};
 
 module_state_t module_info = {0};
@@ -143,6 +148,120 @@ static void signpost_api_start_new_async_recv(void) {
     }
 }
 
+/**************************************************************************/
+/* TIMEOUTS                                                               */
+/**************************************************************************/
+
+// clock granularity term from RFC 6298
+#define RTT_GRANULARITY_MS 10
+
+// One estimate per peer and operation, since a scan and a flush on the same
+// peer take very different times
+typedef struct {
+    uint8_t  address;
+    uint8_t  api_type;
+    uint8_t  message_type;
+    bool     valid;
+    uint32_t srtt_ms;
+    uint32_t rttvar_ms;
+    uint32_t timeout_ms;
+} peer_rtt_t;
+
+static peer_rtt_t peer_rtt[SIGNPOST_API_RTT_PEERS];
+static uint8_t peer_rtt_next = 0;
+
+// last command sent, which is the one a blocking call waits on
+static uint8_t  command_address;
+static uint8_t  command_api_type;
+static uint8_t  command_message_type;
+static uint32_t command_sent_at;
+
+static uint32_t next_timeout_ms = 0;
+
+void signpost_api_set_next_timeout(uint32_t timeout_ms) {
+    next_timeout_ms = timeout_ms;
+}
+
+static peer_rtt_t* signpost_api_find_rtt(uint8_t address, uint8_t api_type, uint8_t message_type) {
+    for (size_t i = 0; i < SIGNPOST_API_RTT_PEERS; i++) {
+        if (peer_rtt[i].valid && peer_rtt[i].address == address &&
+                peer_rtt[i].api_type == api_type && peer_rtt[i].message_type == message_type) {
+            return &peer_rtt[i];
+        }
+    }
+    return NULL;
+}
+
+int signpost_api_get_rtt(uint8_t address, signbus_api_type_t api_type, uint8_t message_type,
+        uint32_t* srtt_ms, uint32_t* rttvar_ms, uint32_t* timeout_ms) {
+    peer_rtt_t* peer = signpost_api_find_rtt(address, api_type, message_type);
+    if (peer == NULL) return PORT_FAIL;
+
+    *srtt_ms = peer->srtt_ms;
+    *rttvar_ms = peer->rttvar_ms;
+    *timeout_ms = peer->timeout_ms;
+    return PORT_SUCCESS;
+}
+
+static uint32_t signpost_api_clamp_timeout(uint32_t timeout_ms) {
+    if (timeout_ms < SIGNPOST_API_TIMEOUT_MIN_MS) return SIGNPOST_API_TIMEOUT_MIN_MS;
+    if (timeout_ms > SIGNPOST_API_TIMEOUT_MAX_MS) return SIGNPOST_API_TIMEOUT_MAX_MS;
+    return timeout_ms;
+}
+
+static void signpost_api_rtt_sample(uint8_t address, uint8_t api_type, uint8_t message_type, uint32_t rtt_ms) {
+    peer_rtt_t* peer = signpost_api_find_rtt(address, api_type, message_type);
+    if (peer == NULL) {
+        // new peer, replace the oldest entry
+        peer = &peer_rtt[peer_rtt_next];
+        peer_rtt_next = (peer_rtt_next + 1) % SIGNPOST_API_RTT_PEERS;
+        peer->address = address;
+        peer->api_type = api_type;
+        peer->message_type = message_type;
+        peer->valid = true;
+        peer->srtt_ms = rtt_ms;
+        peer->rttvar_ms = rtt_ms / 2;
+    } else {
+        uint32_t err = peer->srtt_ms > rtt_ms ? peer->srtt_ms - rtt_ms : rtt_ms - peer->srtt_ms;
+        peer->rttvar_ms = (3 * peer->rttvar_ms + err) / 4;
+        peer->srtt_ms = (7 * peer->srtt_ms + rtt_ms) / 8;
+    }
+
+    uint32_t var = 4 * peer->rttvar_ms;
+    if (var < RTT_GRANULARITY_MS) var = RTT_GRANULARITY_MS;
+    peer->timeout_ms = signpost_api_clamp_timeout(peer->srtt_ms + var);
+}
+
+// Wait for a blocking call's reply to set *flag. default_ms is used until
+// this operation has been answered once, after which the estimate takes
+// over, and 0 waits forever.
+static int signpost_api_wait_for_reply(bool* flag, uint32_t default_ms) {
+    uint8_t address = command_address;
+    uint8_t api_type = command_api_type;
+    uint8_t message_type = command_message_type;
+    uint32_t sent_at = command_sent_at;
+    peer_rtt_t* peer = signpost_api_find_rtt(address, api_type, message_type);
+
+    uint32_t timeout_ms = default_ms;
+    if (next_timeout_ms != 0) {
+        timeout_ms = next_timeout_ms;
+        next_timeout_ms = 0;
+    } else if (peer != NULL && default_ms != 0) {
+        timeout_ms = peer->timeout_ms;
+    }
+
+    int rc = signpost_reactor_wait_for(flag, timeout_ms);
+    if (rc == PORT_SUCCESS) {
+        uint32_t ticks = port_signpost_timer_read() - sent_at;
+        signpost_api_rtt_sample(address, api_type, message_type,
+                (uint32_t)(((uint64_t)ticks * 1000) / port_signpost_timer_frequency()));
+    } else if (peer != NULL) {
+        // back off, a late reply is dropped so it is never sampled
+        peer->timeout_ms = signpost_api_clamp_timeout(peer->timeout_ms * 2);
+    }
+    return rc;
+}
+
 int signpost_api_send(uint8_t destination_address,
                       signbus_frame_type_t frame_type,
                       signbus_api_type_t api_type,
@@ -150,8 +269,17 @@ int signpost_api_send(uint8_t destination_address,
                       size_t message_length,
                       uint8_t* message) {
 
+    if (frame_type == CommandFrame) {
+        command_address = destination_address;
+        command_api_type = api_type;
+        command_message_type = message_type;
+        command_sent_at = port_signpost_timer_read();
+    }
+
+    int mark = SIGNPOST_MEMSTATS_API_BEGIN();
     int rc = signbus_app_send(destination_address, signpost_api_addr_to_key, frame_type, api_type,
                             message_type, message_length, message);
+    SIGNPOST_MEMSTATS_API_END(api_type, mark);
 
     //start recieving after sending!!
     signpost_api_start_new_async_recv();
@@ -162,29 +290,39 @@ int signpost_api_send(uint8_t destination_address,
 
 
 static void signpost_api_recv_callback(int len_or_rc) {
+    int mark = SIGNPOST_MEMSTATS_API_BEGIN();
+    signbus_api_type_t api_type = incoming_api_type;
+
     if (len_or_rc < 0) {
         if (len_or_rc == PORT_ECRYPT) {
             port_printf("Dropping message with HMAC/HASH failure\n");
+            SIGNPOST_MEMSTATS_API_END(api_type, mark);
             signpost_api_start_new_async_recv();
             return;
         } else {
             port_printf("%s:%d It's all fubar?\n", __FILE__, __LINE__);
+            SIGNPOST_MEMSTATS_API_END(api_type, mark);
             signpost_api_start_new_async_recv();
             return;
         }
     }
     if ( (incoming_frame_type == NotificationFrame) || (incoming_frame_type == CommandFrame) ) {
-        api_handler_t** handler = module_api.api_handlers;
-        while (*handler != NULL) {
-            if ((*handler)->api_type == incoming_api_type) {
-                (*handler)->callback(incoming_source_address,
-                        incoming_frame_type, incoming_api_type, incoming_message_type,
-                        incoming_message_length, incoming_message);
-                break;
-            }
-            handler++;
+        api_handler_t* handler = NULL;
+        if (incoming_api_type <= HighestApiType) {
+            handler = module_api.api_handlers[incoming_api_type];
         }
-        if (handler == NULL) {
+        if (handler != NULL) {
+            SIGNPOST_TRACE_BEGIN(SignpostTraceApiDispatch, (incoming_api_type << 8) | incoming_message_type);
+            handler->callback(incoming_source_address,
+                    incoming_frame_type, incoming_api_type, incoming_message_type,
+                    incoming_message_length, incoming_message);
+            SIGNPOST_TRACE_END(SignpostTraceApiDispatch, 0);
+        } else if (incoming_frame_type == CommandFrame) {
+            // tell the requester now rather than letting it time out
+            port_printf("Warn: No handler for api %d. Replying with error\n", incoming_api_type);
+            signpost_api_error_reply(incoming_source_address, incoming_api_type,
+                    incoming_message_type, PORT_ENOSUPPORT);
+        } else {
             port_printf("Warn: Unsolicited message for api %d. Dropping\n", incoming_api_type);
         }
     } else if ( (incoming_frame_type == ResponseFrame) || (incoming_frame_type == ErrorFrame) ) {
@@ -192,7 +330,17 @@ static void signpost_api_recv_callback(int len_or_rc) {
             // clear this before passing it on
             signbus_app_callback_t* temp = incoming_active_callback;
             incoming_active_callback = NULL;
-            temp(len_or_rc);
+            if (incoming_frame_type == ErrorFrame) {
+                // hand the error code down in place of the length
+                int error_code = PORT_FAIL;
+                if (incoming_message_length == sizeof(int)) {
+                    memcpy(&error_code, incoming_message, sizeof(int));
+                }
+                if (error_code >= PORT_SUCCESS) error_code = PORT_FAIL;
+                temp(error_code);
+            } else {
+                temp(len_or_rc);
+            }
         } else {
             port_printf("Warn: Unsolicited response/error. Dropping\n");
         }
@@ -200,6 +348,7 @@ static void signpost_api_recv_callback(int len_or_rc) {
         port_printf("Invalid frame type: %d. Dropping message\n", incoming_frame_type);
     }
 
+    SIGNPOST_MEMSTATS_API_END(api_type, mark);
     signpost_api_start_new_async_recv();
 }
 
@@ -216,10 +365,17 @@ static initialization_state_t init_state;
 static bool request_isolation_complete;
 //static bool revoke_complete;
 static bool declare_controller_complete;
-//static bool key_send_complete;
+static bool key_send_complete;
 //
 static bool get_state_complete;
 
+// whether to exchange keys with the controller after declaring
+static bool key_exchange_enabled = false;
+// wait before asking again when the controller did not answer, doubling
+// after each failure up to the cap
+#define KEY_EXCHANGE_RETRY_DELAY_MS 1000
+#define KEY_EXCHANGE_RETRY_DELAY_MAX_MS 16000
+
 // state of isolation
 static bool is_isolated = 0;
 
@@ -229,10 +385,29 @@ static uint8_t mod_addr_init = ModuleAddressController;
 
 // mbedtls stuff
 #define ECDH_BUF_LEN 72
+// the only curve the pinned mbedtls reads and writes as TLS ECParameters
+#define ECDH_CURVE MBEDTLS_ECP_DP_SECP256R1
 static mbedtls_ecdh_context ecdh;
 static size_t  ecdh_param_len;
 static uint8_t ecdh_buf[ECDH_BUF_LEN];
 
+// Group used for generating our half of each exchange. It is kept loaded
+// across exchanges so the comb table for the fixed generator (grp.T) is
+// only computed once, on the first exchange, rather than once per module.
+static mbedtls_ecp_group ecdh_cached_grp;
+
+static mbedtls_ecp_group* signpost_initialization_ecdh_group(mbedtls_ecp_group_id id) {
+    if (ecdh_cached_grp.id != id) {
+        // mbedtls_ecp_group_load frees the old group, including its table
+        int ret = mbedtls_ecp_group_load(&ecdh_cached_grp, id);
+        if (ret < 0) {
+            mbedtls_ecp_group_init(&ecdh_cached_grp);
+            return NULL;
+        }
+    }
+    return &ecdh_cached_grp;
+}
+
 /**************************************/
 /* Initialization Callbacks           */
 /**************************************/
@@ -243,7 +418,11 @@ static void signpost_initialization_declare_callback(int len_or_rc) {
     if (incoming_api_type != InitializationApiType || incoming_message_type !=
             InitializationDeclare) return;
 
-    init_state = Done;
+    init_state = key_exchange_enabled ? KeyExchange : Done;
+}
+
+static void signpost_initialization_key_exchange_callback(__attribute__ ((unused)) int len_or_rc) {
+    key_send_complete = true;
 }
 
 static void signpost_initialization_get_state_callback(__attribute__ ((unused)) int len_or_rc) {
@@ -260,8 +439,9 @@ static void signpost_initialization_isolation_callback(int unused __attribute__
 
 static void signpost_initialization_lost_isolation_callback(int unused __attribute__ ((unused))) {
     // reset state to request isolation if no longer isolated
+    // the key exchange runs after isolation has been released on purpose
     is_isolated = 0;
-    if (init_state != Done)
+    if (init_state != Done && init_state != KeyExchange)
       init_state = RequestIsolation;
 }
 
@@ -313,24 +493,31 @@ int signpost_initialization_declare_respond(uint8_t source_address, uint8_t new_
 int signpost_initialization_key_exchange_respond(uint8_t source_address, uint8_t* ecdh_params, size_t len) {
     int ret = PORT_SUCCESS;
     uint8_t module_number = signpost_api_addr_to_mod_num(source_address);
+    if (module_number == 0xff) return PORT_FAIL;
 
     port_printf("INIT: Performing key exchange with module %d\n", module_number);
 
+    // a new exchange replaces any old key, and one that fails leaves none,
+    // so the module retrying in plaintext is always understood
+    module_info.haskey[module_number] = false;
+
     // init ecdh struct for key exchange
     mbedtls_ecdh_free(&ecdh);
     mbedtls_ecdh_init(&ecdh);
-    ret = mbedtls_ecp_group_load(&ecdh.grp, MBEDTLS_ECP_DP_SECP256R1);
-    if(ret < PORT_SUCCESS) return ret;
 
     // read params from contacting module
     ret = mbedtls_ecdh_read_params(&ecdh, (const uint8_t **) &ecdh_params, ecdh_params+len);
     if(ret < PORT_SUCCESS) return ret;
+    if(ecdh.grp.id != ECDH_CURVE) return PORT_EINVAL;
 
-    // make params
-    ret = mbedtls_ecdh_make_public(&ecdh, &ecdh_param_len, ecdh_buf, ECDH_BUF_LEN, mbedtls_ctr_drbg_random, &ctr_drbg_context);
+    // make params, using the cached group so the fixed-base table is reused
+    mbedtls_ecp_group* grp = signpost_initialization_ecdh_group(ecdh.grp.id);
+    if (grp == NULL) return PORT_ENOMEM;
+    ret = mbedtls_ecdh_gen_public(grp, &ecdh.d, &ecdh.Q, mbedtls_ctr_drbg_random, &ctr_drbg_context);
+    if(ret < PORT_SUCCESS) return ret;
+    ret = mbedtls_ecp_tls_write_point(grp, &ecdh.Q, MBEDTLS_ECP_PF_UNCOMPRESSED, &ecdh_param_len, ecdh_buf, ECDH_BUF_LEN);
     if(ret < PORT_SUCCESS) return ret;
 
-    if (module_number == 0xff) return PORT_FAIL;
     uint8_t* key = module_info.keys[module_number];
     size_t keylen;
     // calculate shared secret
@@ -341,6 +528,11 @@ int signpost_initialization_key_exchange_respond(uint8_t source_address, uint8_t
     ret = signpost_api_send(source_address,
             ResponseFrame, InitializationApiType, InitializationKeyExchange,
             ecdh_param_len, ecdh_buf);
+    if(ret < PORT_SUCCESS) {
+        // the module never saw our half, it will retry
+        memset(key, 0, ECDH_KEY_LENGTH);
+        return ret;
+    }
 
     module_info.haskey[module_number] = true;
 
@@ -348,6 +540,76 @@ int signpost_initialization_key_exchange_respond(uint8_t source_address, uint8_t
     return ret;
 }
 
+void signpost_initialization_enable_key_exchange(bool enable) {
+    key_exchange_enabled = enable;
+}
+
+int signpost_initialization_key_exchange_send(uint8_t destination_address) {
+    int ret;
+    int module_number = signpost_api_addr_to_mod_num(destination_address);
+    if (module_number < 0) return PORT_EINVAL;
+
+    if (incoming_active_callback != NULL) return PORT_EBUSY;
+
+    // the request goes out in plaintext, and a failed exchange leaves no key
+    module_info.haskey[module_number] = false;
+
+    // make params through the cached group
+    mbedtls_ecdh_free(&ecdh);
+    mbedtls_ecdh_init(&ecdh);
+    mbedtls_ecp_group* grp = signpost_initialization_ecdh_group(ECDH_CURVE);
+    if (grp == NULL) return PORT_ENOMEM;
+    ret = mbedtls_ecp_group_copy(&ecdh.grp, grp);
+    if (ret < 0) return PORT_ENOMEM;
+    ret = mbedtls_ecdh_gen_public(grp, &ecdh.d, &ecdh.Q, mbedtls_ctr_drbg_random, &ctr_drbg_context);
+    if (ret < 0) return PORT_FAIL;
+    ret = mbedtls_ecp_tls_write_group(grp, &ecdh_param_len, ecdh_buf, ECDH_BUF_LEN);
+    if (ret < 0) return PORT_FAIL;
+    size_t point_len;
+    ret = mbedtls_ecp_tls_write_point(grp, &ecdh.Q, MBEDTLS_ECP_PF_UNCOMPRESSED,
+            &point_len, ecdh_buf + ecdh_param_len, ECDH_BUF_LEN - ecdh_param_len);
+    if (ret < 0) return PORT_FAIL;
+    ecdh_param_len += point_len;
+
+    key_send_complete = false;
+    incoming_active_callback = signpost_initialization_key_exchange_callback;
+    ret = signpost_api_send(destination_address,
+            CommandFrame, InitializationApiType, InitializationKeyExchange,
+            ecdh_param_len, ecdh_buf);
+    if (ret < 0) {
+        incoming_active_callback = NULL;
+        return PORT_ENOACK;
+    }
+
+    // the other side does a full scalar multiplication before replying
+    ret = signpost_api_wait_for_reply(&key_send_complete, 5000);
+    if (ret < 0) {
+        incoming_active_callback = NULL;
+        return PORT_ENOACK;
+    }
+    if (incoming_frame_type == ErrorFrame) {
+        // refused, and the other side holds no key for us either
+        return PORT_ENOSUPPORT;
+    }
+    if (incoming_frame_type != ResponseFrame ||
+            incoming_message_type != InitializationKeyExchange) {
+        return PORT_FAIL;
+    }
+
+    ret = mbedtls_ecdh_read_public(&ecdh, incoming_message, incoming_message_length);
+    if (ret < 0) return PORT_FAIL;
+
+    uint8_t* key = module_info.keys[module_number];
+    size_t keylen;
+    ret = mbedtls_ecdh_calc_secret(&ecdh, &keylen, key, ECDH_KEY_LENGTH, mbedtls_ctr_drbg_random, &ctr_drbg_context);
+    if (ret < 0) return PORT_FAIL;
+    SIGNBUS_DEBUG("key: %p: 0x%02x%02x%02x...%02x\n", key,
+            key[0], key[1], key[2], key[ECDH_KEY_LENGTH-1]);
+
+    module_info.haskey[module_number] = true;
+    return PORT_SUCCESS;
+}
+
 int signpost_initialization_get_module_state(void) {
     incoming_active_callback = signpost_initialization_get_state_callback;
     get_state_complete = false;
@@ -356,7 +618,7 @@ int signpost_initialization_get_module_state(void) {
             CommandFrame, InitializationApiType, InitializationGetState,
             0, NULL);
 
-    ret = port_signpost_wait_for_with_timeout(&get_state_complete, 2000);
+    ret = signpost_api_wait_for_reply(&get_state_complete, 2000);
     if(ret < PORT_SUCCESS) {
         return PORT_FAIL;
     }
@@ -377,11 +639,35 @@ int signpost_initialization_get_module_state_reply(uint8_t address) {
             sizeof(module_state_t),(uint8_t*)&module_info);
 }
 
+static api_handler_t debug_handler;
+
+// Build the dispatch table from a NULL terminated handler list. As with the
+// list, the first handler given for an api wins.
+static void signpost_api_set_handlers(api_handler_t** api_handlers) {
+    memset(module_api.api_handlers, 0, sizeof(module_api.api_handlers));
+
+    for (api_handler_t** handler = api_handlers; handler != NULL && *handler != NULL; handler++) {
+        signbus_api_type_t api_type = (*handler)->api_type;
+        if (api_type > HighestApiType || module_api.api_handlers[api_type] != NULL) {
+            port_printf("Warn: Ignoring extra handler for api %d\n", api_type);
+            continue;
+        }
+        module_api.api_handlers[api_type] = *handler;
+    }
+
+    // every module answers debug queries unless it serves them itself
+    if (module_api.api_handlers[DebugApiType] == NULL) {
+        module_api.api_handlers[DebugApiType] = &debug_handler;
+    }
+}
+
 static int signpost_initialization_common(uint8_t i2c_address) {
-    SIGNBUS_DEBUG("i2c %02x handlers %p\n", i2c_address, api_handlers);
+    SIGNBUS_DEBUG("i2c %02x\n", i2c_address);
 
     int rc;
 
+    signpost_memstats_init();
+
     // Initialize the lower layers
     signbus_io_init(i2c_address);
     rc = signpost_entropy_init();
@@ -410,7 +696,7 @@ int signpost_initialization_controller_module_init(api_handler_t** api_handlers)
 
     // Save module configuration
     module_info.i2c_address = ModuleAddressController;
-    module_api.api_handlers = api_handlers;
+    signpost_api_set_handlers(api_handlers);
 
     //set the controller module name
     const char* name = "signpost/control";
@@ -425,6 +711,8 @@ int signpost_initialization_controller_module_init(api_handler_t** api_handlers)
 
 static int signpost_initialization_initialize_loop(void) {
     int rc;
+    unsigned key_exchange_tries = 0;
+    uint32_t key_exchange_delay_ms = KEY_EXCHANGE_RETRY_DELAY_MS;
     //module_state_t check_state;
     //bool keys_exist;
 
@@ -460,7 +748,7 @@ static int signpost_initialization_initialize_loop(void) {
 
             // Now declare self to controller
             declare_controller_complete = false;
-            port_signpost_delay_ms(500);
+            port_signpost_delay_ms(100);
             rc = signpost_initialization_declare_controller();
             if (rc != PORT_SUCCESS) {
                 port_printf("INIT: Declaration Failed - Requesting Isolation\n");
@@ -471,7 +759,7 @@ static int signpost_initialization_initialize_loop(void) {
                 break;
             }
 
-            rc = port_signpost_wait_for_with_timeout(&declare_controller_complete, 100);
+            rc = signpost_api_wait_for_reply(&declare_controller_complete, 100);
             if (rc != PORT_SUCCESS) {
               port_printf("INIT: Timed out waiting for controller declare response\n");
               port_signpost_mod_out_set();
@@ -492,6 +780,38 @@ static int signpost_initialization_initialize_loop(void) {
 
             }
             break;
+          case KeyExchange:
+            // Only address assignment needs isolation, so release it
+            // before the (slow) exchange and let other modules declare
+            port_signpost_mod_out_set();
+            port_signpost_debug_led_off();
+
+            rc = signpost_initialization_key_exchange_send(ModuleAddressController);
+            if (rc == PORT_SUCCESS) {
+              port_printf("INIT: Exchanged keys with controller\n");
+              init_state = Done;
+            } else if (rc == PORT_ENOSUPPORT) {
+              // carry on unencrypted rather than holding up the module
+              port_printf("INIT: Controller refused key exchange\n");
+              init_state = Done;
+            } else if (++key_exchange_tries >= SIGNPOST_KEY_EXCHANGE_TRIES) {
+              // the controller is missing or broken; don't hold up the
+              // module forever, carry on unencrypted as if it had refused
+              port_printf("INIT: Key exchange with controller failed: %d, giving up after %u tries\n",
+                  rc, key_exchange_tries);
+              init_state = Done;
+            } else {
+              // the controller may have taken the bus away to isolate
+              // another module, or answered after we gave up. A retry
+              // replaces whatever key it kept, so both sides agree again
+              port_printf("INIT: Key exchange with controller failed: %d, retrying in %lu ms\n",
+                  rc, (unsigned long)key_exchange_delay_ms);
+              port_signpost_delay_ms(key_exchange_delay_ms);
+              if (key_exchange_delay_ms < KEY_EXCHANGE_RETRY_DELAY_MAX_MS) {
+                key_exchange_delay_ms *= 2;
+              }
+            }
+            break;
           case Done:
             // Save module state
             //port_signpost_save_state(&module_info);
@@ -512,14 +832,12 @@ static int signpost_initialization_initialize_loop(void) {
 int signpost_init(const char* org_name, const char* module_name) {
     int rc;
 
-    //setup APIS
-    static api_handler_t* api_handlers[] = {NULL};
     rc = signpost_initialization_common(0x00);
     if (rc < PORT_SUCCESS) return rc;
 
-    // Save module configuration
+    // Save module configuration, no APIs are served by default
     module_info.i2c_address = 0x00;
-    module_api.api_handlers = api_handlers;
+    signpost_api_set_handlers(NULL);
 
 
     //copy the name into the info struct
@@ -564,7 +882,7 @@ int signpost_initialization_module_init(const char* org_name, const char* module
 
     // Save module configuration
     module_info.i2c_address = i2c_address;
-    module_api.api_handlers = api_handlers;
+    signpost_api_set_handlers(api_handlers);
 
     //copy the name into the info struct
     uint8_t org_name_len = strnlen(org_name,NAME_LEN);
@@ -613,30 +931,37 @@ int signpost_initialization_initialize_with_module(uint8_t module_address) {
 
 // message response state
 static bool storage_ready;
-static bool storage_result;
+static int storage_result;
+
+// token for the last write, reused when that write is retried
+static uint32_t storage_write_token;
+static bool storage_write_token_seeded = false;
 static Storage_Record_t* callback_record = NULL;
 static uint8_t* callback_data = NULL;
 static size_t* callback_length = NULL;
+// records expected in a batched write reply
+static size_t batch_count = 0;
+// offset of the outstanding read request
+static uint32_t read_offset = 0;
+// set by a scan page reply if there are more names
+static bool scan_more = false;
 
-static void signpost_storage_scan_callback(int len_or_rc) {
+static void signpost_storage_write_callback(int len_or_rc) {
     if (len_or_rc < PORT_SUCCESS) {
         // error code response
         storage_result = len_or_rc;
-    } else if ((size_t) len_or_rc > *callback_length * sizeof(Storage_Record_t)) {
+    } else if (len_or_rc != sizeof(Storage_Record_t)) {
         // invalid response length
         port_printf("%s:%d - Error: bad len, got %d, want %d\n",
-                __FILE__, __LINE__, len_or_rc, *callback_length*sizeof(Storage_Record_t));
+                __FILE__, __LINE__, len_or_rc, sizeof(Storage_Record_t));
         storage_result = PORT_FAIL;
     } else {
         // valid storage record
-        if (callback_record != NULL && callback_length != NULL) {
+        if (callback_record != NULL) {
             // copy over record response
-            *callback_length = len_or_rc / sizeof(Storage_Record_t);
-            printf("%u\n", *callback_length);
             memcpy(callback_record, incoming_message, len_or_rc);
         }
         callback_record = NULL;
-        callback_length = NULL;
         storage_result = PORT_SUCCESS;
     }
 
@@ -644,19 +969,18 @@ static void signpost_storage_scan_callback(int len_or_rc) {
     storage_ready = true;
 }
 
-static void signpost_storage_write_callback(int len_or_rc) {
+static void signpost_storage_write_batch_callback(int len_or_rc) {
     if (len_or_rc < PORT_SUCCESS) {
         // error code response
         storage_result = len_or_rc;
-    } else if (len_or_rc != sizeof(Storage_Record_t)) {
+    } else if ((size_t) len_or_rc != batch_count * sizeof(Storage_Record_t)) {
         // invalid response length
         port_printf("%s:%d - Error: bad len, got %d, want %d\n",
-                __FILE__, __LINE__, len_or_rc, sizeof(Storage_Record_t));
+                __FILE__, __LINE__, len_or_rc, batch_count * sizeof(Storage_Record_t));
         storage_result = PORT_FAIL;
     } else {
-        // valid storage record
+        // valid storage records
         if (callback_record != NULL) {
-            // copy over record response
             memcpy(callback_record, incoming_message, len_or_rc);
         }
         callback_record = NULL;
@@ -668,23 +992,32 @@ static void signpost_storage_write_callback(int len_or_rc) {
 }
 
 static void signpost_storage_read_callback(int len_or_rc) {
+    // [offset][data]
+    uint32_t offset = 0;
+    if (len_or_rc >= (int) sizeof(offset)) {
+        memcpy(&offset, incoming_message, sizeof(offset));
+    }
+
     if (len_or_rc < PORT_SUCCESS) {
         // error code response
         storage_result = len_or_rc;
-    } else if (callback_length == NULL) {
-        storage_result = PORT_EINVAL;
-    } else if ((size_t) len_or_rc > *callback_length) {
+    } else if (callback_length == NULL || (size_t) len_or_rc < sizeof(offset) ||
+            (size_t) len_or_rc - sizeof(offset) > *callback_length) {
         // invalid response length
-        port_printf("%s:%d - Error: bad len, got %d, want %d\n",
-                __FILE__, __LINE__, len_or_rc, *callback_length);
+        port_printf("%s:%d - Error: bad len, got %d\n", __FILE__, __LINE__, len_or_rc);
+        storage_result = PORT_FAIL;
+    } else if (offset != read_offset) {
+        // a late reply to an earlier request
+        port_printf("%s:%d - Error: got offset %lu, want %lu\n", __FILE__, __LINE__,
+                (unsigned long)offset, (unsigned long)read_offset);
         storage_result = PORT_FAIL;
     } else {
         // valid data
+        *callback_length = len_or_rc - sizeof(offset);
         if (callback_data != NULL) {
-            // copy over record response
-            memcpy(callback_data, incoming_message, *callback_length);
+            memcpy(callback_data, incoming_message + sizeof(offset), *callback_length);
         }
-        callback_data= NULL;
+        callback_data = NULL;
         callback_length = NULL;
         storage_result = PORT_SUCCESS;
     }
@@ -693,22 +1026,66 @@ static void signpost_storage_read_callback(int len_or_rc) {
     storage_ready = true;
 }
 
-int signpost_storage_scan (Storage_Record_t* record_list, size_t* list_len) {
-    storage_ready = false;
-    storage_result = PORT_SUCCESS;
-    callback_record = record_list;
-    callback_length = list_len;
+static void signpost_storage_scan_page_callback(int len_or_rc) {
+    if (len_or_rc < PORT_SUCCESS) {
+        // error code response
+        storage_result = len_or_rc;
+    } else if (len_or_rc < 1 || (len_or_rc - 1) % sizeof(Storage_Record_t) != 0 ||
+            (size_t) (len_or_rc - 1) > *callback_length * sizeof(Storage_Record_t)) {
+        // invalid response length
+        port_printf("%s:%d - Error: bad len, got %d, want at most %d\n",
+                __FILE__, __LINE__, len_or_rc, 1 + *callback_length*sizeof(Storage_Record_t));
+        storage_result = PORT_FAIL;
+    } else {
+        // [more][records]
+        scan_more = incoming_message[0];
+        *callback_length = (len_or_rc - 1) / sizeof(Storage_Record_t);
+        memcpy(callback_record, incoming_message + 1, len_or_rc - 1);
+        callback_record = NULL;
+        callback_length = NULL;
+        storage_result = PORT_SUCCESS;
+    }
+
+    // response received
+    storage_ready = true;
+}
+
+void signpost_storage_scan_open (Storage_Scan_Cursor_t* cursor, const char* prefix) {
+    memset(cursor, 0, sizeof(Storage_Scan_Cursor_t));
+    if (prefix != NULL) {
+        strncpy(cursor->prefix, prefix, STORAGE_LOG_LEN);
+    }
+}
+
+int signpost_storage_scan_next (Storage_Scan_Cursor_t* cursor, Storage_Record_t* list, size_t max_len) {
+    if (cursor->done || max_len == 0) return 0;
+    if (max_len > SIGNPOST_STORAGE_SCAN_PAGE) max_len = SIGNPOST_STORAGE_SCAN_PAGE;
 
     // set up callback
     if (incoming_active_callback != NULL) {
         return PORT_EBUSY;
     }
-    incoming_active_callback = signpost_storage_scan_callback;
+
+    // [max][after\0][prefix\0]
+    uint8_t marshal[1 + 2*(STORAGE_LOG_LEN + 1)] = {0};
+    size_t after_len = strnlen(cursor->after, STORAGE_LOG_LEN);
+    size_t prefix_len = strnlen(cursor->prefix, STORAGE_LOG_LEN);
+    marshal[0] = max_len;
+    memcpy(marshal + 1, cursor->after, after_len);
+    memcpy(marshal + 1 + after_len + 1, cursor->prefix, prefix_len);
+    size_t marshal_len = 1 + after_len + 1 + prefix_len + 1;
+
+    size_t list_len = max_len;
+    storage_ready = false;
+    storage_result = PORT_SUCCESS;
+    scan_more = false;
+    callback_record = list;
+    callback_length = &list_len;
+    incoming_active_callback = signpost_storage_scan_page_callback;
 
     // send message
     int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
-            StorageApiType, StorageScanMessage, sizeof(*list_len), (uint8_t*) list_len);
-
+            StorageApiType, StorageScanPageMessage, marshal_len, marshal);
     if (err < PORT_SUCCESS) {
         storage_ready = true;
         incoming_active_callback = NULL;
@@ -716,91 +1093,271 @@ int signpost_storage_scan (Storage_Record_t* record_list, size_t* list_len) {
     }
 
     // wait for response
-    port_signpost_wait_for_with_timeout(&storage_ready, 5000);
+    err = signpost_api_wait_for_reply(&storage_ready, 5000);
     if (err != 0) {
-      storage_ready = true;
-      incoming_active_callback = NULL;
-      return err;
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
     }
-    return storage_result;
+    if (storage_result < PORT_SUCCESS) return storage_result;
+
+    // carry on after the last name
+    if (list_len > 0) {
+        strncpy(cursor->after, list[list_len-1].logname, STORAGE_LOG_LEN);
+    }
+    cursor->done = !scan_more;
+    return list_len;
+}
+
+int signpost_storage_scan (Storage_Record_t* record_list, size_t* list_len) {
+    Storage_Scan_Cursor_t cursor;
+    signpost_storage_scan_open(&cursor, NULL);
+
+    size_t total = 0;
+    while (total < *list_len) {
+        int rc = signpost_storage_scan_next(&cursor, record_list + total, *list_len - total);
+        if (rc < PORT_SUCCESS) return rc;
+        if (rc == 0) break;
+        total += rc;
+    }
+
+    *list_len = total;
+    return PORT_SUCCESS;
+}
+
+static uint32_t signpost_storage_next_token(void) {
+    // start from a random token so the storage master doesn't mistake our
+    // first writes after a reset for retries of writes from before it
+    if (!storage_write_token_seeded) {
+        mbedtls_ctr_drbg_random(&ctr_drbg_context,
+                (unsigned char*)&storage_write_token, sizeof(storage_write_token));
+        storage_write_token_seeded = true;
+    }
+    return ++storage_write_token;
+}
+
+// Send a write message until it is acknowledged. The storage master only
+// appends once per token, so it is safe to resend the same message if the
+// reply doesn't come back in time.
+static int signpost_storage_write_send(uint8_t message_type, uint8_t* marshal, size_t marshal_len,
+        Storage_Record_t* records, signbus_app_callback_t* callback) {
+    int err = PORT_FAIL;
+    for (int tries = 0; tries < SIGNPOST_STORAGE_WRITE_TRIES; tries++) {
+        storage_ready = false;
+        storage_result = PORT_SUCCESS;
+        callback_record = records;
+        incoming_active_callback = callback;
+
+        // send message
+        err = signpost_api_send(ModuleAddressStorage, CommandFrame,
+                StorageApiType, message_type, marshal_len, marshal);
+        if (err < PORT_SUCCESS) {
+            incoming_active_callback = NULL;
+            continue;
+        }
+
+        // wait for response
+        err = signpost_api_wait_for_reply(&storage_ready, SIGNPOST_STORAGE_WRITE_TIMEOUT_MS);
+        if (err == 0) {
+            err = storage_result;
+            // a malformed request fails the same way every time, but the
+            // card can fail partway, so resend under the same token and
+            // the storage master picks up where it stopped
+            if (err >= PORT_SUCCESS || err == PORT_ESIZE || err == PORT_EINVAL ||
+                    err == PORT_ENOSUPPORT) {
+                return err;
+            }
+            continue;
+        }
+        incoming_active_callback = NULL;
+    }
+
+    storage_ready = true;
+    return err;
 }
 
 int signpost_storage_write (uint8_t* data, size_t len, Storage_Record_t* record_pointer) {
-    storage_ready = false;
-    storage_result = PORT_SUCCESS;
-    callback_record = record_pointer;
+    return signpost_storage_write_durable(data, len, record_pointer, StorageDurabilityGroup);
+}
 
+int signpost_storage_write_durable (uint8_t* data, size_t len, Storage_Record_t* record_pointer,
+        signpost_storage_durability_e durability) {
     // set up callback
     if (incoming_active_callback != NULL) {
         return PORT_EBUSY;
     }
-    incoming_active_callback = signpost_storage_write_callback;
+    if (durability > StorageDurabilityLazy) {
+        return PORT_EINVAL;
+    }
+    uint32_t token = signpost_storage_next_token();
 
     // allocate new message buffer
+    // [token][durability][logname\0][data]
+    size_t header_len = sizeof(token) + 1;
     size_t logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
-    uint8_t* marshal = (uint8_t*) malloc(logname_len + len + 1);
-    memcpy(marshal, record_pointer->logname, logname_len+1);
-    marshal[logname_len] = 0;
-    memcpy(marshal+logname_len+1, data, len);
-    // send message
-    int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
-            StorageApiType, StorageWriteMessage, len+logname_len+1, marshal);
+    size_t marshal_len = header_len + logname_len + 1 + len;
+    uint8_t* marshal = (uint8_t*) signpost_malloc(marshal_len);
+    if (marshal == NULL) {
+        return PORT_ENOMEM;
+    }
+    memcpy(marshal, &token, sizeof(token));
+    marshal[sizeof(token)] = durability;
+    memcpy(marshal+header_len, record_pointer->logname, logname_len);
+    marshal[header_len+logname_len] = 0;
+    memcpy(marshal+header_len+logname_len+1, data, len);
+
+    int err = signpost_storage_write_send(StorageWriteMessage, marshal, marshal_len,
+            record_pointer, signpost_storage_write_callback);
 
     // free message buffer
-    free(marshal);
+    signpost_free(marshal);
+    return err;
+}
 
-    if (err < PORT_SUCCESS) {
-        storage_ready = true;
-        incoming_active_callback = NULL;
-        return err;
+int signpost_storage_write_batch (Storage_Write_t* writes, size_t count) {
+    // set up callback
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+    if (count == 0 || count > SIGNPOST_STORAGE_BATCH_MAX) {
+        return PORT_EINVAL;
     }
 
-    // wait for response
-    //err = port_signpost_wait_for_with_timeout(&storage_ready, 5000);
-    //if (err != 0) {
-    //  storage_ready = true;
-    //  incoming_active_callback = NULL;
-    //  return err;
-    //}
-    return storage_result;
-}
+    // group the records by log so the storage master writes each log once
+    uint8_t order[SIGNPOST_STORAGE_BATCH_MAX];
+    bool placed[SIGNPOST_STORAGE_BATCH_MAX] = {false};
+    size_t ordered = 0;
+    uint8_t logs = 0;
+    size_t marshal_len = sizeof(uint32_t) + 1;
+    for (size_t i = 0; i < count; i++) {
+        if (writes[i].len > UINT16_MAX) return PORT_ESIZE;
+        if (placed[i]) continue;
+
+        const char* logname = writes[i].record->logname;
+        logs++;
+        marshal_len += strnlen(logname, STORAGE_LOG_LEN) + 2;
+        for (size_t j = i; j < count; j++) {
+            if (!placed[j] && !strncmp(writes[j].record->logname, logname, STORAGE_LOG_LEN)) {
+                placed[j] = true;
+                order[ordered++] = j;
+                marshal_len += sizeof(uint16_t) + writes[j].len;
+            }
+        }
+    }
+    if (marshal_len > SIGNPOST_STORAGE_BATCH_MAX_LEN) {
+        return PORT_ESIZE;
+    }
 
-int signpost_storage_read (uint8_t* data, size_t *len, Storage_Record_t * record_pointer) {
-    storage_ready = false;
-    storage_result = PORT_SUCCESS;
-    callback_record = record_pointer;
-    callback_data = data;
-    callback_length = len;
+    uint8_t* marshal = (uint8_t*) signpost_malloc(marshal_len);
+    Storage_Record_t* records = (Storage_Record_t*) signpost_malloc(count * sizeof(Storage_Record_t));
+    if (marshal == NULL || records == NULL) {
+        signpost_free(marshal);
+        signpost_free(records);
+        return PORT_ENOMEM;
+    }
+
+    // [token][log count] then for each log
+    // [logname\0][record count][record lengths][record data]
+    uint32_t token = signpost_storage_next_token();
+    size_t pos = 0;
+    memcpy(marshal, &token, sizeof(token));
+    pos += sizeof(token);
+    marshal[pos++] = logs;
+    for (size_t k = 0; k < ordered;) {
+        const char* logname = writes[order[k]].record->logname;
+        size_t n = 1;
+        while (k + n < ordered &&
+                !strncmp(writes[order[k+n]].record->logname, logname, STORAGE_LOG_LEN)) {
+            n++;
+        }
+
+        size_t logname_len = strnlen(logname, STORAGE_LOG_LEN);
+        memcpy(marshal+pos, logname, logname_len);
+        pos += logname_len;
+        marshal[pos++] = 0;
+        marshal[pos++] = n;
+        for (size_t i = 0; i < n; i++) {
+            uint16_t len = writes[order[k+i]].len;
+            memcpy(marshal+pos, &len, sizeof(len));
+            pos += sizeof(len);
+        }
+        for (size_t i = 0; i < n; i++) {
+            memcpy(marshal+pos, writes[order[k+i]].data, writes[order[k+i]].len);
+            pos += writes[order[k+i]].len;
+        }
+        k += n;
+    }
+
+    batch_count = count;
+    int err = signpost_storage_write_send(StorageWriteBatchMessage, marshal, marshal_len,
+            records, signpost_storage_write_batch_callback);
+    if (err == PORT_SUCCESS) {
+        // records come back in message order
+        for (size_t k = 0; k < ordered; k++) {
+            memcpy(writes[order[k]].record, &records[k], sizeof(Storage_Record_t));
+        }
+    }
+
+    signpost_free(marshal);
+    signpost_free(records);
+    return err;
+}
 
+int signpost_storage_write_timed (uint8_t* data, size_t len, uint32_t timestamp, Storage_Record_t* record_pointer) {
     // set up callback
     if (incoming_active_callback != NULL) {
         return PORT_EBUSY;
     }
-    incoming_active_callback = signpost_storage_read_callback;
-
-    if(*len> record_pointer->length - record_pointer->offset) {
-      *len= record_pointer->length - record_pointer->offset;
+    if (len > UINT16_MAX) {
+        return PORT_ESIZE;
     }
+    uint32_t token = signpost_storage_next_token();
 
     // allocate new message buffer
+    // [token][timestamp][logname\0][data]
+    size_t header_len = sizeof(token) + sizeof(timestamp);
     size_t logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
-    size_t offset_len = sizeof(record_pointer->offset);
-    size_t length_len = sizeof(*len);
-    size_t marshal_len = logname_len + offset_len + length_len + 2;
-
-    uint8_t* marshal = (uint8_t*) malloc(marshal_len);
-    memset(marshal, 0, marshal_len);
-    memcpy(marshal, &record_pointer->logname, logname_len);
-    memcpy(marshal+logname_len+1, &record_pointer->offset, offset_len);
-    memcpy(marshal+logname_len+1+offset_len+1, len, length_len);
+    size_t marshal_len = header_len + logname_len + 1 + len;
+    uint8_t* marshal = (uint8_t*) signpost_malloc(marshal_len);
+    if (marshal == NULL) {
+        return PORT_ENOMEM;
+    }
+    memcpy(marshal, &token, sizeof(token));
+    memcpy(marshal+sizeof(token), &timestamp, sizeof(timestamp));
+    memcpy(marshal+header_len, record_pointer->logname, logname_len);
+    marshal[header_len+logname_len] = 0;
+    memcpy(marshal+header_len+logname_len+1, data, len);
 
-    // send message
-    int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
-            StorageApiType, StorageReadMessage, marshal_len, marshal);
+    int err = signpost_storage_write_send(StorageWriteTimedMessage, marshal, marshal_len,
+            record_pointer, signpost_storage_write_callback);
 
     // free message buffer
-    free(marshal);
+    signpost_free(marshal);
+    return err;
+}
+
+int signpost_storage_query_range (Storage_Record_t* record_pointer, uint32_t start, uint32_t end) {
+    // set up callback
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+
+    // [start][end][logname\0]
+    uint8_t marshal[2*sizeof(uint32_t) + STORAGE_LOG_LEN + 1] = {0};
+    size_t logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
+    memcpy(marshal, &start, sizeof(start));
+    memcpy(marshal+sizeof(start), &end, sizeof(end));
+    memcpy(marshal+sizeof(start)+sizeof(end), record_pointer->logname, logname_len);
+    size_t marshal_len = sizeof(start) + sizeof(end) + logname_len + 1;
+
+    storage_ready = false;
+    storage_result = PORT_SUCCESS;
+    callback_record = record_pointer;
+    incoming_active_callback = signpost_storage_write_callback;
 
+    // send message
+    int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
+            StorageApiType, StorageQueryRangeMessage, marshal_len, marshal);
     if (err < PORT_SUCCESS) {
         storage_ready = true;
         incoming_active_callback = NULL;
@@ -808,47 +1365,316 @@ int signpost_storage_read (uint8_t* data, size_t *len, Storage_Record_t * record
     }
 
     // wait for response
-    err = port_signpost_wait_for_with_timeout(&storage_ready, 5000);
+    err = signpost_api_wait_for_reply(&storage_ready, 5000);
     if (err != 0) {
-      storage_ready = true;
-      incoming_active_callback = NULL;
-      return err;
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
     }
     return storage_result;
 }
 
-int signpost_storage_delete (Storage_Record_t* record_pointer) {
-    storage_ready = false;
-    storage_result = PORT_SUCCESS;
-    callback_record = record_pointer;
+void signpost_storage_read_open (Storage_Read_Cursor_t* cursor, Storage_Record_t* record_pointer) {
+    memset(cursor->logname, 0, sizeof(cursor->logname));
+    strncpy(cursor->logname, record_pointer->logname, STORAGE_LOG_LEN);
+    cursor->offset = record_pointer->offset;
+    cursor->remaining = record_pointer->length;
+}
 
+int signpost_storage_read_next (Storage_Read_Cursor_t* cursor, uint8_t* data, size_t max_len) {
     // set up callback
     if (incoming_active_callback != NULL) {
         return PORT_EBUSY;
     }
-    incoming_active_callback = signpost_storage_write_callback;
 
-    // allocate new message buffer
-    size_t logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
+    size_t len = max_len;
+    if (len > SIGNPOST_STORAGE_READ_CHUNK) len = SIGNPOST_STORAGE_READ_CHUNK;
+    if (len > cursor->remaining) len = cursor->remaining;
+    if (len == 0) return 0;
+
+    // [offset][length][logname\0]
+    uint8_t marshal[sizeof(uint32_t) + sizeof(uint16_t) + STORAGE_LOG_LEN + 1] = {0};
+    uint32_t offset = cursor->offset;
+    uint16_t length = len;
+    size_t logname_len = strnlen(cursor->logname, STORAGE_LOG_LEN);
+    memcpy(marshal, &offset, sizeof(offset));
+    memcpy(marshal+sizeof(offset), &length, sizeof(length));
+    memcpy(marshal+sizeof(offset)+sizeof(length), cursor->logname, logname_len);
+    size_t marshal_len = sizeof(offset) + sizeof(length) + logname_len + 1;
+
+    storage_ready = false;
+    storage_result = PORT_SUCCESS;
+    callback_data = data;
+    callback_length = &len;
+    read_offset = offset;
+    incoming_active_callback = signpost_storage_read_callback;
 
     // send message
     int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
-            StorageApiType, StorageDeleteMessage, logname_len, (uint8_t*) record_pointer->logname); if (err < PORT_SUCCESS) {
+            StorageApiType, StorageReadMessage, marshal_len, marshal);
+    if (err < PORT_SUCCESS) {
         storage_ready = true;
         incoming_active_callback = NULL;
         return err;
     }
 
     // wait for response
-    //err = port_signpost_wait_for_with_timeout(&storage_ready, 5000);
-    //if (err != 0) {
-    //  storage_ready = true;
-    //  incoming_active_callback = NULL;
-    //  return err;
-    //}
+    err = signpost_api_wait_for_reply(&storage_ready, 5000);
+    if (err != 0) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
+    if (storage_result < PORT_SUCCESS) {
+        return storage_result;
+    }
+
+    // a short chunk means the log ended
+    cursor->offset += len;
+    cursor->remaining = len < length ? 0 : cursor->remaining - len;
+    return len;
+}
+
+static signpost_storage_aggregate_t* callback_aggregate = NULL;
+
+static void signpost_storage_aggregate_callback(int len_or_rc) {
+    if (len_or_rc < PORT_SUCCESS) {
+        // error code response
+        storage_result = len_or_rc;
+    } else if (len_or_rc != sizeof(signpost_storage_aggregate_t)) {
+        // invalid response length
+        port_printf("%s:%d - Error: bad len, got %d, want %d\n",
+                __FILE__, __LINE__, len_or_rc, sizeof(signpost_storage_aggregate_t));
+        storage_result = PORT_FAIL;
+    } else {
+        memcpy(callback_aggregate, incoming_message, len_or_rc);
+        storage_result = PORT_SUCCESS;
+    }
+
+    // response received
+    storage_ready = true;
+}
+
+int signpost_storage_aggregate (Storage_Record_t* record_pointer,
+        signpost_storage_aggregate_query_t* query, signpost_storage_aggregate_t* result) {
+    // set up callback
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+    if (query->histogram_bins > SIGNPOST_STORAGE_HISTOGRAM_BINS) {
+        return PORT_EINVAL;
+    }
+
+    // [offset][length][query][logname\0]
+    uint8_t marshal[2*sizeof(uint32_t) + sizeof(signpost_storage_aggregate_query_t) + STORAGE_LOG_LEN + 1] = {0};
+    uint32_t offset = record_pointer->offset;
+    uint32_t length = record_pointer->length;
+    size_t logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
+    size_t pos = 0;
+    memcpy(marshal+pos, &offset, sizeof(offset));
+    pos += sizeof(offset);
+    memcpy(marshal+pos, &length, sizeof(length));
+    pos += sizeof(length);
+    memcpy(marshal+pos, query, sizeof(*query));
+    pos += sizeof(*query);
+    memcpy(marshal+pos, record_pointer->logname, logname_len);
+    size_t marshal_len = pos + logname_len + 1;
+
+    storage_ready = false;
+    storage_result = PORT_SUCCESS;
+    callback_aggregate = result;
+    incoming_active_callback = signpost_storage_aggregate_callback;
+
+    // send message
+    int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
+            StorageApiType, StorageAggregateMessage, marshal_len, marshal);
+    if (err < PORT_SUCCESS) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
+
+    // wait for response
+    err = signpost_api_wait_for_reply(&storage_ready, 5000);
+    if (err != 0) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
+    return storage_result;
+}
+
+// Read exactly len bytes, or fail
+static int signpost_storage_read_exact (Storage_Read_Cursor_t* cursor, uint8_t* data, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        int rc = signpost_storage_read_next(cursor, data + total, len - total);
+        if (rc < PORT_SUCCESS) return rc;
+        if (rc == 0) return PORT_FAIL;
+        total += rc;
+    }
+    return PORT_SUCCESS;
+}
+
+int signpost_storage_read_timed (Storage_Read_Cursor_t* cursor, uint32_t* timestamp, uint8_t* data, size_t max_len) {
+    if (cursor->remaining == 0) return 0;
+
+    // [timestamp][length][data]
+    uint8_t header[SIGNPOST_STORAGE_TIMED_HEADER_LEN];
+    int rc = signpost_storage_read_exact(cursor, header, sizeof(header));
+    if (rc < PORT_SUCCESS) return rc;
+    uint16_t len;
+    memcpy(timestamp, header, sizeof(uint32_t));
+    memcpy(&len, header + sizeof(uint32_t), sizeof(len));
+
+    if (len > max_len) {
+        // skip over it
+        cursor->offset += len;
+        cursor->remaining = cursor->remaining > len ? cursor->remaining - len : 0;
+        return PORT_ESIZE;
+    }
+    rc = signpost_storage_read_exact(cursor, data, len);
+    if (rc < PORT_SUCCESS) return rc;
+    return len;
+}
+
+int signpost_storage_read (uint8_t* data, size_t *len, Storage_Record_t * record_pointer) {
+    Storage_Read_Cursor_t cursor;
+    signpost_storage_read_open(&cursor, record_pointer);
+    if (cursor.remaining > *len) cursor.remaining = *len;
+
+    size_t total = 0;
+    while (cursor.remaining > 0) {
+        int rc = signpost_storage_read_next(&cursor, data + total, *len - total);
+        if (rc < PORT_SUCCESS) return rc;
+        total += rc;
+    }
+
+    *len = total;
+    return PORT_SUCCESS;
+}
+
+int signpost_storage_delete (Storage_Record_t* record_pointer) {
+    storage_ready = false;
+    storage_result = PORT_SUCCESS;
+    callback_record = record_pointer;
+
+    // set up callback
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+    incoming_active_callback = signpost_storage_write_callback;
+
+    // allocate new message buffer
+    size_t logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
+
+    // send message
+    int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
+            StorageApiType, StorageDeleteMessage, logname_len, (uint8_t*) record_pointer->logname); if (err < PORT_SUCCESS) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
+
+    // wait for response
+    //err = port_signpost_wait_for_with_timeout(&storage_ready, 5000);
+    //if (err != 0) {
+    //  storage_ready = true;
+    //  incoming_active_callback = NULL;
+    //  return err;
+    //}
+    return storage_result;
+}
+
+int signpost_storage_flush (Storage_Record_t* record_pointer) {
+    // set up callback
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+    storage_ready = false;
+    storage_result = PORT_SUCCESS;
+    callback_record = record_pointer;
+    incoming_active_callback = signpost_storage_write_callback;
+
+    // an empty logname flushes every log
+    size_t logname_len = 0;
+    uint8_t* logname = NULL;
+    if (record_pointer != NULL) {
+        logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
+        logname = (uint8_t*) record_pointer->logname;
+    }
+
+    // send message
+    int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
+            StorageApiType, StorageFlushMessage, logname_len, logname);
+    if (err < PORT_SUCCESS) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
+
+    // wait for response
+    err = signpost_api_wait_for_reply(&storage_ready, 5000);
+    if (err != 0) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
+    return storage_result;
+}
+
+int signpost_storage_set_circular (Storage_Record_t* record_pointer, size_t max_size) {
+    // set up callback
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+    if (max_size == 0 || max_size > UINT32_MAX) {
+        return PORT_EINVAL;
+    }
+
+    // [capacity][logname\0]
+    uint8_t marshal[sizeof(uint32_t) + STORAGE_LOG_LEN + 1] = {0};
+    uint32_t capacity = max_size;
+    size_t logname_len = strnlen(record_pointer->logname, STORAGE_LOG_LEN);
+    memcpy(marshal, &capacity, sizeof(capacity));
+    memcpy(marshal + sizeof(capacity), record_pointer->logname, logname_len);
+    size_t marshal_len = sizeof(capacity) + logname_len + 1;
+
+    storage_ready = false;
+    storage_result = PORT_SUCCESS;
+    callback_record = record_pointer;
+    incoming_active_callback = signpost_storage_write_callback;
+
+    // send message
+    int err = signpost_api_send(ModuleAddressStorage, CommandFrame,
+            StorageApiType, StorageCircularMessage, marshal_len, marshal);
+    if (err < PORT_SUCCESS) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
+
+    // wait for response
+    err = signpost_api_wait_for_reply(&storage_ready, 5000);
+    if (err != 0) {
+        storage_ready = true;
+        incoming_active_callback = NULL;
+        return err;
+    }
     return storage_result;
 }
 
+int signpost_storage_scan_page_reply(uint8_t destination_address, bool more, Storage_Record_t* list, size_t list_len) {
+    // [more][records]
+    uint8_t reply[1 + SIGNPOST_STORAGE_SCAN_PAGE*sizeof(Storage_Record_t)];
+    if (list_len > SIGNPOST_STORAGE_SCAN_PAGE) return PORT_ESIZE;
+    reply[0] = more;
+    memcpy(reply + 1, list, list_len*sizeof(Storage_Record_t));
+    return signpost_api_send(destination_address,
+            ResponseFrame, StorageApiType, StorageScanPageMessage,
+            1 + list_len*sizeof(Storage_Record_t), reply);
+}
+
 int signpost_storage_scan_reply(uint8_t destination_address, Storage_Record_t* list, size_t list_len) {
     return signpost_api_send(destination_address,
             ResponseFrame, StorageApiType, StorageScanMessage,
@@ -861,12 +1687,36 @@ int signpost_storage_write_reply(uint8_t destination_address, Storage_Record_t*
             sizeof(Storage_Record_t), (uint8_t*) record_pointer);
 }
 
+int signpost_storage_write_batch_reply(uint8_t destination_address, Storage_Record_t* records, size_t count) {
+  return signpost_api_send(destination_address,
+            ResponseFrame, StorageApiType, StorageWriteBatchMessage,
+            count * sizeof(Storage_Record_t), (uint8_t*) records);
+}
+
 int signpost_storage_read_reply(uint8_t destination_address, uint8_t* data, size_t length) {
     return signpost_api_send(destination_address,
             ResponseFrame, StorageApiType, StorageWriteMessage,
             length, data);
 }
 
+int signpost_storage_flush_reply(uint8_t destination_address, Storage_Record_t* record_pointer) {
+    return signpost_api_send(destination_address,
+            ResponseFrame, StorageApiType, StorageFlushMessage,
+            sizeof(Storage_Record_t), (uint8_t*) record_pointer);
+}
+
+int signpost_storage_set_circular_reply(uint8_t destination_address, Storage_Record_t* record_pointer) {
+    return signpost_api_send(destination_address,
+            ResponseFrame, StorageApiType, StorageCircularMessage,
+            sizeof(Storage_Record_t), (uint8_t*) record_pointer);
+}
+
+int signpost_storage_aggregate_reply(uint8_t destination_address, signpost_storage_aggregate_t* result) {
+    return signpost_api_send(destination_address,
+            ResponseFrame, StorageApiType, StorageAggregateMessage,
+            sizeof(signpost_storage_aggregate_t), (uint8_t*) result);
+}
+
 int signpost_storage_delete_reply(uint8_t destination_address, Storage_Record_t* record_pointer) {
     return signpost_api_send(destination_address,
             ResponseFrame, StorageApiType, StorageDeleteMessage,
@@ -902,7 +1752,7 @@ int signpost_processing_init(const char* path) {
     if (rc < 0) return rc;
 
     //wait for a response
-    port_signpost_wait_for(&processing_ready);
+    signpost_api_wait_for_reply(&processing_ready, 0);
 
     if(incoming_message_length >= 5) {
         //this byte should be the return code
@@ -935,7 +1785,7 @@ int signpost_processing_oneway_send(uint8_t* buf, uint16_t len) {
     processing_ready = false;
     //wait for a response
     //the response is just an ack that it got there
-    port_signpost_wait_for(&processing_ready);
+    signpost_api_wait_for_reply(&processing_ready, 0);
 
     return incoming_message[0];
 }
@@ -966,7 +1816,7 @@ int signpost_processing_twoway_send(uint8_t* buf, uint16_t len) {
 
 int signpost_processing_twoway_receive(uint8_t* buf, uint16_t* len) {
 
-    port_signpost_wait_for(&processing_ready);
+    signpost_api_wait_for_reply(&processing_ready, 0);
 
     //get the header and confirm it matches
     uint16_t size;
@@ -1001,42 +1851,105 @@ int signpost_processing_reply(uint8_t src_addr, uint8_t message_type, uint8_t* r
 
 
 static bool networking_ready;
-static bool networking_result;
-static signpost_networking_subscribe_cb_t networking_subscribe_cb = NULL;
+static int  networking_result;
+// Subscriptions are kept in a trie with one node per topic level, built at
+// subscribe time. A downlink topic is matched by walking it one level at a
+// time, so dispatch costs O(topic length) however many subscriptions exist.
+typedef struct subscription {
+    signpost_networking_subscribe_cb_t cb;
+    struct subscription* next;
+} subscription_t;
+
+typedef struct topic_node {
+    const char*         level;      // points into the saved filter string
+    uint8_t             level_len;
+    struct topic_node*  child;
+    struct topic_node*  sibling;
+    subscription_t*     subscribers;
+} topic_node_t;
+
+static topic_node_t topic_root;
+
+static bool topic_level_is(const topic_node_t* node, const char* level, size_t len) {
+    return node->level_len == len && !memcmp(node->level, level, len);
+}
+
+static topic_node_t* topic_node_child(topic_node_t* parent, const char* level, size_t len, bool create) {
+    for (topic_node_t* node = parent->child; node != NULL; node = node->sibling) {
+        if (topic_level_is(node, level, len)) return node;
+    }
+    if (!create) return NULL;
+
+    topic_node_t* node = signpost_calloc(1, sizeof(topic_node_t));
+    if (node == NULL) return NULL;
+    node->level = level;
+    node->level_len = len;
+    node->sibling = parent->child;
+    parent->child = node;
+    return node;
+}
+
+static void topic_notify(topic_node_t* node, char* topic, uint8_t* data, uint8_t data_len) {
+    for (subscription_t* sub = node->subscribers; sub != NULL; sub = sub->next) {
+        sub->cb(topic, data, data_len);
+    }
+}
+
+// level points at the start of the remaining topic levels, or is NULL once
+// every level has been consumed
+static void topic_match(topic_node_t* node, const char* level, char* topic,
+        uint8_t* data, uint8_t data_len) {
+    // '#' matches everything below here, including nothing at all
+    topic_node_t* multi = topic_node_child(node, "#", 1, false);
+    if (multi != NULL) topic_notify(multi, topic, data, data_len);
+
+    if (level == NULL) {
+        topic_notify(node, topic, data, data_len);
+        return;
+    }
+
+    const char* end = strchr(level, '/');
+    size_t len = (end == NULL) ? strlen(level) : (size_t)(end - level);
+    const char* rest = (end == NULL) ? NULL : end + 1;
+
+    topic_node_t* exact = topic_node_child(node, level, len, false);
+    if (exact != NULL) topic_match(exact, rest, topic, data, data_len);
+
+    topic_node_t* single = topic_node_child(node, "+", 1, false);
+    if (single != NULL && !(len == 1 && *level == '+')) {
+        topic_match(single, rest, topic, data, data_len);
+    }
+}
 
 static void internal_subscribe_callback(__attribute__ ((unused)) uint8_t source_address,
         signbus_frame_type_t frame_type, __attribute ((unused)) signbus_api_type_t api_type,
         uint8_t message_type, size_t message_length, uint8_t* message) {
 
-    //If there is no callback just drop the message
-    if(networking_subscribe_cb == NULL) {
+    if(api_type != NetworkingApiType ||
+            frame_type != NotificationFrame ||
+            message_type != NetworkingSubscribeMessage) {
         return;
-    } else {
-        if(api_type == NetworkingApiType &&
-                frame_type == NotificationFrame &&
-                message_type == NetworkingSubscribeMessage) {
-            //extract the topic and the data
-            //make the topic string static for easier processing
-            char topic[NAME_LEN*2+1] = {0};
-            uint8_t tlen = message[0];
-            if(tlen > 28 || message_length < tlen + (unsigned)2) {
-                //invalid topic
-                return;
-            }
-            memcpy(topic, message+1, tlen);
+    }
 
-            uint8_t dlen = message[tlen+1];
-            if(message_length < tlen + dlen + (unsigned)2) {
-                return;
-            }
-            uint8_t* data = message+tlen+2;
+    //extract the topic and the data
+    uint8_t tlen = message[0];
+    if(tlen > 28 || message_length < tlen + (unsigned)2) {
+        //invalid topic
+        return;
+    }
 
-            //call the provided callback
-            networking_subscribe_cb(topic, data, dlen);
-        } else {
-            return;
-        }
+    uint8_t dlen = message[tlen+1];
+    if(message_length < tlen + dlen + (unsigned)2) {
+        return;
     }
+    uint8_t* data = message+tlen+2;
+
+    //terminate the topic in place of the data length we just read, so
+    //subscribers get a string without copying it out of the message
+    char* topic = (char*)message+1;
+    message[tlen+1] = '\0';
+
+    topic_match(&topic_root, topic, topic, data, dlen);
 }
 
 static void signpost_networking_callback(int result) {
@@ -1044,7 +1957,11 @@ static void signpost_networking_callback(int result) {
     networking_result = result;
 }
 
-int signpost_networking_publish(const char* topic, uint8_t* data, uint8_t data_len) {
+// Lay out one publish as the radio expects it:
+// [topic len][module name/topic][data len][data]
+// returns the record length, or PORT_ESIZE if it won't fit in buf
+static int signpost_networking_build_record(uint8_t* buf, size_t buflen,
+        const char* topic, uint8_t* data, uint8_t data_len) {
     uint8_t slen;
     if(strnlen(topic, 14) > 14) {
         slen = 14;
@@ -1059,9 +1976,8 @@ int signpost_networking_publish(const char* topic, uint8_t* data, uint8_t data_l
     }
 
     uint32_t len = nlen + slash + slen + data_len + 2;
-    uint8_t* buf = malloc(len);
-    if(!buf) {
-        return PORT_ENOMEM;
+    if(len > buflen) {
+        return PORT_ESIZE;
     }
 
     buf[0] = slen + nlen + slash;
@@ -1069,23 +1985,29 @@ int signpost_networking_publish(const char* topic, uint8_t* data, uint8_t data_l
     if(slash) {
         buf[nlen+1] = '/';
     }
-    memcpy(buf+1+nlen+1, topic, slen);
+    memcpy(buf+1+nlen+slash, topic, slen);
     buf[slen+nlen+slash+1] = data_len;
     memcpy(buf+1+slen+1+nlen+slash, data, data_len);
 
+    return len;
+}
+
+static int signpost_networking_send(uint8_t message_type, uint8_t* buf, size_t len) {
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
 
     incoming_active_callback = signpost_networking_callback;
     networking_ready = false;
     int rc = signpost_api_send(ModuleAddressRadio, CommandFrame, NetworkingApiType,
-                        NetworkingPublishMessage, len, buf);
+                        message_type, len, buf);
 
-    free(buf);
     if(rc < PORT_SUCCESS) {
         incoming_active_callback = NULL;
         return rc;
     }
 
-    rc = port_signpost_wait_for_with_timeout(&networking_ready, 3000);
+    rc = signpost_api_wait_for_reply(&networking_ready, 3000);
     if(rc < PORT_SUCCESS) {
         incoming_active_callback = NULL;
         return rc;
@@ -1098,45 +2020,193 @@ int signpost_networking_publish(const char* topic, uint8_t* data, uint8_t data_l
     }
 }
 
-int signpost_networking_subscribe(signpost_networking_subscribe_cb_t cb) {
-    //store the callback in our callback field
-    networking_subscribe_cb = cb;
-
-    //register our internal callback with the app recv handler
-    // get number of api_handlers and insert initialization handler
-    uint8_t i = 0;
-    while((module_api.api_handlers)[i] != NULL) {
-        //You can't do this if a networking handler is already registered
-        if((module_api.api_handlers)[i]->api_type == NetworkingApiType){
-            return PORT_EINVAL;
-        }
-        i++;
+int signpost_networking_publish(const char* topic, uint8_t* data, uint8_t data_len) {
+    size_t max_len = NAME_LEN + 1 + 14 + data_len + 2;
+    uint8_t* buf = signpost_malloc(max_len);
+    if(!buf) {
+        return PORT_ENOMEM;
     }
 
-    //note the size of the original handler array
-    uint8_t original_handler_num = i;
+    int len = signpost_networking_build_record(buf, max_len, topic, data, data_len);
+    if(len < 0) {
+        signpost_free(buf);
+        return len;
+    }
 
-    //we need two more handlers, one for the array and one to terminate it
-    i += 2;
+    int rc = signpost_networking_send(NetworkingPublishMessage, buf, len);
+    signpost_free(buf);
+    return rc;
+}
 
-    //Initialize a new handlers array
-    api_handler_t** updated_api_handlers = (api_handler_t**) malloc(i*sizeof(api_handler_t*));
-    if(updated_api_handlers == NULL) {
+int signpost_networking_publish_notify(const char* topic, uint8_t* data, uint8_t data_len) {
+    size_t max_len = NAME_LEN + 1 + 14 + data_len + 2;
+    uint8_t* buf = signpost_malloc(max_len);
+    if(!buf) {
         return PORT_ENOMEM;
     }
 
+    int len = signpost_networking_build_record(buf, max_len, topic, data, data_len);
+    if(len < 0) {
+        signpost_free(buf);
+        return len;
+    }
+
+    // the radio doesn't reply to notifications, so done once it's on the bus
+    int rc = signpost_api_send(ModuleAddressRadio, NotificationFrame, NetworkingApiType,
+                        NetworkingPublishMessage, len, buf);
+    signpost_free(buf);
+    if(rc < PORT_SUCCESS) {
+        return rc;
+    }
+    return PORT_SUCCESS;
+}
+
+static uint8_t  networking_batch_buf[SIGNPOST_NETWORKING_BATCH_LEN];
+static size_t   networking_batch_len = 0;
+static uint32_t networking_batch_start;
+
+int signpost_networking_flush(void) {
+    if(networking_batch_len == 0) {
+        return PORT_SUCCESS;
+    }
+
+    int rc = signpost_networking_send(NetworkingPublishBatchMessage,
+                        networking_batch_buf, networking_batch_len);
+
+    // drop the batch either way, a failed batch is like a failed publish
+    networking_batch_len = 0;
+    return rc;
+}
+
+int signpost_networking_publish_batched(const char* topic, uint8_t* data, uint8_t data_len) {
+    int rc;
+
+    // flush first if this record won't fit behind the ones already queued
+    int len = signpost_networking_build_record(networking_batch_buf + networking_batch_len,
+            SIGNPOST_NETWORKING_BATCH_LEN - networking_batch_len, topic, data, data_len);
+    if(len == PORT_ESIZE && networking_batch_len > 0) {
+        rc = signpost_networking_flush();
+        if(rc < PORT_SUCCESS) {
+            return rc;
+        }
+        len = signpost_networking_build_record(networking_batch_buf,
+                SIGNPOST_NETWORKING_BATCH_LEN, topic, data, data_len);
+    }
+    if(len < 0) {
+        return len;
+    }
+
+    if(networking_batch_len == 0) {
+        networking_batch_start = port_signpost_timer_read();
+    }
+    networking_batch_len += len;
+
+    // flush if the oldest record has waited long enough
+    uint32_t deadline = (uint32_t)(((uint64_t)port_signpost_timer_frequency() *
+                SIGNPOST_NETWORKING_BATCH_DEADLINE_MS) / 1000);
+    if(port_signpost_timer_read() - networking_batch_start >= deadline) {
+        return signpost_networking_flush();
+    }
+
+    return PORT_SUCCESS;
+}
+
+static int signpost_networking_register_handler(void) {
     static api_handler_t subscribe_handler  = {NetworkingApiType, internal_subscribe_callback};
-    //first handler is out new networking handler
-    updated_api_handlers[0] = &subscribe_handler;
-    //last handler is always NULL
-    updated_api_handlers[i-1] = NULL;
-    //copy the origin handlers into
-    memcpy(updated_api_handlers+1, module_api.api_handlers, original_handler_num * sizeof(api_handler_t*));
-    //update the api handlers with our new memory
-    module_api.api_handlers = updated_api_handlers;
+
+    if(module_api.api_handlers[NetworkingApiType] == &subscribe_handler) {
+        //already registered by an earlier subscription
+        return PORT_SUCCESS;
+    }
+    //You can't do this if a networking handler is already registered
+    if(module_api.api_handlers[NetworkingApiType] != NULL) {
+        return PORT_EINVAL;
+    }
+
+    module_api.api_handlers[NetworkingApiType] = &subscribe_handler;
     return PORT_SUCCESS;
 }
 
+int signpost_networking_subscribe_topic(const char* filter, signpost_networking_subscribe_cb_t cb) {
+    if(filter == NULL || cb == NULL) {
+        return PORT_EINVAL;
+    }
+
+    //'#' is only allowed as the last level. Checked up front so a bad
+    //filter leaves the trie untouched
+    for(const char* level = filter; level != NULL; ) {
+        const char* end = strchr(level, '/');
+        if(level[0] == '#' && end == level + 1) {
+            return PORT_EINVAL;
+        }
+        level = (end == NULL) ? NULL : end + 1;
+    }
+
+    int rc = signpost_networking_register_handler();
+    if(rc < PORT_SUCCESS) {
+        return rc;
+    }
+
+    //the trie points into the filter, so keep our own copy of it
+    size_t flen = strlen(filter);
+    char* saved = signpost_malloc(flen + 1);
+    subscription_t* sub = signpost_malloc(sizeof(subscription_t));
+    if(saved == NULL || sub == NULL) {
+        signpost_free(saved);
+        signpost_free(sub);
+        return PORT_ENOMEM;
+    }
+    memcpy(saved, filter, flen + 1);
+
+    //nodes added for this filter point into saved. They form one chain
+    //hanging off the head of the first one's parent, so they can be taken
+    //out again if we run out of memory part way
+    topic_node_t* added = NULL;
+    topic_node_t* added_parent = NULL;
+
+    topic_node_t* node = &topic_root;
+    const char* level = saved;
+    while(level != NULL) {
+        const char* end = strchr(level, '/');
+        size_t len = (end == NULL) ? strlen(level) : (size_t)(end - level);
+
+        topic_node_t* parent = node;
+        node = topic_node_child(parent, level, len, true);
+        if(node == NULL) {
+            if(added != NULL) {
+                added_parent->child = added->sibling;
+                while(added != NULL) {
+                    topic_node_t* next = added->child;
+                    signpost_free(added);
+                    added = next;
+                }
+            }
+            signpost_free(saved);
+            signpost_free(sub);
+            return PORT_ENOMEM;
+        }
+        if(added == NULL && node->level == level) {
+            added = node;
+            added_parent = parent;
+        }
+        level = (end == NULL) ? NULL : end + 1;
+    }
+
+    if(added == NULL) {
+        //every level was already in the trie, nothing points into our copy
+        signpost_free(saved);
+    }
+
+    sub->cb = cb;
+    sub->next = node->subscribers;
+    node->subscribers = sub;
+    return PORT_SUCCESS;
+}
+
+int signpost_networking_subscribe(signpost_networking_subscribe_cb_t cb) {
+    return signpost_networking_subscribe_topic("#", cb);
+}
+
 int signpost_networking_publish_reply(uint8_t src_addr, int return_code) {
 
     return signpost_api_send(src_addr, ResponseFrame, NetworkingApiType,
@@ -1144,10 +2214,17 @@ int signpost_networking_publish_reply(uint8_t src_addr, int return_code) {
 
 }
 
+int signpost_networking_publish_batch_reply(uint8_t src_addr, int return_code) {
+
+    return signpost_api_send(src_addr, ResponseFrame, NetworkingApiType,
+                         NetworkingPublishBatchMessage, 4, (uint8_t*)(&return_code));
+
+}
+
 int signpost_networking_subscribe_send(uint8_t dest_addr, char* topic, uint8_t* data, uint8_t data_len) {
 
     uint8_t tlen = strnlen(topic, 28);
-    uint8_t* buf = malloc(tlen + data_len + 2);
+    uint8_t* buf = signpost_malloc(tlen + data_len + 2);
     if(!buf) {
         return PORT_ENOMEM;
     }
@@ -1160,7 +2237,7 @@ int signpost_networking_subscribe_send(uint8_t dest_addr, char* topic, uint8_t*
     int rc = signpost_api_send(dest_addr, NotificationFrame, NetworkingApiType,
                          NetworkingSubscribeMessage, 2+tlen+data_len, buf);
 
-    free(buf);
+    signpost_free(buf);
 
     return rc;
 }
@@ -1205,7 +2282,7 @@ int signpost_energy_query(signpost_energy_information_t* energy) {
         }
     }
 
-    int ret = port_signpost_wait_for_with_timeout(&energy_query_ready, 10000);
+    int ret = signpost_api_wait_for_reply(&energy_query_ready, 10000);
     if(ret < 0) {
         incoming_active_callback = NULL;
         return PORT_FAIL;
@@ -1267,6 +2344,91 @@ int signpost_energy_query_async(
     return PORT_SUCCESS;
 }
 
+static signpost_energy_notify_cb_t energy_notify_cb = NULL;
+static signpost_energy_information_t energy_notify_info;
+static bool energy_subscribe_ready;
+static int energy_subscribe_result;
+
+static void energy_notify_handler(uint8_t source_address,
+        signbus_frame_type_t frame_type, signbus_api_type_t api_type,
+        uint8_t message_type, size_t message_length, uint8_t* message) {
+
+    if (frame_type == CommandFrame) {
+        // energy commands are for the controller, not us
+        signpost_api_error_reply(source_address, api_type, message_type, PORT_ENOSUPPORT);
+        return;
+    }
+    if (frame_type != NotificationFrame || message_type != EnergyNotifyMessage) {
+        return;
+    }
+    if (message_length != sizeof(signpost_energy_information_t)) {
+        port_printf("%s:%d - Error: bad len, got %d, want %d\n",
+                __FILE__, __LINE__, message_length, sizeof(signpost_energy_information_t));
+        return;
+    }
+
+    memcpy(&energy_notify_info, message, message_length);
+    if (energy_notify_cb != NULL) {
+        energy_notify_cb(&energy_notify_info);
+    }
+}
+
+static void energy_subscribe_callback(int len_or_rc) {
+    if (len_or_rc < PORT_SUCCESS) {
+        energy_subscribe_result = len_or_rc;
+    } else if (len_or_rc != sizeof(signpost_energy_information_t)) {
+        port_printf("%s:%d - Error: bad len, got %d, want %d\n",
+                __FILE__, __LINE__, len_or_rc, sizeof(signpost_energy_information_t));
+        energy_subscribe_result = PORT_FAIL;
+    } else {
+        memcpy(&energy_notify_info, incoming_message, len_or_rc);
+        energy_subscribe_result = PORT_SUCCESS;
+    }
+    energy_subscribe_ready = true;
+}
+
+int signpost_energy_subscribe(uint32_t period_s, signpost_energy_notify_cb_t cb) {
+    static api_handler_t energy_handler = {EnergyApiType, energy_notify_handler};
+
+    if (cb == NULL) {
+        return PORT_EINVAL;
+    }
+    //You can't do this if an energy handler is already registered
+    if (module_api.api_handlers[EnergyApiType] != NULL &&
+            module_api.api_handlers[EnergyApiType] != &energy_handler) {
+        return PORT_EINVAL;
+    }
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+
+    module_api.api_handlers[EnergyApiType] = &energy_handler;
+    energy_notify_cb = cb;
+
+    incoming_active_callback = energy_subscribe_callback;
+    energy_subscribe_ready = false;
+    int rc = signpost_api_send(ModuleAddressController,
+            CommandFrame, EnergyApiType, EnergySubscribeMessage,
+            sizeof(uint32_t), (uint8_t*)&period_s);
+    if (rc < 0) {
+        incoming_active_callback = NULL;
+        return rc;
+    }
+
+    rc = signpost_api_wait_for_reply(&energy_subscribe_ready, 10000);
+    if (rc < 0) {
+        incoming_active_callback = NULL;
+        return PORT_FAIL;
+    }
+    if (energy_subscribe_result < 0) {
+        return energy_subscribe_result;
+    }
+
+    // hand over the current state so the module starts from it
+    cb(&energy_notify_info);
+    return PORT_SUCCESS;
+}
+
 int signpost_energy_duty_cycle(uint32_t time_ms) {
     return signpost_api_send(ModuleAddressController,
             NotificationFrame, EnergyApiType, EnergyDutyCycleMessage,
@@ -1278,7 +2440,7 @@ int signpost_energy_report(signpost_energy_report_t* report) {
     // should make a message buffer and pack the reports into it.
     uint8_t reports_size = report->num_reports*sizeof(signpost_energy_report_module_t);
     uint8_t report_buf_size = reports_size + 1;
-    uint8_t* report_buf = malloc(report_buf_size);
+    uint8_t* report_buf = signpost_malloc(report_buf_size);
     if(!report_buf) {
         return PORT_ENOMEM;
     }
@@ -1290,12 +2452,12 @@ int signpost_energy_report(signpost_energy_report_t* report) {
     rc = signpost_api_send(ModuleAddressController,
             CommandFrame, EnergyApiType, EnergyReportModuleConsumptionMessage,
             report_buf_size, report_buf);
-    free(report_buf);
+    signpost_free(report_buf);
     if (rc < 0) return rc;
 
     incoming_active_callback = signpost_energy_report_callback;
     energy_report_received = false;
-    rc = port_signpost_wait_for_with_timeout(&energy_report_received,10000);
+    rc = signpost_api_wait_for_reply(&energy_report_received, 10000);
     if(rc < 0) {
         incoming_active_callback = NULL;
         return PORT_FAIL;
@@ -1321,7 +2483,7 @@ int signpost_energy_reset(void) {
 
     incoming_active_callback = signpost_energy_reset_callback;
     energy_reset_received = false;
-    rc = port_signpost_wait_for_with_timeout(&energy_reset_received,10000);
+    rc = signpost_api_wait_for_reply(&energy_reset_received, 10000);
     if(rc < 0) {
         incoming_active_callback = NULL;
         return PORT_FAIL;
@@ -1358,15 +2520,31 @@ int signpost_energy_reset_reply(uint8_t destination_address, int return_code) {
             sizeof(int), (uint8_t*)&return_code);
 }
 
+int signpost_energy_subscribe_reply(uint8_t destination_address,
+        signpost_energy_information_t* info) {
+    return signpost_api_send(destination_address,
+            ResponseFrame, EnergyApiType, EnergySubscribeMessage,
+            sizeof(signpost_energy_information_t), (uint8_t*) info);
+}
+
+int signpost_energy_notify(uint8_t destination_address,
+        signpost_energy_information_t* info) {
+    return signpost_api_send(destination_address,
+            NotificationFrame, EnergyApiType, EnergyNotifyMessage,
+            sizeof(signpost_energy_information_t), (uint8_t*) info);
+}
+
 /**************************************************************************/
 /* TIME & LOCATION API                                                    */
 /**************************************************************************/
 
 static bool timelocation_query_answered;
 static int  timelocation_query_result;
+static uint32_t timelocation_reply_tick;
 
 // Callback when a response is received
 static void timelocation_callback(int result) {
+    timelocation_reply_tick = port_signpost_timer_read();
     timelocation_query_answered = true;
     timelocation_query_result = result;
 }
@@ -1394,7 +2572,7 @@ static int signpost_timelocation_sync(signpost_timelocation_message_type_e messa
     }
 
     // Wait for a response message to come back
-    rc = port_signpost_wait_for_with_timeout(&timelocation_query_answered, 1000);
+    rc = signpost_api_wait_for_reply(&timelocation_query_answered, 1000);
     if (rc < 0)  {
         incoming_active_callback = NULL;
         return rc;
@@ -1412,15 +2590,23 @@ static int signpost_timelocation_sync(signpost_timelocation_message_type_e messa
     return timelocation_query_result;
 }
 
-int signpost_timelocation_get_time(time_t* time) {
-    // Check the argument, because why not.
-    if (time == NULL) {
-        return PORT_EINVAL;
-    }
+static time_t signpost_timelocation_to_time(const signpost_timelocation_time_t* temp) {
+    //convert that struct into a tm struct
+    struct tm current_time;
+    current_time.tm_year = temp->year - 1900;
+    current_time.tm_mon = temp->month - 1;
+    current_time.tm_mday = temp->day;
+    current_time.tm_hour = temp->hours;
+    current_time.tm_min = temp->minutes;
+    current_time.tm_sec = temp->seconds;
+    current_time.tm_isdst = 0;
 
-    int rc = signpost_timelocation_sync(TimeLocationGetTimeMessage);
-    if (rc < 0) return rc;
+    //convert it into a time_t object
+    return mktime(&current_time);
+}
 
+// Convert a time message from the controller to a unix time
+static int signpost_timelocation_message_to_time(time_t* time, int* satellites) {
     // Do our due diligence
     if (incoming_message_length != sizeof(signpost_timelocation_time_t)) {
         SIGNBUS_DEBUG("Time message wrong length. Expected: %d, got %d\n",
@@ -1432,26 +2618,189 @@ int signpost_timelocation_get_time(time_t* time) {
     signpost_timelocation_time_t temp;
     memcpy(&temp, incoming_message, incoming_message_length);
 
-    //convert that struct into a tm struct
-    struct tm current_time;
-    current_time.tm_year = temp.year - 1900;
-    current_time.tm_mon = temp.month - 1;
-    current_time.tm_mday = temp.day;
-    current_time.tm_hour = temp.hours;
-    current_time.tm_min = temp.minutes;
-    current_time.tm_sec = temp.seconds;
-    current_time.tm_isdst = 0;
+    *time = signpost_timelocation_to_time(&temp);
+    *satellites = temp.satellite_count;
 
-    //convert it into a time_t object
-    time_t utime = mktime(&current_time);
+    return PORT_SUCCESS;
+}
+
+/**************************************/
+/* Local Clock                        */
+/**************************************/
+
+// The local clock is anchored to a PPS edge whose time came from the
+// controller, and extrapolated with the port timer. Each resync also
+// measures how fast the port timer really runs against PPS, which corrects
+// for crystal drift between syncs.
+static struct {
+    bool     synced;
+    time_t   anchor_time;        // UTC second at the anchor PPS edge
+    uint32_t anchor_tick;        // port timer at the anchor PPS edge
+    uint64_t ticks_per_s_q16;    // measured timer rate, 16.16 fixed point
+    int      satellite_count;
+    bool     sync_failed;
+    uint32_t failed_tick;        // port timer when the last sync failed
+} local_clock;
+
+// Split a number of port timer ticks into seconds and microseconds using
+// the measured timer rate
+static void signpost_timelocation_clock_elapsed(uint32_t ticks, uint32_t* secs, uint32_t* usec) {
+    uint64_t ticks_q16 = (uint64_t)ticks << 16;
+    uint64_t s = ticks_q16 / local_clock.ticks_per_s_q16;
+    uint64_t rem_q16 = ticks_q16 - s * local_clock.ticks_per_s_q16;
+    *secs = (uint32_t)s;
+    *usec = (uint32_t)((rem_q16 * 1000000) / local_clock.ticks_per_s_q16);
+}
+
+static bool     pps_edge_seen;
+static uint32_t pps_edge_tick;
+
+static void signpost_timelocation_pps_callback(int unused __attribute__ ((unused))) {
+    // stamp the edge before anything else can delay us
+    pps_edge_tick = port_signpost_timer_read();
+    pps_edge_seen = true;
+    signpost_reactor_wake();
+}
+
+// Wait for the next rising PPS edge through the reactor, so other events
+// are still served while we wait
+static int signpost_timelocation_wait_for_pps_edge(uint32_t* edge_tick) {
+    pps_edge_seen = false;
+    int rc = port_signpost_pps_enable_interrupt_rising(signpost_timelocation_pps_callback);
+    if (rc < 0) return rc;
+    rc = signpost_reactor_wait_for(&pps_edge_seen, SIGNPOST_CLOCK_PPS_TIMEOUT_MS);
+    port_signpost_pps_disable_interrupt();
+    if (rc < 0) return rc;
+
+    *edge_tick = pps_edge_tick;
+    return PORT_SUCCESS;
+}
+
+int signpost_timelocation_clock_sync(void) {
+    int rc = signpost_timelocation_sync(TimeLocationGetTimeNextPpsMessage);
+    if (rc < 0) return rc;
+
+    if (incoming_message_length != sizeof(signpost_timelocation_pps_time_t)) {
+        SIGNBUS_DEBUG("PPS time message wrong length. Expected: %d, got %d\n",
+            sizeof(signpost_timelocation_pps_time_t), incoming_message_length);
+        return PORT_FAIL;
+    }
+    signpost_timelocation_pps_time_t pps_time;
+    memcpy(&pps_time, incoming_message, sizeof(pps_time));
+    uint32_t reply_tick = timelocation_reply_tick;
+
+    int satellites = pps_time.time.satellite_count;
+    if (satellites < 3) return PORT_ENOSAT;
+
+    uint32_t edge_tick;
+    rc = signpost_timelocation_wait_for_pps_edge(&edge_tick);
+    if (rc < 0) return rc;
+
+    // The fix arrived at the controller after the edge it names and before
+    // the one after, so each whole second from the fix to our edge is one
+    // more edge. A fix too close to an edge could belong to either side of
+    // it once transfer delays are counted, so that sync is refused.
+    uint64_t fix_to_edge_ms = pps_time.ms_since_fix +
+        ((uint64_t)(uint32_t)(edge_tick - reply_tick) * 1000) / port_signpost_timer_frequency();
+    uint32_t into_second = fix_to_edge_ms % 1000;
+    if (into_second < SIGNPOST_CLOCK_PPS_GUARD_MS || into_second > 1000 - SIGNPOST_CLOCK_PPS_GUARD_MS) {
+        SIGNBUS_DEBUG("PPS fix %lu ms from an edge, cannot tell which\n", (unsigned long)into_second);
+        return PORT_FAIL;
+    }
+    time_t next_pps_time = signpost_timelocation_to_time(&pps_time.time) + fix_to_edge_ms / 1000 + 1;
+
+    uint64_t nominal_q16 = (uint64_t)port_signpost_timer_frequency() << 16;
+    if (local_clock.synced && next_pps_time > local_clock.anchor_time) {
+        // measure the timer rate over the interval since the last anchor
+        uint64_t seconds = next_pps_time - local_clock.anchor_time;
+        uint64_t ticks = (uint32_t)(edge_tick - local_clock.anchor_tick);
+        uint64_t measured_q16 = (ticks << 16) / seconds;
+
+        // a wild measurement means a missed edge or bad time, not drift
+        uint64_t limit = nominal_q16 / 1000;
+        if (measured_q16 + limit > nominal_q16 && measured_q16 < nominal_q16 + limit) {
+            local_clock.ticks_per_s_q16 = measured_q16;
+        }
+    } else {
+        local_clock.ticks_per_s_q16 = nominal_q16;
+    }
+
+    local_clock.anchor_time = next_pps_time;
+    local_clock.anchor_tick = edge_tick;
+    local_clock.satellite_count = satellites;
+    local_clock.synced = true;
+
+    return satellites;
+}
+
+int signpost_timelocation_get_time_us(time_t* time, uint32_t* usec) {
+    // Check the argument, because why not.
+    if (time == NULL) {
+        return PORT_EINVAL;
+    }
+
+    uint32_t now = port_signpost_timer_read();
+    uint32_t secs = 0;
+    uint32_t us = 0;
+    if (local_clock.synced) {
+        signpost_timelocation_clock_elapsed(now - local_clock.anchor_tick, &secs, &us);
+    }
+
+    // Resync when stale, and well before the timer can wrap
+    if (!local_clock.synced || secs >= SIGNPOST_CLOCK_RESYNC_S ||
+            now - local_clock.anchor_tick > UINT32_MAX / 2) {
+        // don't keep paying for a failing sync on every call
+        uint32_t retry_ticks = port_signpost_timer_frequency() * SIGNPOST_CLOCK_RETRY_S;
+        if (local_clock.sync_failed && now - local_clock.failed_tick < retry_ticks) {
+            return PORT_FAIL;
+        }
+
+        int rc = signpost_timelocation_clock_sync();
+        if (rc < 0) {
+            local_clock.synced = false;
+            local_clock.sync_failed = true;
+            local_clock.failed_tick = now;
+            return rc;
+        }
+        local_clock.sync_failed = false;
+        signpost_timelocation_clock_elapsed(port_signpost_timer_read() - local_clock.anchor_tick, &secs, &us);
+    }
+
+    *time = local_clock.anchor_time + secs;
+    if (usec != NULL) {
+        *usec = us;
+    }
+
+    return local_clock.satellite_count;
+}
+
+int signpost_timelocation_get_time(time_t* time) {
+    // Check the argument, because why not.
+    if (time == NULL) {
+        return PORT_EINVAL;
+    }
+
+    // Answer locally if we can keep a PPS-disciplined clock
+    int rc = signpost_timelocation_get_time_us(time, NULL);
+    if (rc >= 0) return rc;
+
+    // Otherwise (no fix yet, or no PPS on this module) fall back to asking
+    // the controller for the time of its last fix
+    rc = signpost_timelocation_sync(TimeLocationGetTimeMessage);
+    if (rc < 0) return rc;
+
+    time_t utime;
+    int satellites;
+    rc = signpost_timelocation_message_to_time(&utime, &satellites);
+    if (rc < 0) return rc;
 
     //place it back in the starting array
     memcpy(time,&utime,sizeof(time_t));
 
-    if(temp.satellite_count < 3) {
+    if(satellites < 3) {
         return PORT_ENOSAT;
     } else {
-        return temp.satellite_count;
+        return satellites;
     }
 }
 
@@ -1483,6 +2832,13 @@ int signpost_timelocation_get_time_reply(uint8_t destination_address,
             sizeof(signpost_timelocation_time_t), (uint8_t*) time);
 }
 
+int signpost_timelocation_get_time_next_pps_reply(uint8_t destination_address,
+        signpost_timelocation_pps_time_t* pps_time) {
+    return signpost_api_send(destination_address,
+            ResponseFrame, TimeLocationApiType, TimeLocationGetTimeNextPpsMessage,
+            sizeof(signpost_timelocation_pps_time_t), (uint8_t*) pps_time);
+}
+
 int signpost_timelocation_get_location_reply(uint8_t destination_address,
         signpost_timelocation_location_t* location) {
     return signpost_api_send(destination_address,
@@ -1510,7 +2866,7 @@ int signpost_watchdog_start(void) {
 
     incoming_active_callback = signpost_watchdog_cb;
 
-    port_signpost_wait_for(&watchdog_reply);
+    signpost_api_wait_for_reply(&watchdog_reply, 0);
 
     return 1;
 }
@@ -1526,7 +2882,7 @@ int signpost_watchdog_tickle(void) {
 
     incoming_active_callback = signpost_watchdog_cb;
 
-    port_signpost_wait_for(&watchdog_reply);
+    signpost_api_wait_for_reply(&watchdog_reply, 0);
 
     return 1;
 }
@@ -1538,6 +2894,79 @@ int signpost_watchdog_reply(uint8_t destination_address) {
     return rc;
 }
 
+/**************************************************************************/
+/* DEBUG API                                                              */
+/**************************************************************************/
+static bool debug_ready;
+static int debug_result;
+static signpost_memstats_t* debug_memstats;
+
+static void debug_api_callback(uint8_t source_address,
+        signbus_frame_type_t frame_type, signbus_api_type_t api_type,
+        uint8_t message_type, __attribute__ ((unused)) size_t message_length,
+        __attribute__ ((unused)) uint8_t* message) {
+    if (frame_type != CommandFrame) {
+        port_printf("Warn: Unexpected debug frame type %d. Dropping\n", frame_type);
+        return;
+    }
+
+    int rc;
+    if (message_type == DebugMemstatsMessage) {
+        rc = signpost_debug_memstats_reply(source_address);
+    } else {
+        rc = signpost_api_error_reply(source_address, api_type, message_type, PORT_ENOSUPPORT);
+    }
+    if (rc < 0) {
+        port_printf(" - %d: Error sending debug reply (code: %d)\n", __LINE__, rc);
+    }
+}
+
+static api_handler_t debug_handler = {DebugApiType, debug_api_callback};
+
+static void debug_memstats_callback(int len_or_rc) {
+    if (len_or_rc < PORT_SUCCESS) {
+        debug_result = len_or_rc;
+    } else if (len_or_rc != sizeof(signpost_memstats_t)) {
+        port_printf("%s:%d - Error: bad len, got %d, want %d\n",
+                __FILE__, __LINE__, len_or_rc, sizeof(signpost_memstats_t));
+        debug_result = PORT_FAIL;
+    } else {
+        memcpy(debug_memstats, incoming_message, len_or_rc);
+        debug_result = PORT_SUCCESS;
+    }
+    debug_ready = true;
+}
+
+int signpost_debug_memstats_query(uint8_t address, signpost_memstats_t* stats) {
+    if (incoming_active_callback != NULL) {
+        return PORT_EBUSY;
+    }
+
+    debug_memstats = stats;
+    incoming_active_callback = debug_memstats_callback;
+    debug_ready = false;
+    int rc = signpost_api_send(address, CommandFrame, DebugApiType,
+            DebugMemstatsMessage, 0, NULL);
+    if (rc < 0) {
+        incoming_active_callback = NULL;
+        return rc;
+    }
+
+    rc = signpost_api_wait_for_reply(&debug_ready, 1000);
+    if (rc < 0) {
+        incoming_active_callback = NULL;
+        return PORT_FAIL;
+    }
+    return debug_result;
+}
+
+int signpost_debug_memstats_reply(uint8_t destination_address) {
+    signpost_memstats_t stats;
+    signpost_memstats_get(&stats);
+    return signpost_api_send(destination_address, ResponseFrame, DebugApiType,
+            DebugMemstatsMessage, sizeof(signpost_memstats_t), (uint8_t*)&stats);
+}
+
 /**************************************************************************/
 /* EDISON API                                                             */
 /**************************************************************************/
@@ -10,6 +10,7 @@ extern "C" {
 #include <stdint.h>
 #include "signbus_app_layer.h"
 #include "signbus_protocol_layer.h"
+#include "signpost_memstats.h"
 
 typedef void (*signpost_api_callback_t)(uint8_t source_address,
         signbus_frame_type_t frame_type, signbus_api_type_t api_type, uint8_t message_type,
@@ -61,6 +62,33 @@ int signpost_api_module_name_to_mod_num(char* name);
 //
 int signpost_api_revoke_key(uint8_t module_number);
 
+// Reply timeouts
+//
+// Blocking calls wait for their reply for a timeout derived from the round
+// trip times seen for the same operation (peer, api and message type),
+// SRTT + 4 * RTTVAR as in TCP, clamped to SIGNPOST_API_TIMEOUT_MIN_MS and
+// SIGNPOST_API_TIMEOUT_MAX_MS. Each call's own fixed default is only used
+// until the operation has been answered once. A timeout doubles the estimate
+// until the operation is answered again.
+#ifndef SIGNPOST_API_TIMEOUT_MIN_MS
+#define SIGNPOST_API_TIMEOUT_MIN_MS 50
+#endif
+#ifndef SIGNPOST_API_TIMEOUT_MAX_MS
+#define SIGNPOST_API_TIMEOUT_MAX_MS 30000
+#endif
+#define SIGNPOST_API_RTT_PEERS 16
+
+// Use timeout_ms for the next blocking call instead of the estimate.
+// 0 clears a pending override.
+void signpost_api_set_next_timeout(uint32_t timeout_ms);
+
+// Get the current estimate for an operation on a peer
+//
+// returns PORT_SUCCESS, or PORT_FAIL if no reply to that operation has been
+// timed from address
+int signpost_api_get_rtt(uint8_t address, signbus_api_type_t api_type, uint8_t message_type,
+        uint32_t* srtt_ms, uint32_t* rttvar_ms, uint32_t* timeout_ms);
+
 
 /**************************************************************************/
 /* INITIALIZATION API                                                     */
@@ -145,13 +173,32 @@ int signpost_initialization_request_isolation(void);
 //  module_address: i2c address of module to initialize with
 int signpost_initialization_initialize_with_module(uint8_t module_address);
 
-// Send a exchange request to another module
-// Assumes controller has already isolated source and target
+// Send a exchange request to another module and wait for its reply. On
+// success the shared key is stored and later messages to that module are
+// encrypted. Returns PORT_ENOACK if no reply arrived, in which case the
+// exchange should be retried so the other side drops any key it kept, and
+// PORT_ENOSUPPORT if the other side refused it.
 //
 // params:
 //  destination_address - The I2C address of the module to exchange keys with
-//__attribute__((warn_unused_result))
-//int signpost_initialization_key_exchange_send(uint8_t destination_address);
+__attribute__((warn_unused_result))
+int signpost_initialization_key_exchange_send(uint8_t destination_address);
+
+// Exchange keys with the controller as part of initialization. The exchange
+// runs after the module has released isolation, so several modules can be
+// exchanging keys while the controller isolates the next one. A failed
+// exchange is retried with a doubling delay; after SIGNPOST_KEY_EXCHANGE_TRIES
+// failures initialization finishes without a key and traffic to the
+// controller stays unencrypted. Off by default; call before signpost_init or
+// signpost_initialization_module_init.
+//
+// params:
+//  enable - Whether to exchange keys after declaring
+void signpost_initialization_enable_key_exchange(bool enable);
+
+#ifndef SIGNPOST_KEY_EXCHANGE_TRIES
+#define SIGNPOST_KEY_EXCHANGE_TRIES 8
+#endif
 
 // Send a response to a registration request if module key already stored
 //
@@ -194,11 +241,30 @@ int signpost_initialization_get_module_state_reply(uint8_t address);
 
 #define STORAGE_LOG_LEN 32
 
+// How long to wait for the storage master to acknowledge a write, and how
+// many times to send it before giving up. A write is also resent when the
+// storage master replies with an error other than for a malformed request.
+// Retries carry the same token, so the storage master appends the data at
+// most once.
+#ifndef SIGNPOST_STORAGE_WRITE_TIMEOUT_MS
+#define SIGNPOST_STORAGE_WRITE_TIMEOUT_MS 1000
+#endif
+#ifndef SIGNPOST_STORAGE_WRITE_TRIES
+#define SIGNPOST_STORAGE_WRITE_TRIES 3
+#endif
+
 enum storage_message_type {
    StorageWriteMessage = 0,
    StorageReadMessage= 1,
    StorageDeleteMessage= 2,
    StorageScanMessage= 3,
+   StorageWriteBatchMessage= 4,
+   StorageFlushMessage= 5,
+   StorageWriteTimedMessage= 6,
+   StorageQueryRangeMessage= 7,
+   StorageAggregateMessage= 8,
+   StorageCircularMessage= 9,
+   StorageScanPageMessage= 10,
 };
 
 typedef struct {
@@ -207,16 +273,123 @@ typedef struct {
   size_t length;
 } Storage_Record_t;
 
-// Write data to the Storage Master
+// Most records in one batched write, and most bytes in its message
+#define SIGNPOST_STORAGE_BATCH_MAX 16
+#define SIGNPOST_STORAGE_BATCH_MAX_LEN 960
+
+// Most records returned by one scan request. Longer listings are made of
+// several requests.
+#define SIGNPOST_STORAGE_SCAN_PAGE 8
+
+// Most bytes returned by one read request. Larger reads are made of
+// several requests.
+#define SIGNPOST_STORAGE_READ_CHUNK 512
+
+// Position in a read that is consumed a chunk at a time
+typedef struct {
+  char logname[STORAGE_LOG_LEN+1];
+  size_t offset;      // next byte to read
+  size_t remaining;   // bytes left in the range
+} Storage_Read_Cursor_t;
+
+typedef struct {
+  char prefix[STORAGE_LOG_LEN+1];   // only list names starting with this
+  char after[STORAGE_LOG_LEN+1];    // last name listed
+  bool done;
+} Storage_Scan_Cursor_t;
+
+// When an acknowledged write reaches the SD card
+typedef enum {
+  // synced within STORAGE_SYNC_PERIOD_MS, together with other pending writes
+  StorageDurabilityGroup = 0,
+  // synced before the write is acknowledged
+  StorageDurabilityImmediate = 1,
+  // synced whenever the storage master next has reason to, for logs that
+  // can lose some recent data
+  StorageDurabilityLazy = 2,
+} signpost_storage_durability_e;
+
+// Type of the field an aggregate is computed over, stored little endian
+typedef enum {
+  StorageFieldU8 = 0,
+  StorageFieldI8 = 1,
+  StorageFieldU16 = 2,
+  StorageFieldI16 = 3,
+  StorageFieldU32 = 4,
+  StorageFieldI32 = 5,
+} signpost_storage_field_type_e;
+
+#define SIGNPOST_STORAGE_HISTOGRAM_BINS 16
+
+// Describes the records in a range and the field to aggregate
+typedef struct __attribute__((packed)) {
+  uint16_t record_len;      // length of each record, 0 for a timed log
+  uint16_t field_offset;    // offset of the field in a record's data
+  uint8_t  field_type;      // signpost_storage_field_type_e
+  uint8_t  histogram_bins;  // 0 for no histogram
+  int32_t  histogram_min;   // values below go in the first bin
+  int32_t  histogram_max;   // values at or above go in the last bin
+} signpost_storage_aggregate_query_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t count;
+  int64_t  sum;             // mean is sum / count
+  int64_t  min;
+  int64_t  max;
+  uint32_t histogram[SIGNPOST_STORAGE_HISTOGRAM_BINS];
+} signpost_storage_aggregate_t;
+
+#ifdef __cplusplus
+static_assert(sizeof(signpost_storage_aggregate_query_t) == 14, "On-wire structure size");
+static_assert(sizeof(signpost_storage_aggregate_t) == 92, "On-wire structure size");
+#else
+_Static_assert(sizeof(signpost_storage_aggregate_query_t) == 14, "On-wire structure size");
+_Static_assert(sizeof(signpost_storage_aggregate_t) == 92, "On-wire structure size");
+#endif
+
+// Records in a timed log are [timestamp][length][data], with a 32 bit
+// timestamp and 16 bit length
+#define SIGNPOST_STORAGE_TIMED_HEADER_LEN 6
+
+// One record of a batched write
+typedef struct {
+  uint8_t* data;
+  size_t len;
+  Storage_Record_t* record;   // logname to write to, filled in like a write
+} Storage_Write_t;
+
+// List the logs on the Storage Master, in name order. Each record names a
+// log, with its length in bytes.
 //
 // params:
 //  record_list     - List of records to fill
-//  list_len        - Actual number of records filled
-//  max_list_len    - Maximum number of records to accept
+//  list_len        - Maximum number of records to accept, set to the number
+//                    filled
 __attribute__((warn_unused_result))
 int signpost_storage_scan (Storage_Record_t* record_list, size_t* list_len);
 
-// Write data to the Storage Master
+// Start listing the logs on the Storage Master a page at a time
+//
+// params:
+//  cursor          - Cursor to set up
+//  prefix          - Only list logs whose names start with this, NULL for all
+void signpost_storage_scan_open (Storage_Scan_Cursor_t* cursor, const char* prefix);
+
+// List the next page of logs into list and advance the cursor. Logs created
+// or deleted between pages may or may not be listed.
+//
+// params:
+//  cursor          - Cursor from signpost_storage_scan_open
+//  list            - Records to fill
+//  max_len         - Length of list, at most SIGNPOST_STORAGE_SCAN_PAGE is used
+//
+// returns the number of records filled, 0 once every log is listed, or < 0
+// on error
+__attribute__((warn_unused_result))
+int signpost_storage_scan_next (Storage_Scan_Cursor_t* cursor, Storage_Record_t* list, size_t max_len);
+
+// Write data to the Storage Master. Waits for the write to be acknowledged,
+// resending it if needed, and fills in where the data was written.
 //
 // params:
 //  data            - Data to write
@@ -225,15 +398,108 @@ int signpost_storage_scan (Storage_Record_t* record_list, size_t* list_len);
 __attribute__((warn_unused_result))
 int signpost_storage_write (uint8_t* data, size_t len, Storage_Record_t* record_pointer);
 
+// Write data to the Storage Master like signpost_storage_write, choosing
+// when it must reach the SD card. signpost_storage_write is a group commit
+// write.
+//
+// params:
+//  data            - Data to write
+//  len             - Length of data
+//  record_pointer  - Pointer to record that will indicate location of written data
+//  durability      - When the write must be synced, see signpost_storage_durability_e
+__attribute__((warn_unused_result))
+int signpost_storage_write_durable (uint8_t* data, size_t len, Storage_Record_t* record_pointer,
+        signpost_storage_durability_e durability);
+
+// Write several records to the Storage Master in one message. The storage
+// master appends each log once, in the order its records are given, and
+// fills in every record like signpost_storage_write. Retried like a write,
+// and a resend only appends the logs the storage master had not reached.
+// Don't retry a failed batch yourself: it goes out under a new token, so
+// logs written before the failure are written again.
+//
+// params:
+//  writes          - Records to write, up to SIGNPOST_STORAGE_BATCH_MAX
+//  count           - Number of records
+__attribute__((warn_unused_result))
+int signpost_storage_write_batch (Storage_Write_t* writes, size_t count);
+
+// Write a timestamped record to a timed log. The Storage Master keeps a
+// sparse index of timed logs so they can be queried by time. Timestamps
+// should not go backwards within a log. Retried like a write.
+//
+// params:
+//  data            - Data to write
+//  len             - Length of data
+//  timestamp       - Unix time in seconds, e.g. from signpost_timelocation_get_time
+//  record_pointer  - Pointer to record that will indicate location of the whole record
+__attribute__((warn_unused_result))
+int signpost_storage_write_timed (uint8_t* data, size_t len, uint32_t timestamp, Storage_Record_t* record_pointer);
+
+// Find the records of a timed log stamped from start to end, inclusive
+//
+// params:
+//  record_pointer  - Record naming the log, filled in with the range found
+//  start           - First timestamp to include
+//  end             - Last timestamp to include
+__attribute__((warn_unused_result))
+int signpost_storage_query_range (Storage_Record_t* record_pointer, uint32_t start, uint32_t end);
+
+// Read the next record of a timed log, opened on a range from
+// signpost_storage_query_range
+//
+// params:
+//  cursor          - Cursor from signpost_storage_read_open
+//  timestamp       - Set to the record's timestamp
+//  data            - Pointer to buffer to read to
+//  max_len         - Length of data
+//
+// returns the length of the record, 0 at the end of the range, PORT_ESIZE if
+// the record did not fit in data (it is skipped), or < 0 on error
+__attribute__((warn_unused_result))
+int signpost_storage_read_timed (Storage_Read_Cursor_t* cursor, uint32_t* timestamp, uint8_t* data, size_t max_len);
+
+// Have the Storage Master aggregate one field over the records in a range,
+// so only the result crosses the bus. Long ranges take a while, so set a
+// longer timeout with signpost_api_set_next_timeout.
+//
+// params:
+//  record_pointer  - Range to aggregate, e.g. from signpost_storage_query_range
+//  query           - Layout of the records and the field to aggregate
+//  result          - Filled in with the aggregate
+__attribute__((warn_unused_result))
+int signpost_storage_aggregate (Storage_Record_t* record_pointer,
+        signpost_storage_aggregate_query_t* query, signpost_storage_aggregate_t* result);
+
 // Read data from the Storage Master
 //
 // params:
 //  data            - Pointer to buffer to read to
-//  len             - Length of data to read
+//  len             - Length of data to read, set to the length read
 //  record_pointer  - Record that will indicate location of stored data
 __attribute__((warn_unused_result))
 int signpost_storage_read (uint8_t* data, size_t *len, Storage_Record_t* record_pointer);
 
+// Start reading the range a record describes, from its offset for its
+// length
+//
+// params:
+//  cursor          - Cursor to set up
+//  record_pointer  - Record that will indicate location of stored data
+void signpost_storage_read_open (Storage_Read_Cursor_t* cursor, Storage_Record_t* record_pointer);
+
+// Read the next chunk of a range into data and advance the cursor
+//
+// params:
+//  cursor          - Cursor from signpost_storage_read_open
+//  data            - Pointer to buffer to read to
+//  max_len         - Length of data, at most SIGNPOST_STORAGE_READ_CHUNK is used
+//
+// returns the number of bytes read, 0 at the end of the range or log, or < 0
+// on error
+__attribute__((warn_unused_result))
+int signpost_storage_read_next (Storage_Read_Cursor_t* cursor, uint8_t* data, size_t max_len);
+
 // Delete log from the Storage Master
 //
 // params:
@@ -241,6 +507,30 @@ int signpost_storage_read (uint8_t* data, size_t *len, Storage_Record_t* record_
 __attribute__((warn_unused_result))
 int signpost_storage_delete (Storage_Record_t* record_pointer);
 
+// Make the Storage Master write a log through to the SD card. Acknowledged
+// writes are buffered briefly before they reach the card, this bounds what
+// a power loss can take.
+//
+// params:
+//  record_pointer  - Record naming the log to flush, NULL flushes every log
+__attribute__((warn_unused_result))
+int signpost_storage_flush (Storage_Record_t* record_pointer);
+
+// Make a log circular, so the Storage Master keeps only its newest max_size
+// bytes and overwrites the oldest as it is written. Space for the log is
+// allocated up front, so this must be called before anything is written to
+// it, and again with the same size after that is a no-op. Writes larger than
+// max_size fail, and timed writes are not supported on circular logs.
+//
+// Offsets stay valid until the data they point to is overwritten, after
+// which reading them fails.
+//
+// params:
+//  record_pointer  - Record naming the log, set to the range the log holds
+//  max_size        - Bytes of data to keep
+__attribute__((warn_unused_result))
+int signpost_storage_set_circular (Storage_Record_t* record_pointer, size_t max_size);
+
 // Storage master response to scan request
 //
 // params:
@@ -250,6 +540,16 @@ int signpost_storage_delete (Storage_Record_t* record_pointer);
 __attribute__((warn_unused_result))
 int signpost_storage_scan_reply(uint8_t destination_address, Storage_Record_t* list, size_t list_len);
 
+// Storage master response to scan page request
+//
+// params:
+//  destination_address - Address to reply to
+//  more                - Whether there are names past this page
+//  list                - Records listed
+//  list_len            - Number of records, at most SIGNPOST_STORAGE_SCAN_PAGE
+__attribute__((warn_unused_result))
+int signpost_storage_scan_page_reply(uint8_t destination_address, bool more, Storage_Record_t* list, size_t list_len);
+
 // Storage master response to write request
 //
 // params:
@@ -258,12 +558,21 @@ int signpost_storage_scan_reply(uint8_t destination_address, Storage_Record_t* l
 __attribute__((warn_unused_result))
 int signpost_storage_write_reply (uint8_t destination_address, Storage_Record_t* record_pointer);
 
+// Storage master response to batched write request
+//
+// params:
+//  destination_address - Address to reply to
+//  records             - Written records, in message order
+//  count               - Number of records
+__attribute__((warn_unused_result))
+int signpost_storage_write_batch_reply (uint8_t destination_address, Storage_Record_t* records, size_t count);
+
 // Storage master response to read request
 //
 // params:
 //  destination_address - Address to reply to
-//  data                - buffer to write read data
-//  length              - length of read data
+//  data                - Offset the data was read from followed by the data
+//  length              - length of offset and data
 __attribute__((warn_unused_result))
 int signpost_storage_read_reply (uint8_t destination_address, uint8_t* data, size_t length);
 
@@ -275,23 +584,86 @@ int signpost_storage_read_reply (uint8_t destination_address, uint8_t* data, siz
 __attribute__((warn_unused_result))
 int signpost_storage_delete_reply (uint8_t destination_address, Storage_Record_t* record_pointer);
 
+// Storage master response to flush request
+//
+// params:
+//  destination_address - Address to reply to
+//  record_pointer      - Flushed record
+__attribute__((warn_unused_result))
+int signpost_storage_flush_reply (uint8_t destination_address, Storage_Record_t* record_pointer);
+
+// Storage master response to circular request
+//
+// params:
+//  destination_address - Address to reply to
+//  record_pointer      - Range the log holds
+__attribute__((warn_unused_result))
+int signpost_storage_set_circular_reply (uint8_t destination_address, Storage_Record_t* record_pointer);
+
+// Storage master response to aggregate request
+//
+// params:
+//  destination_address - Address to reply to
+//  result              - Aggregate computed
+__attribute__((warn_unused_result))
+int signpost_storage_aggregate_reply (uint8_t destination_address, signpost_storage_aggregate_t* result);
+
 /**************************************************************************/
 /* NETWORKING API                                                         */
 /**************************************************************************/
 enum networking_message_type {
     NetworkingPublishMessage = 0,
     NetworkingSubscribeMessage,
+    NetworkingPublishBatchMessage,
 };
 
+// Publishes queued by signpost_networking_publish_batched are sent together
+// once the next one wouldn't fit in SIGNPOST_NETWORKING_BATCH_LEN bytes, or
+// once the oldest has waited SIGNPOST_NETWORKING_BATCH_DEADLINE_MS
+#ifndef SIGNPOST_NETWORKING_BATCH_LEN
+#define SIGNPOST_NETWORKING_BATCH_LEN 512
+#endif
+#ifndef SIGNPOST_NETWORKING_BATCH_DEADLINE_MS
+#define SIGNPOST_NETWORKING_BATCH_DEADLINE_MS 5000
+#endif
+
 typedef void (*signpost_networking_subscribe_cb_t)(char* topic, uint8_t* data, uint8_t data_len);
 
 //used by other modules
+
+// Publish and wait for the radio to confirm it queued the data
+// returns the radio's return code or a signpost error define.
 __attribute__((warn_unused_result))
 int signpost_networking_publish(const char* topic, uint8_t* data, uint8_t data_len);
+
+// Publish without waiting for the radio. Returns once the message is on the
+// bus, so a full radio queue is not reported.
+__attribute__((warn_unused_result))
+int signpost_networking_publish_notify(const char* topic, uint8_t* data, uint8_t data_len);
+
+// Add a publish to the local batch. The deadline is only checked when
+// publishing, so call signpost_networking_flush at the end of a burst.
+// returns PORT_SUCCESS, or the result of a flush if one was triggered.
+__attribute__((warn_unused_result))
+int signpost_networking_publish_batched(const char* topic, uint8_t* data, uint8_t data_len);
+
+// Send any batched publishes as one message and wait for the radio
+// returns the radio's return code or a signpost error define.
+__attribute__((warn_unused_result))
+int signpost_networking_flush(void);
+
+// Receive downlink messages whose topic matches filter. Filters are matched
+// level by level on '/', '+' matches any single level and a trailing '#'
+// matches any remaining levels. Several callbacks may match one message.
+// The topic passed to the callback is only valid during the callback.
+int signpost_networking_subscribe_topic(const char* filter, signpost_networking_subscribe_cb_t cb);
+
+// Receive every downlink message, same as subscribing to "#"
 int signpost_networking_subscribe(signpost_networking_subscribe_cb_t cb);
 
 //Used by the radio module
 int signpost_networking_publish_reply(uint8_t src_addr, int return_code);
+int signpost_networking_publish_batch_reply(uint8_t src_addr, int return_code);
 int signpost_networking_subscribe_send(uint8_t dest_addr, char* topic, uint8_t* data, uint8_t data_len);
 
 /**************************************************************************/
@@ -364,6 +736,8 @@ enum energy_message_type {
     EnergyResetMessage = 1,
     EnergyReportModuleConsumptionMessage = 2,
     EnergyDutyCycleMessage = 3,
+    EnergySubscribeMessage = 4,
+    EnergyNotifyMessage = 5,
 };
 
 //information sent to a module from the controller
@@ -420,6 +794,20 @@ int signpost_energy_duty_cycle(uint32_t time_ms);
 // that energy.
 int signpost_energy_report(signpost_energy_report_t* report);
 
+typedef void (*signpost_energy_notify_cb_t)(signpost_energy_information_t* info);
+
+// Ask the controller to push energy information instead of polling for it.
+// cb is called with the current information once subscribed, whenever the
+// module crosses the warning or critical threshold, and every period_s
+// seconds if period_s is not zero. Subscribing again replaces the callback
+// and period.
+//
+// params:
+//  period_s    - seconds between periodic updates, 0 for threshold changes only
+//  cb          - called with each update
+__attribute__((warn_unused_result))
+int signpost_energy_subscribe(uint32_t period_s, signpost_energy_notify_cb_t cb);
+
 // Query the controller for energy information, asynchronously
 //
 // params:
@@ -444,6 +832,15 @@ int signpost_energy_report_reply(uint8_t destination_address, int return_code);
 // returns a signpost error define.
 int signpost_energy_reset_reply(uint8_t destination_address, int return_code);
 
+// Response from the controller to a subscribing module with its current
+// energy information
+__attribute__((warn_unused_result))
+int signpost_energy_subscribe_reply(uint8_t destination_address, signpost_energy_information_t* info);
+
+// Push energy information from the controller to a subscribed module
+__attribute__((warn_unused_result))
+int signpost_energy_notify(uint8_t destination_address, signpost_energy_information_t* info);
+
 /**************************************************************************/
 /* TIME & LOCATION API                                                    */
 /**************************************************************************/
@@ -464,19 +861,64 @@ typedef struct __attribute__((packed)) {
     uint8_t  satellite_count;
 } signpost_timelocation_time_t;
 
+// Reply to TimeLocationGetTimeNextPpsMessage. The controller stamps each GPS
+// fix as it arrives, some time after the PPS edge the fix is for and before
+// the next one, so a module can count PPS edges on from there.
+typedef struct __attribute__((packed)) {
+    signpost_timelocation_time_t time;  // time at the PPS edge of the last fix
+    uint32_t ms_since_fix;              // age of that fix when the reply was sent
+} signpost_timelocation_pps_time_t;
+
 typedef struct __attribute__((packed)) {
     uint32_t latitude;  // Latitude in microdegrees (divide by 10^6 to get degrees)
     uint32_t longitude; // Longitude in microdegrees
     uint8_t  satellite_count;
 } signpost_timelocation_location_t;
 
-// Get time from controller
+// The local clock resyncs with the controller and PPS after this long
+#ifndef SIGNPOST_CLOCK_RESYNC_S
+#define SIGNPOST_CLOCK_RESYNC_S 600
+#endif
+// and waits this long before trying again after a failed sync
+#ifndef SIGNPOST_CLOCK_RETRY_S
+#define SIGNPOST_CLOCK_RETRY_S 60
+#endif
+#define SIGNPOST_CLOCK_PPS_TIMEOUT_MS 1500
+// a sync is refused if the fix landed this close to a PPS edge, where it
+// cannot be told which edge it belongs to
+#define SIGNPOST_CLOCK_PPS_GUARD_MS 50
+
+// Get time
+// Answered from the local clock, which is synced to the controller's GPS
+// time and PPS every SIGNPOST_CLOCK_RESYNC_S seconds. Falls back to asking
+// the controller if the local clock cannot be synced.
+// returns the satellite count or a signpost error define.
 //
 // params:
-//  time     - signpost_timelocation_time_t struct to fill
+//  time     - time_t to fill
 __attribute__((warn_unused_result))
 int signpost_timelocation_get_time(time_t* time);
 
+// Get time from the local clock with microseconds
+// Syncs first if the clock is unsynced or stale. Resolution is that of the
+// port timer (62.5 us on Tock).
+// returns the satellite count or a signpost error define.
+//
+// params:
+//  time     - time_t to fill
+//  usec     - microseconds into the second, may be NULL
+__attribute__((warn_unused_result))
+int signpost_timelocation_get_time_us(time_t* time, uint32_t* usec);
+
+// Sync the local clock now
+// Asks the controller which PPS edge its last fix was for and how old that
+// fix is, then waits through the reactor for the next PPS edge and works
+// out its time from the two. Waits for up to SIGNPOST_CLOCK_PPS_TIMEOUT_MS
+// for the edge.
+// returns the satellite count or a signpost error define.
+__attribute__((warn_unused_result))
+int signpost_timelocation_clock_sync(void);
+
 // Get location from controller
 //
 // params:
@@ -493,6 +935,15 @@ int signpost_timelocation_get_location(signpost_timelocation_location_t* locatio
 __attribute__((warn_unused_result))
 int signpost_timelocation_get_time_reply(uint8_t destination_address, signpost_timelocation_time_t* time);
 
+// Controller reply to next PPS time requesting module
+//
+// params:
+//
+//  destination_address - i2c address of requesting module
+//  pps_time            - time of the last fix's PPS edge and the fix's age
+__attribute__((warn_unused_result))
+int signpost_timelocation_get_time_next_pps_reply(uint8_t destination_address, signpost_timelocation_pps_time_t* pps_time);
+
 // Controller reply to location requesting module
 //
 // params:
@@ -516,6 +967,28 @@ int signpost_watchdog_start(void);
 int signpost_watchdog_tickle(void);
 int signpost_watchdog_reply(uint8_t destination_address);
 
+/**************************************************************************/
+/* DEBUG API                                                              */
+/**************************************************************************/
+
+// Every module answers these, libsignpost registers the handler itself
+typedef enum {
+    DebugMemstatsMessage = 0,
+} signpost_debug_message_type_e;
+
+// Read the stack and heap high-water marks of another module, usually
+// from the controller
+//
+// params:
+//  address - i2c address of the module to query
+//  stats   - signpost_memstats_t struct to fill
+__attribute__((warn_unused_result))
+int signpost_debug_memstats_query(uint8_t address, signpost_memstats_t* stats);
+
+// Reply with this module's high-water marks
+__attribute__((warn_unused_result))
+int signpost_debug_memstats_reply(uint8_t destination_address);
+
 /**************************************************************************/
 /* EDISON API                                                             */
 /**************************************************************************/
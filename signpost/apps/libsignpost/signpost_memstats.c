@@ -0,0 +1,183 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "port_signpost.h"
+#include "signpost_memstats.h"
+
+#define STACK_PAINT 0xC5A5C5A5
+// room left below the stack pointer when painting
+#define STACK_PAINT_GUARD 32
+// a dispatch can send a reply, which can nest a little further
+#define MAX_NESTED_CALLS 4
+
+static uintptr_t stack_bottom = 0;
+// peaks are measured from the stack pointer at the first init
+static uintptr_t stack_base = 0;
+// lowest word found overwritten since boot
+static uintptr_t stack_low = 0;
+
+typedef struct {
+    uintptr_t sp;
+    uintptr_t low;
+} active_call_t;
+
+static active_call_t active_calls[MAX_NESTED_CALLS];
+static int active_depth = 0;
+static uint16_t api_stack_peak[SIGNPOST_MEMSTATS_API_SLOTS];
+_Static_assert(HighestApiType < SIGNPOST_MEMSTATS_API_SLOTS, "memstats api slots");
+
+static size_t heap_current = 0;
+static size_t heap_peak = 0;
+static uint16_t heap_failures = 0;
+
+static uint16_t saturate_u16(size_t value) {
+    return value > UINT16_MAX ? UINT16_MAX : (uint16_t)value;
+}
+
+/**************************************************************************/
+/* STACK                                                                  */
+/**************************************************************************/
+
+// Everything below the returned address is free once this returns
+__attribute__((noinline))
+static uintptr_t current_sp(void) {
+    volatile uint32_t marker = 0;
+    return (uintptr_t)&marker;
+}
+
+__attribute__((noinline))
+static void stack_paint(void) {
+    uintptr_t top = current_sp() - STACK_PAINT_GUARD;
+    for (volatile uint32_t* word = (uint32_t*)stack_bottom; (uintptr_t)word < top; word++) {
+        *word = STACK_PAINT;
+    }
+}
+
+// Find the lowest overwritten word and fold it into every open measurement
+static void stack_scan(void) {
+    volatile uint32_t* word = (uint32_t*)stack_bottom;
+    while ((uintptr_t)word < stack_base && *word == STACK_PAINT) {
+        word++;
+    }
+
+    uintptr_t low = (uintptr_t)word;
+    if (low < stack_low) stack_low = low;
+    for (int i = 0; i < active_depth; i++) {
+        if (low < active_calls[i].low) active_calls[i].low = low;
+    }
+}
+
+void signpost_memstats_init(void) {
+    if (stack_base == 0) {
+        uintptr_t bottom;
+        if (port_signpost_stack_bottom(&bottom) != PORT_SUCCESS) return;
+        stack_bottom = (bottom + 3) & ~(uintptr_t)3;
+        stack_base = current_sp();
+        stack_low = stack_base;
+    } else {
+        stack_scan();
+    }
+    stack_paint();
+}
+
+int signpost_memstats_api_begin(void) {
+    if (stack_base == 0 || active_depth == MAX_NESTED_CALLS) return -1;
+
+    stack_scan();
+    uintptr_t sp = current_sp();
+    active_calls[active_depth].sp = sp;
+    active_calls[active_depth].low = sp;
+    active_depth++;
+    stack_paint();
+    return active_depth - 1;
+}
+
+void signpost_memstats_api_end(signbus_api_type_t api_type, int mark) {
+    if (mark < 0 || mark >= active_depth) return;
+
+    stack_scan();
+    active_call_t* call = &active_calls[mark];
+    uint16_t peak = saturate_u16(call->sp > call->low ? call->sp - call->low : 0);
+    if (api_type < SIGNPOST_MEMSTATS_API_SLOTS && peak > api_stack_peak[api_type]) {
+        api_stack_peak[api_type] = peak;
+    }
+    // anything opened inside this call and not closed is abandoned
+    active_depth = mark;
+}
+
+void signpost_memstats_get(signpost_memstats_t* stats) {
+    memset(stats, 0, sizeof(signpost_memstats_t));
+
+    if (stack_base != 0) {
+        stack_scan();
+        stats->stack_free = saturate_u16(stack_low - stack_bottom);
+        stats->stack_peak = saturate_u16(stack_base - stack_low);
+        memcpy(stats->api_stack_peak, api_stack_peak, sizeof(api_stack_peak));
+    }
+
+    stats->heap_current = saturate_u16(heap_current);
+    stats->heap_peak = saturate_u16(heap_peak);
+    stats->heap_failures = heap_failures;
+}
+
+/**************************************************************************/
+/* HEAP                                                                   */
+/**************************************************************************/
+
+// Each allocation is prefixed with its size so free can account for it
+typedef union {
+    size_t size;
+    long long align_ll;
+    double align_d;
+} heap_header_t;
+
+static void heap_account(size_t allocated, size_t freed) {
+    heap_current = heap_current + allocated - freed;
+    if (heap_current > heap_peak) heap_peak = heap_current;
+}
+
+void* signpost_malloc(size_t size) {
+    heap_header_t* header = malloc(sizeof(heap_header_t) + size);
+    if (header == NULL) {
+        if (heap_failures < UINT16_MAX) heap_failures++;
+        return NULL;
+    }
+
+    header->size = size;
+    heap_account(size, 0);
+    return header + 1;
+}
+
+void* signpost_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) return NULL;
+
+    void* ptr = signpost_malloc(count * size);
+    if (ptr != NULL) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* signpost_realloc(void* ptr, size_t size) {
+    if (ptr == NULL) return signpost_malloc(size);
+
+    heap_header_t* header = (heap_header_t*)ptr - 1;
+    size_t old_size = header->size;
+    heap_header_t* resized = realloc(header, sizeof(heap_header_t) + size);
+    if (resized == NULL) {
+        if (heap_failures < UINT16_MAX) heap_failures++;
+        return NULL;
+    }
+
+    resized->size = size;
+    heap_account(size, old_size);
+    return resized + 1;
+}
+
+void signpost_free(void* ptr) {
+    if (ptr == NULL) return;
+
+    heap_header_t* header = (heap_header_t*)ptr - 1;
+    heap_account(0, header->size);
+    free(header);
+}
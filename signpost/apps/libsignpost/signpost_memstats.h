@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "signbus_app_layer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stack and heap high-water marks
+//
+// The stack is painted with a known pattern below the current stack pointer
+// and later scanned for the lowest word that was overwritten. This needs the
+// port to report where the stack ends (port_signpost_stack_bottom), without
+// it all of the stack numbers stay at zero.
+//
+// The stack is painted once at init and only scanned when stats are asked
+// for, so the overall numbers cost nothing per message. Per api peaks need a
+// scan and repaint around every send and dispatch, so they are only kept
+// when SIGNPOST_MEMSTATS_API is defined, for example by adding
+// -DSIGNPOST_MEMSTATS_API to CPPFLAGS in an app Makefile. Otherwise
+// api_stack_peak stays zero.
+//
+// Heap use is only tracked for allocations made through signpost_malloc and
+// friends. libsignpost uses these for its own buffers, applications can too.
+
+// Fixed so the message layout does not change as apis are added
+#define SIGNPOST_MEMSTATS_API_SLOTS 16
+
+typedef struct __attribute__((packed)) signpost_memstats {
+    uint16_t stack_free;                             // stack never touched since boot
+    uint16_t stack_peak;                             // deepest stack use below signpost init
+    uint16_t heap_current;                           // bytes held through signpost_malloc
+    uint16_t heap_peak;
+    uint16_t heap_failures;                          // signpost_malloc calls that returned NULL
+    uint16_t api_stack_peak[SIGNPOST_MEMSTATS_API_SLOTS]; // deepest use inside each api, by api type
+} signpost_memstats_t;
+
+// Paint the unused stack. Called by signpost initialization, which should be
+// early in main so the peak covers as much of the app as possible.
+void signpost_memstats_init(void);
+
+// Bracket an api call or dispatch to record its peak stack use. These nest,
+// the returned mark must be handed back to the matching end.
+int signpost_memstats_api_begin(void);
+void signpost_memstats_api_end(signbus_api_type_t api_type, int mark);
+
+#ifdef SIGNPOST_MEMSTATS_API
+#define SIGNPOST_MEMSTATS_API_BEGIN() signpost_memstats_api_begin()
+#define SIGNPOST_MEMSTATS_API_END(_api_type, _mark) signpost_memstats_api_end((_api_type), (_mark))
+#else
+#define SIGNPOST_MEMSTATS_API_BEGIN() (-1)
+#define SIGNPOST_MEMSTATS_API_END(_api_type, _mark) do { (void)(_api_type); (void)(_mark); } while (0)
+#endif
+
+// Fill stats with the current high-water marks
+void signpost_memstats_get(signpost_memstats_t* stats);
+
+void* signpost_malloc(size_t size);
+void* signpost_calloc(size_t count, size_t size);
+void* signpost_realloc(void* ptr, size_t size);
+void signpost_free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,451 @@
+// Generated by tools/payload_codec/codegen.py from payloads.schema.
+// Do not edit, change the schema and regenerate.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "port_signpost.h"
+
+// Encoders return the encoded length, or PORT_ESIZE if buf is too short.
+// Decoders return the decoded length, or PORT_ESIZE if len is too short for
+// the required fields and PORT_EINVAL if the message type is wrong. Optional
+// fields missing from a short message are zeroed.
+
+static inline void signpost_payload_put(uint8_t* buf, uint32_t value, size_t width) {
+    for (size_t i = width; i > 0; i--) {
+        buf[i-1] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+static inline uint32_t signpost_payload_get(const uint8_t* buf, size_t width) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < width; i++) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+/**************************************************************************/
+/* ENERGY                                                                 */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_ENERGY_TYPE 0x01
+#define SIGNPOST_PAYLOAD_ENERGY_LEN 50
+#define SIGNPOST_PAYLOAD_ENERGY_MIN_LEN 34
+
+typedef struct {
+    uint16_t battery_voltage_mV;
+    int32_t battery_current_uA;
+    uint16_t solar_voltage_mV;
+    int32_t solar_current_uA;
+    uint8_t battery_capacity_percent_remaining;
+    uint16_t battery_capacity_remaining_mAh;
+    uint16_t battery_capacity_full_mAh;
+    uint16_t module0_energy_remaining_mWh;
+    uint16_t module1_energy_remaining_mWh;
+    uint16_t module2_energy_remaining_mWh;
+    uint16_t controller_energy_remaining_mWh;
+    uint16_t linux_energy_remaining_mWh;
+    uint16_t module5_energy_remaining_mWh;
+    uint16_t module6_energy_remaining_mWh;
+    uint16_t module7_energy_remaining_mWh;
+    uint16_t module0_energy_average_mW;
+    uint16_t module1_energy_average_mW;
+    uint16_t module2_energy_average_mW;
+    uint16_t controller_energy_average_mW;
+    uint16_t linux_energy_average_mW;
+    uint16_t module5_energy_average_mW;
+    uint16_t module6_energy_average_mW;
+    uint16_t module7_energy_average_mW;
+} signpost_payload_energy_t;
+
+static inline int signpost_payload_energy_encode(const signpost_payload_energy_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_ENERGY_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_ENERGY_TYPE;
+    signpost_payload_put(buf + 1, (uint32_t)msg->battery_voltage_mV, 2);
+    signpost_payload_put(buf + 3, (uint32_t)msg->battery_current_uA, 4);
+    signpost_payload_put(buf + 7, (uint32_t)msg->solar_voltage_mV, 2);
+    signpost_payload_put(buf + 9, (uint32_t)msg->solar_current_uA, 4);
+    buf[13] = (uint8_t)msg->battery_capacity_percent_remaining;
+    signpost_payload_put(buf + 14, (uint32_t)msg->battery_capacity_remaining_mAh, 2);
+    signpost_payload_put(buf + 16, (uint32_t)msg->battery_capacity_full_mAh, 2);
+    signpost_payload_put(buf + 18, (uint32_t)msg->module0_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 20, (uint32_t)msg->module1_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 22, (uint32_t)msg->module2_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 24, (uint32_t)msg->controller_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 26, (uint32_t)msg->linux_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 28, (uint32_t)msg->module5_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 30, (uint32_t)msg->module6_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 32, (uint32_t)msg->module7_energy_remaining_mWh, 2);
+    signpost_payload_put(buf + 34, (uint32_t)msg->module0_energy_average_mW, 2);
+    signpost_payload_put(buf + 36, (uint32_t)msg->module1_energy_average_mW, 2);
+    signpost_payload_put(buf + 38, (uint32_t)msg->module2_energy_average_mW, 2);
+    signpost_payload_put(buf + 40, (uint32_t)msg->controller_energy_average_mW, 2);
+    signpost_payload_put(buf + 42, (uint32_t)msg->linux_energy_average_mW, 2);
+    signpost_payload_put(buf + 44, (uint32_t)msg->module5_energy_average_mW, 2);
+    signpost_payload_put(buf + 46, (uint32_t)msg->module6_energy_average_mW, 2);
+    signpost_payload_put(buf + 48, (uint32_t)msg->module7_energy_average_mW, 2);
+    return SIGNPOST_PAYLOAD_ENERGY_LEN;
+}
+
+static inline int signpost_payload_energy_decode(signpost_payload_energy_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_ENERGY_MIN_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_ENERGY_TYPE) return PORT_EINVAL;
+    memset(msg, 0, sizeof(signpost_payload_energy_t));
+    msg->battery_voltage_mV = (uint16_t)signpost_payload_get(buf + 1, 2);
+    msg->battery_current_uA = (int32_t)signpost_payload_get(buf + 3, 4);
+    msg->solar_voltage_mV = (uint16_t)signpost_payload_get(buf + 7, 2);
+    msg->solar_current_uA = (int32_t)signpost_payload_get(buf + 9, 4);
+    msg->battery_capacity_percent_remaining = (uint8_t)buf[13];
+    msg->battery_capacity_remaining_mAh = (uint16_t)signpost_payload_get(buf + 14, 2);
+    msg->battery_capacity_full_mAh = (uint16_t)signpost_payload_get(buf + 16, 2);
+    msg->module0_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 18, 2);
+    msg->module1_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 20, 2);
+    msg->module2_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 22, 2);
+    msg->controller_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 24, 2);
+    msg->linux_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 26, 2);
+    msg->module5_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 28, 2);
+    msg->module6_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 30, 2);
+    msg->module7_energy_remaining_mWh = (uint16_t)signpost_payload_get(buf + 32, 2);
+    if (len < SIGNPOST_PAYLOAD_ENERGY_LEN) return SIGNPOST_PAYLOAD_ENERGY_MIN_LEN;
+    msg->module0_energy_average_mW = (uint16_t)signpost_payload_get(buf + 34, 2);
+    msg->module1_energy_average_mW = (uint16_t)signpost_payload_get(buf + 36, 2);
+    msg->module2_energy_average_mW = (uint16_t)signpost_payload_get(buf + 38, 2);
+    msg->controller_energy_average_mW = (uint16_t)signpost_payload_get(buf + 40, 2);
+    msg->linux_energy_average_mW = (uint16_t)signpost_payload_get(buf + 42, 2);
+    msg->module5_energy_average_mW = (uint16_t)signpost_payload_get(buf + 44, 2);
+    msg->module6_energy_average_mW = (uint16_t)signpost_payload_get(buf + 46, 2);
+    msg->module7_energy_average_mW = (uint16_t)signpost_payload_get(buf + 48, 2);
+    return SIGNPOST_PAYLOAD_ENERGY_LEN;
+}
+
+/**************************************************************************/
+/* GPS                                                                    */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_GPS_TYPE 0x02
+#define SIGNPOST_PAYLOAD_GPS_LEN 17
+
+typedef struct {
+    uint8_t day;
+    uint8_t month;
+    uint8_t year;
+    uint8_t hours;
+    uint8_t minutes;
+    uint8_t seconds;
+    int32_t latitude;
+    int32_t longitude;
+    uint8_t fix;
+    uint8_t satellite_count;
+} signpost_payload_gps_t;
+
+static inline int signpost_payload_gps_encode(const signpost_payload_gps_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_GPS_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_GPS_TYPE;
+    buf[1] = (uint8_t)msg->day;
+    buf[2] = (uint8_t)msg->month;
+    buf[3] = (uint8_t)msg->year;
+    buf[4] = (uint8_t)msg->hours;
+    buf[5] = (uint8_t)msg->minutes;
+    buf[6] = (uint8_t)msg->seconds;
+    signpost_payload_put(buf + 7, (uint32_t)msg->latitude, 4);
+    signpost_payload_put(buf + 11, (uint32_t)msg->longitude, 4);
+    buf[15] = (uint8_t)msg->fix;
+    buf[16] = (uint8_t)msg->satellite_count;
+    return SIGNPOST_PAYLOAD_GPS_LEN;
+}
+
+static inline int signpost_payload_gps_decode(signpost_payload_gps_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_GPS_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_GPS_TYPE) return PORT_EINVAL;
+    msg->day = (uint8_t)buf[1];
+    msg->month = (uint8_t)buf[2];
+    msg->year = (uint8_t)buf[3];
+    msg->hours = (uint8_t)buf[4];
+    msg->minutes = (uint8_t)buf[5];
+    msg->seconds = (uint8_t)buf[6];
+    msg->latitude = (int32_t)signpost_payload_get(buf + 7, 4);
+    msg->longitude = (int32_t)signpost_payload_get(buf + 11, 4);
+    msg->fix = (uint8_t)buf[15];
+    msg->satellite_count = (uint8_t)buf[16];
+    return SIGNPOST_PAYLOAD_GPS_LEN;
+}
+
+/**************************************************************************/
+/* MEMORY                                                                 */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_MEMORY_TYPE 0x01
+#define SIGNPOST_PAYLOAD_MEMORY_LEN 44
+
+typedef struct {
+    uint8_t module;
+    uint16_t stack_free;
+    uint16_t stack_peak;
+    uint16_t heap_current;
+    uint16_t heap_peak;
+    uint16_t heap_failures;
+    uint16_t api_stack_peak[16];
+} signpost_payload_memory_t;
+
+static inline int signpost_payload_memory_encode(const signpost_payload_memory_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_MEMORY_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_MEMORY_TYPE;
+    buf[1] = (uint8_t)msg->module;
+    signpost_payload_put(buf + 2, (uint32_t)msg->stack_free, 2);
+    signpost_payload_put(buf + 4, (uint32_t)msg->stack_peak, 2);
+    signpost_payload_put(buf + 6, (uint32_t)msg->heap_current, 2);
+    signpost_payload_put(buf + 8, (uint32_t)msg->heap_peak, 2);
+    signpost_payload_put(buf + 10, (uint32_t)msg->heap_failures, 2);
+    for (size_t i = 0; i < 16; i++) {
+        signpost_payload_put(buf + 12 + i*2, (uint32_t)msg->api_stack_peak[i], 2);
+    }
+    return SIGNPOST_PAYLOAD_MEMORY_LEN;
+}
+
+static inline int signpost_payload_memory_decode(signpost_payload_memory_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_MEMORY_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_MEMORY_TYPE) return PORT_EINVAL;
+    msg->module = (uint8_t)buf[1];
+    msg->stack_free = (uint16_t)signpost_payload_get(buf + 2, 2);
+    msg->stack_peak = (uint16_t)signpost_payload_get(buf + 4, 2);
+    msg->heap_current = (uint16_t)signpost_payload_get(buf + 6, 2);
+    msg->heap_peak = (uint16_t)signpost_payload_get(buf + 8, 2);
+    msg->heap_failures = (uint16_t)signpost_payload_get(buf + 10, 2);
+    for (size_t i = 0; i < 16; i++) {
+        msg->api_stack_peak[i] = (uint16_t)signpost_payload_get(buf + 12 + i*2, 2);
+    }
+    return SIGNPOST_PAYLOAD_MEMORY_LEN;
+}
+
+/**************************************************************************/
+/* AMBIENT                                                                */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_AMBIENT_TYPE 0x01
+#define SIGNPOST_PAYLOAD_AMBIENT_LEN 10
+
+typedef struct {
+    int16_t temperature;
+    int16_t humidity;
+    int16_t light;
+    uint32_t pressure;
+} signpost_payload_ambient_t;
+
+static inline int signpost_payload_ambient_encode(const signpost_payload_ambient_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AMBIENT_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_AMBIENT_TYPE;
+    signpost_payload_put(buf + 1, (uint32_t)msg->temperature, 2);
+    signpost_payload_put(buf + 3, (uint32_t)msg->humidity, 2);
+    signpost_payload_put(buf + 5, (uint32_t)msg->light, 2);
+    signpost_payload_put(buf + 7, (uint32_t)msg->pressure, 3);
+    return SIGNPOST_PAYLOAD_AMBIENT_LEN;
+}
+
+static inline int signpost_payload_ambient_decode(signpost_payload_ambient_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AMBIENT_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_AMBIENT_TYPE) return PORT_EINVAL;
+    msg->temperature = (int16_t)signpost_payload_get(buf + 1, 2);
+    msg->humidity = (int16_t)signpost_payload_get(buf + 3, 2);
+    msg->light = (int16_t)signpost_payload_get(buf + 5, 2);
+    msg->pressure = (uint32_t)signpost_payload_get(buf + 7, 3);
+    return SIGNPOST_PAYLOAD_AMBIENT_LEN;
+}
+
+/**************************************************************************/
+/* AUDIO_SPECTRUM                                                         */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_TYPE 0x01
+#define SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_LEN 15
+
+typedef struct {
+    uint16_t bands[7];
+} signpost_payload_audio_spectrum_t;
+
+static inline int signpost_payload_audio_spectrum_encode(const signpost_payload_audio_spectrum_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_TYPE;
+    for (size_t i = 0; i < 7; i++) {
+        signpost_payload_put(buf + 1 + i*2, (uint32_t)msg->bands[i], 2);
+    }
+    return SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_LEN;
+}
+
+static inline int signpost_payload_audio_spectrum_decode(signpost_payload_audio_spectrum_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_TYPE) return PORT_EINVAL;
+    for (size_t i = 0; i < 7; i++) {
+        msg->bands[i] = (uint16_t)signpost_payload_get(buf + 1 + i*2, 2);
+    }
+    return SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_LEN;
+}
+
+/**************************************************************************/
+/* AUDIO_SPECTRUM_BATCH                                                   */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_TYPE 0x03
+#define SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_LEN 75
+
+typedef struct {
+    uint32_t time;
+    uint8_t bands[70];
+} signpost_payload_audio_spectrum_batch_t;
+
+static inline int signpost_payload_audio_spectrum_batch_encode(const signpost_payload_audio_spectrum_batch_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_TYPE;
+    signpost_payload_put(buf + 1, (uint32_t)msg->time, 4);
+    for (size_t i = 0; i < 70; i++) {
+        buf[5 + i*1] = (uint8_t)msg->bands[i];
+    }
+    return SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_LEN;
+}
+
+static inline int signpost_payload_audio_spectrum_batch_decode(signpost_payload_audio_spectrum_batch_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_TYPE) return PORT_EINVAL;
+    msg->time = (uint32_t)signpost_payload_get(buf + 1, 4);
+    for (size_t i = 0; i < 70; i++) {
+        msg->bands[i] = (uint8_t)buf[5 + i*1];
+    }
+    return SIGNPOST_PAYLOAD_AUDIO_SPECTRUM_BATCH_LEN;
+}
+
+/**************************************************************************/
+/* RADAR_MOTION                                                           */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_RADAR_MOTION_TYPE 0x01
+#define SIGNPOST_PAYLOAD_RADAR_MOTION_LEN 7
+
+typedef struct {
+    int8_t motion;
+    uint32_t speed;
+    uint8_t motion_confidence;
+} signpost_payload_radar_motion_t;
+
+static inline int signpost_payload_radar_motion_encode(const signpost_payload_radar_motion_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_RADAR_MOTION_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_RADAR_MOTION_TYPE;
+    buf[1] = (uint8_t)msg->motion;
+    signpost_payload_put(buf + 2, (uint32_t)msg->speed, 4);
+    buf[6] = (uint8_t)msg->motion_confidence;
+    return SIGNPOST_PAYLOAD_RADAR_MOTION_LEN;
+}
+
+static inline int signpost_payload_radar_motion_decode(signpost_payload_radar_motion_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_RADAR_MOTION_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_RADAR_MOTION_TYPE) return PORT_EINVAL;
+    msg->motion = (int8_t)buf[1];
+    msg->speed = (uint32_t)signpost_payload_get(buf + 2, 4);
+    msg->motion_confidence = (uint8_t)buf[6];
+    return SIGNPOST_PAYLOAD_RADAR_MOTION_LEN;
+}
+
+/**************************************************************************/
+/* RADAR_MOTION_BATCH                                                     */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_TYPE 0x02
+#define SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_LEN 25
+
+typedef struct {
+    uint32_t time;
+    uint8_t motion_index[20];
+} signpost_payload_radar_motion_batch_t;
+
+static inline int signpost_payload_radar_motion_batch_encode(const signpost_payload_radar_motion_batch_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_TYPE;
+    signpost_payload_put(buf + 1, (uint32_t)msg->time, 4);
+    for (size_t i = 0; i < 20; i++) {
+        buf[5 + i*1] = (uint8_t)msg->motion_index[i];
+    }
+    return SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_LEN;
+}
+
+static inline int signpost_payload_radar_motion_batch_decode(signpost_payload_radar_motion_batch_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_TYPE) return PORT_EINVAL;
+    msg->time = (uint32_t)signpost_payload_get(buf + 1, 4);
+    for (size_t i = 0; i < 20; i++) {
+        msg->motion_index[i] = (uint8_t)buf[5 + i*1];
+    }
+    return SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_LEN;
+}
+
+/**************************************************************************/
+/* AQM                                                                    */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_AQM_TYPE 0x01
+#define SIGNPOST_PAYLOAD_AQM_LEN 15
+
+typedef struct {
+    uint16_t co2_ppm;
+    uint32_t VOC_PID_ppb;
+    uint32_t VOC_IAQ_ppb;
+    uint16_t barometric_millibar;
+    uint16_t humidity_percent;
+} signpost_payload_aqm_t;
+
+static inline int signpost_payload_aqm_encode(const signpost_payload_aqm_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AQM_LEN) return PORT_ESIZE;
+    buf[0] = SIGNPOST_PAYLOAD_AQM_TYPE;
+    signpost_payload_put(buf + 1, (uint32_t)msg->co2_ppm, 2);
+    signpost_payload_put(buf + 3, (uint32_t)msg->VOC_PID_ppb, 4);
+    signpost_payload_put(buf + 7, (uint32_t)msg->VOC_IAQ_ppb, 4);
+    signpost_payload_put(buf + 11, (uint32_t)msg->barometric_millibar, 2);
+    signpost_payload_put(buf + 13, (uint32_t)msg->humidity_percent, 2);
+    return SIGNPOST_PAYLOAD_AQM_LEN;
+}
+
+static inline int signpost_payload_aqm_decode(signpost_payload_aqm_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_AQM_LEN) return PORT_ESIZE;
+    if (buf[0] != SIGNPOST_PAYLOAD_AQM_TYPE) return PORT_EINVAL;
+    msg->co2_ppm = (uint16_t)signpost_payload_get(buf + 1, 2);
+    msg->VOC_PID_ppb = (uint32_t)signpost_payload_get(buf + 3, 4);
+    msg->VOC_IAQ_ppb = (uint32_t)signpost_payload_get(buf + 7, 4);
+    msg->barometric_millibar = (uint16_t)signpost_payload_get(buf + 11, 2);
+    msg->humidity_percent = (uint16_t)signpost_payload_get(buf + 13, 2);
+    return SIGNPOST_PAYLOAD_AQM_LEN;
+}
+
+/**************************************************************************/
+/* WS_SPECTRUM                                                            */
+/**************************************************************************/
+
+#define SIGNPOST_PAYLOAD_WS_SPECTRUM_LEN 80
+
+typedef struct {
+    int8_t channels[80];
+} signpost_payload_ws_spectrum_t;
+
+static inline int signpost_payload_ws_spectrum_encode(const signpost_payload_ws_spectrum_t* msg, uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_WS_SPECTRUM_LEN) return PORT_ESIZE;
+    for (size_t i = 0; i < 80; i++) {
+        buf[0 + i*1] = (uint8_t)msg->channels[i];
+    }
+    return SIGNPOST_PAYLOAD_WS_SPECTRUM_LEN;
+}
+
+static inline int signpost_payload_ws_spectrum_decode(signpost_payload_ws_spectrum_t* msg, const uint8_t* buf, size_t len) {
+    if (len < SIGNPOST_PAYLOAD_WS_SPECTRUM_LEN) return PORT_ESIZE;
+    for (size_t i = 0; i < 80; i++) {
+        msg->channels[i] = (int8_t)buf[0 + i*1];
+    }
+    return SIGNPOST_PAYLOAD_WS_SPECTRUM_LEN;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,158 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "port_signpost.h"
+#include "signpost_reactor.h"
+
+typedef struct {
+    signpost_reactor_handler_t handler;
+    int arg;
+    void* ud;
+} reactor_event_t;
+
+static reactor_event_t event_queue[SIGNPOST_REACTOR_QUEUE_LEN];
+static volatile uint8_t event_head = 0;
+static volatile uint8_t event_count = 0;
+
+// set whenever there is something for the loop to look at
+static volatile bool reactor_pending = false;
+
+// started timers, soonest first
+static signpost_reactor_timer_t* timers = NULL;
+
+static uint32_t ms_to_ticks(uint32_t ms) {
+    return (uint32_t)(((uint64_t)ms * port_signpost_timer_frequency()) / 1000);
+}
+
+static uint32_t ticks_to_ms(uint32_t ticks) {
+    return (uint32_t)(((uint64_t)ticks * 1000) / port_signpost_timer_frequency());
+}
+
+// Ticks from now until deadline, 0 if it has passed. Deadlines are less
+// than half the timer range away, so the signed difference handles wrap.
+static uint32_t ticks_until(uint32_t deadline, uint32_t now) {
+    int32_t diff = (int32_t)(deadline - now);
+    return diff > 0 ? (uint32_t)diff : 0;
+}
+
+// Run one queued event or expired timer. Returns false if there was nothing.
+static bool reactor_run_one(void) {
+    if (event_count > 0) {
+        reactor_event_t event = event_queue[event_head];
+        event_head = (event_head + 1) % SIGNPOST_REACTOR_QUEUE_LEN;
+        event_count--;
+        event.handler(event.arg, event.ud);
+        return true;
+    }
+
+    if (timers != NULL && ticks_until(timers->deadline, port_signpost_timer_read()) == 0) {
+        signpost_reactor_timer_t* timer = timers;
+        timers = timer->next;
+        timer->active = false;
+        timer->handler(0, timer->ud);
+        return true;
+    }
+
+    return false;
+}
+
+int signpost_reactor_post(signpost_reactor_handler_t handler, int arg, void* ud) {
+    if (event_count == SIGNPOST_REACTOR_QUEUE_LEN) {
+        port_printf("Warn: Reactor queue full, dropping event\n");
+        return PORT_EBUSY;
+    }
+
+    uint8_t tail = (event_head + event_count) % SIGNPOST_REACTOR_QUEUE_LEN;
+    event_queue[tail].handler = handler;
+    event_queue[tail].arg = arg;
+    event_queue[tail].ud = ud;
+    event_count++;
+    reactor_pending = true;
+    return PORT_SUCCESS;
+}
+
+void signpost_reactor_timer_cancel(signpost_reactor_timer_t* timer) {
+    for (signpost_reactor_timer_t** link = &timers; *link != NULL; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            break;
+        }
+    }
+    timer->active = false;
+}
+
+void signpost_reactor_timer_start(signpost_reactor_timer_t* timer, uint32_t ms,
+        signpost_reactor_handler_t handler, void* ud) {
+    if (timer->active) signpost_reactor_timer_cancel(timer);
+
+    uint32_t now = port_signpost_timer_read();
+    timer->deadline = now + ms_to_ticks(ms);
+    timer->handler = handler;
+    timer->ud = ud;
+    timer->active = true;
+
+    signpost_reactor_timer_t** link = &timers;
+    while (*link != NULL && ticks_until((*link)->deadline, now) <= ticks_until(timer->deadline, now)) {
+        link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    reactor_pending = true;
+}
+
+void signpost_reactor_wake(void) {
+    reactor_pending = true;
+}
+
+int signpost_reactor_wait_for(bool* condition, uint32_t timeout_ms) {
+    uint32_t deadline = port_signpost_timer_read() + ms_to_ticks(timeout_ms);
+    int rc = PORT_SUCCESS;
+
+    while (!*condition) {
+        if (reactor_run_one()) continue;
+
+        // nothing to run, sleep until the next event, timer or our timeout
+        reactor_pending = false;
+        if (event_count > 0) continue;
+
+        uint32_t now = port_signpost_timer_read();
+        uint32_t sleep_ticks = UINT32_MAX;
+        if (timeout_ms != 0) {
+            sleep_ticks = ticks_until(deadline, now);
+            if (sleep_ticks == 0) {
+                rc = PORT_FAIL;
+                break;
+            }
+        }
+        if (timers != NULL) {
+            uint32_t timer_ticks = ticks_until(timers->deadline, now);
+            if (timer_ticks < sleep_ticks) sleep_ticks = timer_ticks;
+        }
+
+        if (sleep_ticks == UINT32_MAX) {
+            port_signpost_wait_for((void*)&reactor_pending);
+        } else {
+            // round up so we do not wake just before the deadline
+            port_signpost_wait_for_with_timeout((void*)&reactor_pending, ticks_to_ms(sleep_ticks) + 1);
+        }
+    }
+
+    return rc;
+}
+
+void signpost_reactor_delay_ms(uint32_t ms) {
+    static bool never = false;
+    if (ms == 0) {
+        while (reactor_run_one());
+        return;
+    }
+    signpost_reactor_wait_for(&never, ms);
+}
+
+void signpost_reactor_run(void) {
+    static bool never = false;
+    while (true) {
+        signpost_reactor_wait_for(&never, 0);
+    }
+}
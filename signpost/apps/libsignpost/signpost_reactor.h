@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Event loop for libsignpost
+//
+// Driver callbacks do as little as possible and post an event here. Events
+// and expired timers are run one at a time from the loop, outside any driver
+// callback, and between events the loop sleeps in one place through the port
+// layer.
+//
+// Posting never runs an event, so events only run while the app is in the
+// loop: inside signpost_reactor_wait_for, which all of the blocking API
+// calls use, signpost_reactor_delay_ms or signpost_reactor_run. Apps must
+// spend their idle time there, by ending main with signpost_reactor_run and
+// sleeping with signpost_reactor_delay_ms instead of a platform delay.
+// Messages that arrive while an app sleeps any other way, or after it
+// returns from main, wait in the queue.
+
+#ifndef SIGNPOST_REACTOR_QUEUE_LEN
+#define SIGNPOST_REACTOR_QUEUE_LEN 8
+#endif
+
+typedef void (*signpost_reactor_handler_t)(int arg, void* ud);
+
+// Owned by the caller and must stay valid while started
+typedef struct signpost_reactor_timer {
+    uint32_t deadline;
+    signpost_reactor_handler_t handler;
+    void* ud;
+    bool active;
+    struct signpost_reactor_timer* next;
+} signpost_reactor_timer_t;
+
+// Queue handler(arg, ud) to run from the loop. Safe to call from driver
+// callbacks. Returns PORT_EBUSY if the queue is full.
+int signpost_reactor_post(signpost_reactor_handler_t handler, int arg, void* ud);
+
+// Run handler(0, ud) from the loop once ms have passed
+void signpost_reactor_timer_start(signpost_reactor_timer_t* timer, uint32_t ms,
+        signpost_reactor_handler_t handler, void* ud);
+void signpost_reactor_timer_cancel(signpost_reactor_timer_t* timer);
+
+// Run the loop until *condition is true or timeout_ms pass, 0 waits
+// forever. The condition must be set from a reactor handler, or followed by
+// signpost_reactor_wake, or the loop will not notice until the next event.
+// Returns PORT_SUCCESS, or PORT_FAIL on timeout.
+int signpost_reactor_wait_for(bool* condition, uint32_t timeout_ms);
+
+// Run the loop for ms, then return. 0 only runs what is already due. Use
+// in place of a platform delay so messages are handled while the app sleeps.
+void signpost_reactor_delay_ms(uint32_t ms);
+
+// Wake the loop to recheck its condition
+void signpost_reactor_wake(void);
+
+// Run the loop forever. Call at the end of main.
+void signpost_reactor_run(void) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
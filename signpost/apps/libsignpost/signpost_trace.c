@@ -0,0 +1,94 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "port_signpost.h"
+#include "signpost_api.h"
+#include "signpost_trace.h"
+
+#define TRACE_PUBLISH_VERSION 0x01
+// version, timer frequency and dropped count
+#define TRACE_PUBLISH_HEADER_LEN 7
+#define TRACE_PUBLISH_RECORDS ((255 - TRACE_PUBLISH_HEADER_LEN) / sizeof(signpost_trace_record_t))
+#define TRACE_DUMP_RECORDS_PER_LINE 4
+
+static signpost_trace_record_t trace_ring[SIGNPOST_TRACE_LEN];
+static size_t trace_head = 0;
+static size_t trace_count = 0;
+static uint32_t trace_dropped = 0;
+
+void signpost_trace_record(uint8_t event, uint16_t arg) {
+    signpost_trace_record_t* record = &trace_ring[trace_head];
+    record->timestamp = port_signpost_timer_read();
+    record->event = event;
+    record->reserved = 0;
+    record->arg = arg;
+
+    trace_head = (trace_head + 1) % SIGNPOST_TRACE_LEN;
+    if (trace_count == SIGNPOST_TRACE_LEN) {
+        trace_dropped++;
+    } else {
+        trace_count++;
+    }
+}
+
+size_t signpost_trace_drain(signpost_trace_record_t* records, size_t max_records, uint32_t* dropped) {
+    size_t tail = (trace_head + SIGNPOST_TRACE_LEN - trace_count) % SIGNPOST_TRACE_LEN;
+    size_t n = trace_count < max_records ? trace_count : max_records;
+
+    for (size_t i = 0; i < n; i++) {
+        records[i] = trace_ring[(tail + i) % SIGNPOST_TRACE_LEN];
+    }
+    trace_count -= n;
+
+    *dropped = trace_dropped;
+    trace_dropped = 0;
+    return n;
+}
+
+void signpost_trace_dump(void) {
+    signpost_trace_record_t records[TRACE_DUMP_RECORDS_PER_LINE];
+    uint32_t dropped;
+    size_t remaining = trace_count;
+
+    port_printf("TRACE BEGIN %lu %lu\n", (unsigned long)port_signpost_timer_frequency(),
+            (unsigned long)trace_dropped);
+    while (remaining > 0) {
+        size_t n = signpost_trace_drain(records, TRACE_DUMP_RECORDS_PER_LINE, &dropped);
+        if (n == 0) break;
+        remaining = remaining > n ? remaining - n : 0;
+
+        port_printf("TRACE ");
+        uint8_t* bytes = (uint8_t*)records;
+        for (size_t i = 0; i < n * sizeof(signpost_trace_record_t); i++) {
+            port_printf("%02x", bytes[i]);
+        }
+        port_printf("\n");
+    }
+    port_printf("TRACE END\n");
+}
+
+int signpost_trace_publish(const char* topic) {
+    uint8_t buf[TRACE_PUBLISH_HEADER_LEN + TRACE_PUBLISH_RECORDS * sizeof(signpost_trace_record_t)];
+    uint32_t frequency = port_signpost_timer_frequency();
+    // publishing adds records of its own, those go out next time
+    size_t remaining = trace_count;
+
+    while (remaining > 0) {
+        uint32_t dropped;
+        size_t n = signpost_trace_drain((signpost_trace_record_t*)(buf + TRACE_PUBLISH_HEADER_LEN),
+                TRACE_PUBLISH_RECORDS, &dropped);
+        if (n == 0) break;
+        remaining = remaining > n ? remaining - n : 0;
+
+        uint16_t dropped16 = dropped > UINT16_MAX ? UINT16_MAX : dropped;
+        buf[0] = TRACE_PUBLISH_VERSION;
+        memcpy(buf + 1, &frequency, sizeof(uint32_t));
+        memcpy(buf + 5, &dropped16, sizeof(uint16_t));
+
+        int rc = signpost_networking_publish(topic, buf,
+                TRACE_PUBLISH_HEADER_LEN + n * sizeof(signpost_trace_record_t));
+        if (rc < 0) return rc;
+    }
+    return PORT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hot path tracing
+//
+// Trace points record a timestamp, an event and a 16 bit argument into a
+// fixed ring buffer. They compile to nothing unless SIGNPOST_TRACE is
+// defined, for example by adding -DSIGNPOST_TRACE to CPPFLAGS in an app
+// Makefile. The buffer is drained to the console or published, and
+// tools/trace_decode turns it into per-stage latencies.
+//
+// Timestamps come from port_signpost_timer_read, so their resolution is
+// whatever the port's free running timer gives.
+
+// Arguments are read from the begin record unless noted
+typedef enum {
+    SignpostTraceIoSend = 1,            // arg: message length
+    SignpostTraceIoFragmentWrite = 2,   // arg: bytes written to the bus
+    SignpostTraceIoGetMessage = 3,      // arg: message length, on end
+    SignpostTraceCipher = 4,            // arg: input length
+    SignpostTraceMessageDigest = 5,     // arg: input length
+    SignpostTraceApiDispatch = 6,       // arg: api type << 8 | message type
+    SignpostTraceStorageWrite = 7,      // arg: bytes to write, bytes written on end
+} signpost_trace_event_e;
+
+// Set in the event byte of records marking the end of a stage
+#define SIGNPOST_TRACE_END_FLAG 0x80
+
+#ifndef SIGNPOST_TRACE_LEN
+#define SIGNPOST_TRACE_LEN 128
+#endif
+
+typedef struct __attribute__((packed)) signpost_trace_record {
+    uint32_t timestamp;
+    uint8_t  event;
+    uint8_t  reserved;
+    uint16_t arg;
+} signpost_trace_record_t;
+
+#ifdef SIGNPOST_TRACE
+#define SIGNPOST_TRACE_BEGIN(_event, _arg) signpost_trace_record((_event), (_arg))
+#define SIGNPOST_TRACE_END(_event, _arg) signpost_trace_record((_event) | SIGNPOST_TRACE_END_FLAG, (_arg))
+#else
+#define SIGNPOST_TRACE_BEGIN(_event, _arg)
+#define SIGNPOST_TRACE_END(_event, _arg)
+#endif
+
+void signpost_trace_record(uint8_t event, uint16_t arg);
+
+// Copy out and clear the buffered records, oldest first. Returns the number
+// of records copied, and sets dropped to the number overwritten since the
+// last drain.
+size_t signpost_trace_drain(signpost_trace_record_t* records, size_t max_records, uint32_t* dropped);
+
+// Drain the buffer to the console as TRACE lines for tools/trace_decode
+void signpost_trace_dump(void);
+
+// Drain the buffer through the networking api on the given topic. Each
+// publish is a header followed by records, see tools/trace_decode.
+int signpost_trace_publish(const char* topic);
+
+#ifdef __cplusplus
+}
+#endif
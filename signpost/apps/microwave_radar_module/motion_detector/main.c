@@ -15,11 +15,14 @@
 #include "app_watchdog.h"
 #include "i2c_master_slave.h"
 #include "signpost_api.h"
+#include "signpost_payloads.h"
+#include "signpost_reactor.h"
 #include "microwave_radar.h"
 #include "time.h"
 
 // i2c message storage
-uint8_t send_buf[50];
+static signpost_payload_radar_motion_batch_t batch;
+uint8_t send_buf[SIGNPOST_PAYLOAD_RADAR_MOTION_BATCH_LEN];
 
 #define LED_PIN 0
 
@@ -38,16 +41,17 @@ static void timer_callback (
 
     // uint8_t of the index/2000 (deterimined analytically - if we are at 512000 there is definitely motion).
     if(motion_index > 510000) {
-        send_buf[5+count] = 255;
+        batch.motion_index[count] = 255;
     } else {
-        send_buf[5+count] = (uint8_t)((motion_index/2000) & 0xFF);
+        batch.motion_index[count] = (uint8_t)((motion_index/2000) & 0xFF);
     }
 
     count++;
 
     if(count == 20) {
+        int len = signpost_payload_radar_motion_batch_encode(&batch, send_buf, sizeof(send_buf));
         printf("About to send data to radio\n");
-        int rc = signpost_networking_publish("motion",send_buf,5+count*4);
+        int rc = signpost_networking_publish("motion",send_buf,len);
         printf("Sent data with return code %d\n\n\n",rc);
 
         if(rc >= 0) {
@@ -61,17 +65,10 @@ static void timer_callback (
         if(rc < 0) {
             printf("Failed to get time - assuming 20 seconds\n");
             utime += 20;
-            send_buf[1] = (uint8_t)((utime & 0xff000000) >> 24);
-            send_buf[2] = (uint8_t)((utime & 0xff0000) >> 16);
-            send_buf[3] = (uint8_t)((utime & 0xff00) >> 8);
-            send_buf[4] = (uint8_t)((utime & 0xff));
         } else {
             printf("Got time with %d satellites\n",rc);
-            send_buf[1] = (uint8_t)((utime & 0xff000000) >> 24);
-            send_buf[2] = (uint8_t)((utime & 0xff0000) >> 16);
-            send_buf[3] = (uint8_t)((utime & 0xff00) >> 8);
-            send_buf[4] = (uint8_t)((utime & 0xff));
         }
+        batch.time = utime;
     }
 }
 
@@ -101,8 +98,6 @@ int main (void) {
     gpio_set(3);
     mr_init();
 
-    send_buf[0] = 0x02;
-
     // setup two timers. One every 500ms to check for motion and
     // one to send data every 5s summarizing that motion
     static tock_timer_t send_timer;
@@ -111,5 +106,8 @@ int main (void) {
     // Setup a watchdog
     app_watchdog_set_kernel_timeout(60000);
     app_watchdog_start();
+
+    // handle messages from the loop while the timer does the work
+    signpost_reactor_run();
 }
 
@@ -10,6 +10,7 @@
 
 //tock includes
 #include <signpost_api.h>
+#include <signpost_reactor.h>
 #include "tock.h"
 #include "console.h"
 #include "timer.h"
@@ -22,6 +23,7 @@
 #include "RadioDefs.h"
 #include "CRC16.h"
 #include "led.h"
+#include "rng.h"
 
 #define POST_ADDRESS "ec2-35-166-179-172.us-west-2.compute.amazonaws.com"
 
@@ -142,13 +144,93 @@ static int8_t send_downlink_message(uint8_t* buffer, uint8_t len) {
     }
 }
 
+//topic interning
+//The first time a topic is queued it is given a small id, and after that
+//records carry [0x80|id][epoch][dlen][data] instead of the topic string.
+//The first use, and every TOPIC_REDEFINE_INTERVAL uses after it, is sent as
+//a definition [0xFF][id][epoch][tlen][topic][dlen][data] so the backend can
+//relearn the map if a definition is lost. The epoch is random per boot so the
+//backend never resolves this boot's ids with a map from a previous one.
+#define TOPIC_TABLE_SIZE 32
+#define TOPIC_MAX_LEN 32
+#define TOPIC_REDEFINE_INTERVAL 16
+#define TOPIC_INTERNED 0x80
+#define TOPIC_DEFINE 0xFF
+static char topic_table[TOPIC_TABLE_SIZE][TOPIC_MAX_LEN];
+static uint8_t topic_table_len[TOPIC_TABLE_SIZE];
+static uint8_t topic_uses[TOPIC_TABLE_SIZE];
+static uint8_t topic_count = 0;
+static uint8_t topic_epoch = 0;
+
+static int intern_topic(uint8_t* topic, uint8_t tlen) {
+    for(uint8_t i = 0; i < topic_count; i++) {
+        if(topic_table_len[i] == tlen && !memcmp(topic_table[i], topic, tlen)) {
+            return i;
+        }
+    }
+
+    if(topic_count == TOPIC_TABLE_SIZE || tlen > TOPIC_MAX_LEN) {
+        return TOCK_FAIL;
+    }
+
+    memcpy(topic_table[topic_count], topic, tlen);
+    topic_table_len[topic_count] = tlen;
+    topic_uses[topic_count] = 0;
+    return topic_count++;
+}
+
+//rewrite a [tlen][topic][dlen][data] record into its interned form
+//returns the new length, or 0 if it should be sent unchanged
+static uint8_t intern_record(uint8_t* out, uint8_t* record, uint8_t len) {
+    uint8_t tlen = record[0];
+    if(tlen >= TOPIC_INTERNED || tlen + 2 > len) {
+        return 0;
+    }
+    uint8_t dlen = record[tlen+1];
+    if(tlen + dlen + 2 > len) {
+        return 0;
+    }
+
+    int id = intern_topic(record+1, tlen);
+    if(id < 0) {
+        return 0;
+    }
+
+    if(topic_uses[id] % TOPIC_REDEFINE_INTERVAL == 0) {
+        if(len + 3 > BUFFER_SIZE) {
+            return 0;
+        }
+        out[0] = TOPIC_DEFINE;
+        out[1] = id;
+        out[2] = topic_epoch;
+        memcpy(out+3, record, len);
+        topic_uses[id]++;
+        return len + 3;
+    } else {
+        if(dlen + 3 > BUFFER_SIZE) {
+            return 0;
+        }
+        out[0] = TOPIC_INTERNED | id;
+        out[1] = topic_epoch;
+        out[2] = dlen;
+        memcpy(out+3, record+tlen+2, dlen);
+        topic_uses[id]++;
+        return dlen + 3;
+    }
+}
+
 static int8_t add_buffer_to_queue(uint8_t addr, uint8_t* buffer, uint8_t len) {
     uint8_t temp_tail = queue_tail;
     increment_queue_pointer(&temp_tail);
     if(temp_tail == queue_head) {
         return TOCK_FAIL;
     } else {
-        if(len <= BUFFER_SIZE) {
+        uint8_t interned_len = intern_record(data_queue[queue_tail], buffer, len);
+        if(interned_len > 0) {
+            data_address[queue_tail]= addr;
+            data_length[queue_tail] = interned_len;
+            increment_queue_pointer(&queue_tail);
+        } else if(len <= BUFFER_SIZE) {
             data_address[queue_tail]= addr;
             memcpy(data_queue[queue_tail], buffer, len);
             data_length[queue_tail] = len;
@@ -176,7 +258,34 @@ static void networking_api_callback(uint8_t source_address,
     if (frame_type == NotificationFrame || frame_type == CommandFrame) {
         if(message_type == NetworkingPublishMessage) {
             int rc = add_buffer_to_queue(source_address, message, message_length);
-            signpost_networking_publish_reply(source_address, rc);
+            // notifications are fire-and-forget, nobody is waiting for a reply
+            if(frame_type == CommandFrame) {
+                signpost_networking_publish_reply(source_address, rc);
+            }
+        } else if(message_type == NetworkingPublishBatchMessage) {
+            // a batch is back to back [tlen][topic][dlen][data] records,
+            // each queued as if it had been published on its own
+            int rc = 0;
+            size_t offset = 0;
+            while(offset + 2 <= message_length) {
+                uint8_t tlen = message[offset];
+                if(offset + tlen + 2 > message_length) break;
+                uint8_t dlen = message[offset + tlen + 1];
+                size_t len = tlen + dlen + 2;
+                if(offset + len > message_length) break;
+
+                int queue_rc = add_buffer_to_queue(source_address, message + offset, len);
+                if(queue_rc < 0 && rc == 0) {
+                    rc = queue_rc;
+                }
+                offset += len;
+            }
+            if(offset != message_length && rc == 0) {
+                rc = TOCK_EINVAL;
+            }
+            if(frame_type == CommandFrame) {
+                signpost_networking_publish_batch_reply(source_address, rc);
+            }
         }
     }
 }
@@ -517,6 +626,8 @@ int main (void) {
     delay_ms(1000);
     rc = sara_u260_init();
 
+    rng_sync(&topic_epoch, 1, 1);
+
     status_send_buf[0] = strlen("signpost/radio/status");
     memcpy(status_send_buf+1,"signpost/radio/status",strlen("signpost/radio/status"));
     status_length_offset = 1 + strlen("signpost/radio/status");
@@ -536,6 +647,7 @@ int main (void) {
         if(lora_state != LORA_JOINED) {
             join_lora_network();
         }
-        yield();
+        // publish requests are delivered from the loop while waiting
+        signpost_reactor_delay_ms(1000);
     }
 }
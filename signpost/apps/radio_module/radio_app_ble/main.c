@@ -19,6 +19,7 @@
 
 //tock includes
 #include <signpost_api.h>
+#include <signpost_reactor.h>
 #include "tock.h"
 #include "console.h"
 #include "timer.h"
@@ -645,6 +646,7 @@ int main (void) {
         if(lora_state != LORA_JOINED) {
             join_lora_network();
         }
-        yield();
+        // publish requests are delivered from the loop while waiting
+        signpost_reactor_delay_ms(1000);
     }
 }
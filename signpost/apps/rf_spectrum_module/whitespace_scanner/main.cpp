@@ -3,6 +3,7 @@
 
 #include "port_signpost.h"
 #include "signpost_api.h"
+#include "signpost_payloads.h"
 #include "signbus_io_interface.h"
 #include "board.h"
 
@@ -23,20 +24,28 @@ static int8_t bin_std[80] = {0};
 static int8_t bin_mean[80] = {0};
 
 static void send_packets(void) {
-    static uint8_t send_buf[80];
+    static uint8_t send_buf[SIGNPOST_PAYLOAD_WS_SPECTRUM_LEN];
+    signpost_payload_ws_spectrum_t spectrum;
     int ret;
 
-    memcpy(send_buf,bin_max,80);
-    ret = signpost_networking_publish("ws_max",send_buf,81);
+    // queue all three and send them to the radio in one message
+    memcpy(spectrum.channels,bin_max,80);
+    signpost_payload_ws_spectrum_encode(&spectrum,send_buf,sizeof(send_buf));
+    ret = signpost_networking_publish_batched("ws_max",send_buf,sizeof(send_buf));
     if(ret < 0 ) printf("Sending max error!\n");
 
-    memcpy(send_buf,bin_mean,80);
-    ret = signpost_networking_publish("ws_mean",send_buf,81);
+    memcpy(spectrum.channels,bin_mean,80);
+    signpost_payload_ws_spectrum_encode(&spectrum,send_buf,sizeof(send_buf));
+    ret = signpost_networking_publish_batched("ws_mean",send_buf,sizeof(send_buf));
     if(ret < 0 ) printf("Sending mean error!\n");
 
-    memcpy(send_buf,bin_std,80);
-    ret = signpost_networking_publish("ws_std",send_buf,81);
+    memcpy(spectrum.channels,bin_std,80);
+    signpost_payload_ws_spectrum_encode(&spectrum,send_buf,sizeof(send_buf));
+    ret = signpost_networking_publish_batched("ws_std",send_buf,sizeof(send_buf));
     if(ret < 0 ) printf("Sending std error!\n");
+
+    ret = signpost_networking_flush();
+    if(ret < 0 ) printf("Sending batch error!\n");
 }
 
 int main(void) {
@@ -14,12 +14,61 @@
 
 #include "app_watchdog.h"
 #include "signpost_api.h"
+#include "signpost_reactor.h"
 #include "signpost_storage.h"
+#include "storage_batch.h"
 #include "storage_master.h"
 #include "port_signpost.h"
 
 #define DEBUG_RED_LED 0
 
+// Clients tag each write with a token and resend it under the same token if
+// our reply is lost. Remember the last token and resulting record for each
+// module and log, so a resent write is acknowledged without appending again.
+#define WRITE_TOKEN_ENTRIES 16
+
+typedef struct {
+  bool valid;
+  uint8_t source_address;
+  uint32_t token;
+  Storage_Record_t record;
+} write_token_t;
+
+static write_token_t write_tokens[WRITE_TOKEN_ENTRIES];
+static size_t write_token_next = 0;
+
+static write_token_t* write_token_lookup(uint8_t source_address, const char* logname) {
+  for (size_t i = 0; i < WRITE_TOKEN_ENTRIES; i++) {
+    write_token_t* entry = &write_tokens[i];
+    if (entry->valid && entry->source_address == source_address &&
+        !strncmp(entry->record.logname, logname, STORAGE_LOG_LEN)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void write_token_save(write_token_t* entry, uint8_t source_address,
+    uint32_t token, Storage_Record_t* record) {
+  if (entry == NULL) {
+    // replace the oldest entry
+    entry = &write_tokens[write_token_next];
+    write_token_next = (write_token_next + 1) % WRITE_TOKEN_ENTRIES;
+  }
+  entry->valid = true;
+  entry->source_address = source_address;
+  entry->token = token;
+  memcpy(&entry->record, record, sizeof(Storage_Record_t));
+}
+
+// records acknowledged by a batch write
+static Storage_Record_t batch_records[SIGNPOST_STORAGE_BATCH_MAX];
+// records listed by a scan page request
+static Storage_Record_t scan_page[SIGNPOST_STORAGE_SCAN_PAGE];
+
+// [offset][data] for read replies
+static uint8_t read_chunk[sizeof(uint32_t) + SIGNPOST_STORAGE_READ_CHUNK];
+
 static void storage_api_callback(uint8_t source_address,
     signbus_frame_type_t frame_type, signbus_api_type_t api_type,
     uint8_t message_type, size_t message_length, uint8_t* message) {
@@ -48,6 +97,8 @@ static void storage_api_callback(uint8_t source_address,
       // unmarshal sent data into list_len
       size_t list_len = *(size_t*) message;
       printf("got request for %u records\n", list_len);
+      // the client picks the length, so bound the list and the reply
+      if (list_len > SIGNPOST_STORAGE_SCAN_PAGE) list_len = SIGNPOST_STORAGE_SCAN_PAGE;
       Storage_Record_t* list = malloc(list_len * sizeof(Storage_Record_t));
       if (list == NULL) {
         printf("Not enough memory to store record list of length %u\n", list_len);
@@ -75,19 +126,98 @@ static void storage_api_callback(uint8_t source_address,
       }
     }
 
+    else if (message_type == StorageScanPageMessage) {
+      // unmarshal sent data into max, after and prefix
+      // [max][after\0][prefix\0]
+      if (message_length < 3) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      size_t max = message[0];
+      if (max > SIGNPOST_STORAGE_SCAN_PAGE) max = SIGNPOST_STORAGE_SCAN_PAGE;
+      char after[STORAGE_LOG_LEN+1] = {0};
+      char prefix[STORAGE_LOG_LEN+1] = {0};
+      char* name = (char*) message + 1;
+      size_t name_space = message_length - 1;
+      size_t after_len = strnlen(name, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+      if (after_len >= name_space || name[after_len] != '\0') {
+        printf("Name is not terminated\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(after, name, after_len);
+      name += after_len + 1;
+      name_space -= after_len + 1;
+      memcpy(prefix, name, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+
+      printf("Scanning after '%s' for '%s'\n", after, prefix);
+      size_t list_len = 0;
+      bool more = false;
+      err = storage_scan_page(after, prefix, scan_page, &list_len, max, &more);
+      if (err < TOCK_SUCCESS) {
+        printf("Scanning error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+
+      // send response
+      err = signpost_storage_scan_page_reply(source_address, more, scan_page, list_len);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+    }
+
     else if (message_type == StorageWriteMessage) {
-      // unmarshal sent data into logname and data
-      char logname[STORAGE_LOG_LEN+1];
-      strncpy(logname, (char*) message, STORAGE_LOG_LEN);
-      size_t logname_len = strnlen(logname, STORAGE_LOG_LEN);
-      // if the expected size of the message is greater than its length
-      if (logname_len + sizeof(size_t) + 1 > message_length) {
-        printf("Failed to allocate enough memory\n");
-        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ENOMEM, true, true, 1);
+      // unmarshal sent data into token, durability, logname and data
+      // [token][durability][logname\0][data]
+      uint32_t token;
+      size_t header_len = sizeof(token) + 1;
+      if (message_length < header_len + 1) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(&token, message, sizeof(token));
+      uint8_t durability = message[sizeof(token)];
+      if (durability > StorageDurabilityLazy) {
+        printf("Unknown durability %d\n", durability);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_EINVAL, true, true, 1);
+        return;
+      }
+      char* name = (char*) message + header_len;
+      size_t name_space = message_length - header_len;
+      size_t logname_len = strnlen(name, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+      // the logname must be terminated within the message
+      if (logname_len >= name_space || name[logname_len] != '\0') {
+        printf("Logname is not terminated\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      char logname[STORAGE_LOG_LEN+1] = {0};
+      memcpy(logname, name, logname_len);
+      uint8_t* data = (uint8_t*) name + logname_len + 1;
+      size_t data_len = name_space - logname_len - 1;
+
+      // a resend of a write we already did, acknowledge it again
+      write_token_t* previous = write_token_lookup(source_address, logname);
+      if (previous != NULL && previous->token == token) {
+        printf("Duplicate write %lx, not appending\n", token);
+        // its sync may be what failed
+        if (durability == StorageDurabilityImmediate) {
+          err = storage_flush_data(logname);
+          if (err < TOCK_SUCCESS) {
+            signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+            return;
+          }
+        }
+        err = signpost_storage_write_reply(source_address, &previous->record);
+        if (err < TOCK_SUCCESS) {
+          signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        }
         return;
       }
-      uint8_t* data = message + logname_len + 1;
-      size_t data_len = message_length - logname_len - 1;
 
       printf("Writing data\n");
 
@@ -97,12 +227,23 @@ static void storage_api_callback(uint8_t source_address,
       write_record.length = data_len;
       size_t bytes_written = 0;
 
-      err = storage_write_data(logname, data, data_len, data_len, &bytes_written, &write_record.offset);
+      err = storage_write_durable(logname, data, data_len, data_len, &bytes_written, &write_record.offset, durability);
       if (err < TOCK_SUCCESS || bytes_written < data_len) {
         printf("Writing error: %d\n", err);
         signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
         return;
       }
+      write_token_save(previous, source_address, token, &write_record);
+
+      // on the card before it is acknowledged
+      if (durability == StorageDurabilityImmediate) {
+        err = storage_flush_data(logname);
+        if (err < TOCK_SUCCESS) {
+          printf("Sync error: %d\n", err);
+          signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+          return;
+        }
+      }
 
       // send response
       err = signpost_storage_write_reply(source_address, &write_record);
@@ -112,54 +253,188 @@ static void storage_api_callback(uint8_t source_address,
       }
     }
 
-    else if (message_type == StorageReadMessage) {
-      // unmarshal sent data into logname, offset, and length
-      char logname[STORAGE_LOG_LEN+1];
-      strncpy(logname, (char*) message, STORAGE_LOG_LEN);
-      size_t logname_len = strnlen(logname, STORAGE_LOG_LEN);
-      // if the expected size of the message is greater than its length
-      if (logname_len + sizeof(size_t)*2 + 2 > message_length) {
-        printf("Failed to allocate enough memory\n");
-        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ENOMEM, true, true, 1);
+    else if (message_type == StorageWriteBatchMessage) {
+      printf("Writing batch\n");
+
+      size_t record_count = 0;
+      err = storage_write_batch(source_address, message, message_length, batch_records, &record_count);
+      if (err < TOCK_SUCCESS) {
+        printf("Writing error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
         return;
       }
-      size_t offset = *((size_t*) (message + logname_len + 1));
-      for (size_t i=0; i<sizeof(offset); i++) {
-        printf("%2x", *(message + logname_len + 1 + i));
+
+      // send response
+      err = signpost_storage_write_batch_reply(source_address, batch_records, record_count);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
       }
-      printf("\n");
-      size_t length = *((size_t*) (message + logname_len + 2 + sizeof(size_t)));
-      for (size_t i=0; i<sizeof(length); i++) {
-        printf("%2x", *(message + logname_len + 2 + sizeof(offset) + i));
+    }
+
+    else if (message_type == StorageWriteTimedMessage) {
+      // unmarshal sent data into token, timestamp, logname and data
+      // [token][timestamp][logname\0][data]
+      uint32_t token;
+      uint32_t timestamp;
+      size_t header_len = sizeof(token) + sizeof(timestamp);
+      if (message_length < header_len + 1) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(&token, message, sizeof(token));
+      memcpy(&timestamp, message + sizeof(token), sizeof(timestamp));
+      char* name = (char*) message + header_len;
+      size_t name_space = message_length - header_len;
+      size_t logname_len = strnlen(name, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+      // the logname must be terminated within the message
+      if (logname_len >= name_space || name[logname_len] != '\0') {
+        printf("Logname is not terminated\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
       }
-      printf("\n");
-      //printf("%d %d %d\n", offset, length, logname_len);
+      char logname[STORAGE_LOG_LEN+1] = {0};
+      memcpy(logname, name, logname_len);
+      uint8_t* data = (uint8_t*) name + logname_len + 1;
+      size_t data_len = name_space - logname_len - 1;
 
-      printf("Reading data\n");
-      // read data from storage
-      size_t bytes_read= 0;
-      //XXX this is potentially dangerous, should eventually define limits:
-      uint8_t* data = (uint8_t*) malloc(length);
-      if (data == NULL) {
-        printf("Failed to allocate enough memory\n");
-        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ENOMEM, true, true, 1);
+      // a resend of a write we already did, acknowledge it again
+      write_token_t* previous = write_token_lookup(source_address, logname);
+      if (previous != NULL && previous->token == token) {
+        printf("Duplicate write %lx, not appending\n", token);
+        err = signpost_storage_write_reply(source_address, &previous->record);
+        if (err < TOCK_SUCCESS) {
+          signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        }
         return;
       }
 
-      err = storage_read_data(logname, offset, data, length, length, &bytes_read);
-      if (err < TOCK_SUCCESS || bytes_read < length) {
-        printf("Reading error: %d\n", err);
+      printf("Writing timed data\n");
+
+      // write record to storage
+      Storage_Record_t write_record = {0};
+      strncpy(write_record.logname, logname, STORAGE_LOG_LEN);
+      err = storage_write_timed(logname, timestamp, data, data_len, &write_record.offset, &write_record.length);
+      if (err < TOCK_SUCCESS) {
+        printf("Writing error: %d\n", err);
         signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
-        free(data);
         return;
       }
+      write_token_save(previous, source_address, token, &write_record);
 
       // send response
-      err = signpost_storage_read_reply(source_address, data, length);
-      free(data);
+      err = signpost_storage_write_reply(source_address, &write_record);
       if (err < TOCK_SUCCESS) {
         signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+    }
 
+    else if (message_type == StorageQueryRangeMessage) {
+      // unmarshal sent data into start, end and logname
+      // [start][end][logname\0]
+      uint32_t start;
+      uint32_t end;
+      size_t header_len = sizeof(start) + sizeof(end);
+      if (message_length <= header_len) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(&start, message, sizeof(start));
+      memcpy(&end, message + sizeof(start), sizeof(end));
+      Storage_Record_t range_record = {0};
+      size_t name_space = message_length - header_len;
+      memcpy(range_record.logname, message + header_len, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+
+      printf("Querying %lu to %lu\n", start, end);
+      err = storage_query_range(range_record.logname, start, end, &range_record.offset, &range_record.length);
+      if (err < TOCK_SUCCESS) {
+        printf("Query error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+
+      // send response
+      err = signpost_storage_write_reply(source_address, &range_record);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+    }
+
+    else if (message_type == StorageAggregateMessage) {
+      // unmarshal sent data into range, query and logname
+      // [offset][length][query][logname\0]
+      uint32_t offset;
+      uint32_t length;
+      signpost_storage_aggregate_query_t query;
+      size_t header_len = sizeof(offset) + sizeof(length) + sizeof(query);
+      if (message_length <= header_len) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(&offset, message, sizeof(offset));
+      memcpy(&length, message + sizeof(offset), sizeof(length));
+      memcpy(&query, message + sizeof(offset) + sizeof(length), sizeof(query));
+      char logname[STORAGE_LOG_LEN+1] = {0};
+      size_t name_space = message_length - header_len;
+      memcpy(logname, message + header_len, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+
+      printf("Aggregating %s\n", logname);
+      signpost_storage_aggregate_t result;
+      err = storage_aggregate(logname, offset, length, &query, &result);
+      if (err < TOCK_SUCCESS) {
+        printf("Aggregate error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+
+      // send response
+      err = signpost_storage_aggregate_reply(source_address, &result);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+    }
+
+    else if (message_type == StorageReadMessage) {
+      // unmarshal sent data into offset, length and logname
+      // [offset][length][logname\0]
+      uint32_t offset;
+      uint16_t length;
+      size_t header_len = sizeof(offset) + sizeof(length);
+      if (message_length <= header_len) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(&offset, message, sizeof(offset));
+      memcpy(&length, message + sizeof(offset), sizeof(length));
+      char logname[STORAGE_LOG_LEN+1] = {0};
+      size_t name_space = message_length - header_len;
+      memcpy(logname, message + header_len, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+
+      // reads are served a chunk at a time from one buffer
+      if (length > SIGNPOST_STORAGE_READ_CHUNK) length = SIGNPOST_STORAGE_READ_CHUNK;
+
+      printf("Reading data\n");
+      // read data from storage
+      size_t bytes_read = 0;
+      err = storage_read_data(logname, offset, read_chunk + sizeof(offset), length, length, &bytes_read);
+      if (err < TOCK_SUCCESS) {
+        printf("Reading error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+
+      // send response, a short chunk tells the client the log ended
+      memcpy(read_chunk, &offset, sizeof(offset));
+      err = signpost_storage_read_reply(source_address, read_chunk, sizeof(offset) + bytes_read);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
         return;
       }
     }
@@ -181,6 +456,66 @@ static void storage_api_callback(uint8_t source_address,
         return;
       }
     }
+
+    else if (message_type == StorageFlushMessage) {
+      // an empty logname flushes every log
+      Storage_Record_t flushed_record = {0};
+      size_t logname_len = message_length < STORAGE_LOG_LEN ? message_length : STORAGE_LOG_LEN;
+      memcpy(flushed_record.logname, message, logname_len);
+
+      printf("Flushing data\n");
+      err = storage_flush_data(flushed_record.logname);
+      if (err < TOCK_SUCCESS) {
+        printf("Flushing error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+
+      // send response
+      err = signpost_storage_flush_reply(source_address, &flushed_record);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+    }
+
+    else if (message_type == StorageCircularMessage) {
+      // unmarshal sent data into capacity and logname
+      // [capacity][logname\0]
+      uint32_t capacity;
+      if (message_length <= sizeof(capacity)) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(&capacity, message, sizeof(capacity));
+      Storage_Record_t circular_record = {0};
+      size_t name_space = message_length - sizeof(capacity);
+      memcpy(circular_record.logname, message + sizeof(capacity), name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+
+      printf("Making %s circular, %lu bytes\n", circular_record.logname, capacity);
+      size_t start = 0;
+      size_t end = 0;
+      err = storage_circular_create(circular_record.logname, capacity, &start, &end);
+      if (err < TOCK_SUCCESS) {
+        printf("Circular error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+      circular_record.offset = start;
+      circular_record.length = end - start;
+
+      // send response
+      err = signpost_storage_set_circular_reply(source_address, &circular_record);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+    }
+    else {
+      printf("Unknown storage message type %d\n", message_type);
+      signpost_api_error_reply_repeating(source_address, api_type, message_type, PORT_ENOSUPPORT, true, true, 1);
+    }
   } else if (frame_type == ResponseFrame) {
     // XXX unexpected, drop
   } else if (frame_type == ErrorFrame) {
@@ -220,5 +555,8 @@ int main (void) {
   //app_watchdog_start();
 
   printf("\nStorage Master initialization complete\n");
+
+  // keep the event loop running so open files are synced on time
+  signpost_reactor_run();
 }
 
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <tock.h>
+
+#include "signpost_storage.h"
+#include "storage_batch.h"
+
+// Batched writes are remembered per module. Logs are appended in message
+// order, and the offset each log was appended at is kept so a resend is
+// acknowledged with the same records, and a batch that failed partway
+// only appends the logs it had not reached.
+#define BATCH_TOKEN_ENTRIES 4
+
+typedef struct {
+  bool valid;
+  uint8_t source_address;
+  uint32_t token;
+  size_t logs_written;
+  size_t offsets[SIGNPOST_STORAGE_BATCH_MAX];
+} batch_token_t;
+
+static batch_token_t batch_tokens[BATCH_TOKEN_ENTRIES];
+static size_t batch_token_next = 0;
+
+static batch_token_t* batch_token_lookup(uint8_t source_address, uint32_t token) {
+  batch_token_t* entry = NULL;
+  for (size_t i = 0; i < BATCH_TOKEN_ENTRIES; i++) {
+    if (batch_tokens[i].valid && batch_tokens[i].source_address == source_address) {
+      entry = &batch_tokens[i];
+      break;
+    }
+  }
+  if (entry == NULL) {
+    // replace the oldest entry
+    entry = &batch_tokens[batch_token_next];
+    batch_token_next = (batch_token_next + 1) % BATCH_TOKEN_ENTRIES;
+  }
+  if (!entry->valid || entry->source_address != source_address || entry->token != token) {
+    entry->valid = true;
+    entry->source_address = source_address;
+    entry->token = token;
+    entry->logs_written = 0;
+  }
+  return entry;
+}
+
+int storage_write_batch(uint8_t source_address, uint8_t* message, size_t message_length,
+    Storage_Record_t* records, size_t* record_count) {
+  uint32_t token;
+  if (message_length < sizeof(token) + 1) return TOCK_ESIZE;
+  memcpy(&token, message, sizeof(token));
+  size_t log_count = message[sizeof(token)];
+  if (log_count > SIGNPOST_STORAGE_BATCH_MAX) return TOCK_ESIZE;
+
+  batch_token_t* entry = batch_token_lookup(source_address, token);
+  if (entry->logs_written > 0) {
+    printf("Resent batch %lx, %u logs already written\n", (unsigned long)token, (unsigned)entry->logs_written);
+  }
+
+  uint8_t* pos = message + sizeof(token) + 1;
+  uint8_t* end = message + message_length;
+  *record_count = 0;
+  for (size_t log = 0; log < log_count; log++) {
+    // logname must be terminated within the message
+    size_t space = end - pos;
+    size_t logname_len = strnlen((char*) pos, space < STORAGE_LOG_LEN ? space : STORAGE_LOG_LEN);
+    if (logname_len >= space || pos[logname_len] != '\0') return TOCK_ESIZE;
+    char logname[STORAGE_LOG_LEN+1] = {0};
+    memcpy(logname, pos, logname_len);
+    pos += logname_len + 1;
+
+    if (pos >= end) return TOCK_ESIZE;
+    size_t count = *pos++;
+    if (*record_count + count > SIGNPOST_STORAGE_BATCH_MAX ||
+        (size_t)(end - pos) < count * sizeof(uint16_t)) return TOCK_ESIZE;
+
+    size_t data_len = 0;
+    for (size_t i = 0; i < count; i++) {
+      uint16_t len;
+      memcpy(&len, pos + i*sizeof(uint16_t), sizeof(len));
+      Storage_Record_t* record = &records[*record_count + i];
+      memset(record, 0, sizeof(Storage_Record_t));
+      strncpy(record->logname, logname, STORAGE_LOG_LEN);
+      record->offset = data_len;
+      record->length = len;
+      data_len += len;
+    }
+    pos += count * sizeof(uint16_t);
+    if ((size_t)(end - pos) < data_len) return TOCK_ESIZE;
+
+    // the records of a log are contiguous, so each log is one write
+    if (log >= entry->logs_written) {
+      size_t bytes_written = 0;
+      int err = storage_write_data(logname, pos, data_len, data_len, &bytes_written, &entry->offsets[log]);
+      if (err < TOCK_SUCCESS) return err;
+      if (bytes_written < data_len) return TOCK_FAIL;
+      entry->logs_written = log + 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+      records[*record_count + i].offset += entry->offsets[log];
+    }
+
+    pos += data_len;
+    *record_count += count;
+  }
+
+  return TOCK_SUCCESS;
+}
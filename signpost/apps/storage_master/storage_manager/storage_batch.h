@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "signpost_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Write a batch of records from source_address, one log at a time
+// [token][log count] then for each log
+// [logname\0][record count][record lengths][record data]
+//
+// records must hold SIGNPOST_STORAGE_BATCH_MAX records, and is filled with
+// record_count records in message order. A batch resent under the same token
+// is acknowledged with the same records, and only the logs it had not
+// reached are appended.
+int storage_write_batch(uint8_t source_address, uint8_t* message, size_t message_length,
+    Storage_Record_t* records, size_t* record_count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,11 +19,18 @@
 #include "storage_master.h"
 #include "signpost_storage.h"
 #include "port_signpost.h"
+#include "signpost_reactor.h"
 
 // buffer for holding i2c slave read data
 #define SLAVE_READ_LEN 512
 static uint8_t slave_read_buf[SLAVE_READ_LEN] = {0};
 
+// [offset][data] for read replies
+static uint8_t read_chunk[sizeof(uint32_t) + SIGNPOST_STORAGE_READ_CHUNK];
+
+// records listed by a scan page request
+static Storage_Record_t scan_page[SIGNPOST_STORAGE_SCAN_PAGE];
+
 static void edison_wakeup(void) {
     gpio_clear(2);
     delay_ms(100);
@@ -183,6 +190,8 @@ static void storage_api_callback(uint8_t source_address,
       // unmarshal sent data into list_len
       size_t list_len = *(size_t*) message;
       printf("got request for %u records\n", list_len);
+      // the client picks the length, so bound the list and the reply
+      if (list_len > SIGNPOST_STORAGE_SCAN_PAGE) list_len = SIGNPOST_STORAGE_SCAN_PAGE;
       Storage_Record_t* list = malloc(list_len * sizeof(Storage_Record_t));
       if (list == NULL) {
         printf("Not enough memory to store record list of length %u\n", list_len);
@@ -210,15 +219,74 @@ static void storage_api_callback(uint8_t source_address,
       }
     }
 
+    else if (message_type == StorageScanPageMessage) {
+      // unmarshal sent data into max, after and prefix
+      // [max][after\0][prefix\0]
+      if (message_length < 3) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      size_t max = message[0];
+      if (max > SIGNPOST_STORAGE_SCAN_PAGE) max = SIGNPOST_STORAGE_SCAN_PAGE;
+      char after[STORAGE_LOG_LEN+1] = {0};
+      char prefix[STORAGE_LOG_LEN+1] = {0};
+      char* name = (char*) message + 1;
+      size_t name_space = message_length - 1;
+      size_t after_len = strnlen(name, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+      if (after_len >= name_space || name[after_len] != '\0') {
+        printf("Name is not terminated\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      memcpy(after, name, after_len);
+      name += after_len + 1;
+      name_space -= after_len + 1;
+      memcpy(prefix, name, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+
+      printf("Scanning after '%s' for '%s'\n", after, prefix);
+      size_t list_len = 0;
+      bool more = false;
+      err = storage_scan_page(after, prefix, scan_page, &list_len, max, &more);
+      if (err < TOCK_SUCCESS) {
+        printf("Scanning error: %d\n", err);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+
+      // send response
+      err = signpost_storage_scan_page_reply(source_address, more, scan_page, list_len);
+      if (err < TOCK_SUCCESS) {
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+        return;
+      }
+    }
+
     else if (message_type == StorageWriteMessage) {
-      // unmarshal sent data into logname and data
-      char logname[STORAGE_LOG_LEN+1];
+      // unmarshal sent data into durability, logname and data, skipping
+      // the write token
+      // [token][durability][logname\0][data]
+      size_t header_len = sizeof(uint32_t) + 1;
+      if (message_length < header_len + 1) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
+        return;
+      }
+      uint8_t durability = message[sizeof(uint32_t)];
+      if (durability > StorageDurabilityLazy) {
+        printf("Unknown durability %d\n", durability);
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_EINVAL, true, true, 1);
+        return;
+      }
+      message += header_len;
+      message_length -= header_len;
+      char logname[STORAGE_LOG_LEN+1] = {0};
       strncpy(logname, (char*) message, STORAGE_LOG_LEN);
       size_t logname_len = strnlen(logname, STORAGE_LOG_LEN);
       // if the expected size of the message is greater than its length
-      if (logname_len + sizeof(size_t) + 1 > message_length) {
-        printf("Failed to allocate enough memory\n");
-        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ENOMEM, true, true, 1);
+      if (logname_len + 1 > message_length) {
+        printf("Logname is not terminated\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
         return;
       }
       uint8_t* data = message + logname_len + 1;
@@ -232,13 +300,23 @@ static void storage_api_callback(uint8_t source_address,
       write_record.length = data_len;
       size_t bytes_written = 0;
 
-      err = storage_write_data(logname, data, data_len, data_len, &bytes_written, &write_record.offset);
+      err = storage_write_durable(logname, data, data_len, data_len, &bytes_written, &write_record.offset, durability);
       if (err < TOCK_SUCCESS || bytes_written < data_len) {
         printf("Writing error: %d\n", err);
         signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
         return;
       }
 
+      // on the card before it is acknowledged
+      if (durability == StorageDurabilityImmediate) {
+        err = storage_flush_data(logname);
+        if (err < TOCK_SUCCESS) {
+          printf("Sync error: %d\n", err);
+          signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
+          return;
+        }
+      }
+
       // send response
       err = signpost_storage_write_reply(source_address, &write_record);
       if (err < TOCK_SUCCESS) {
@@ -248,53 +326,40 @@ static void storage_api_callback(uint8_t source_address,
     }
 
     else if (message_type == StorageReadMessage) {
-      // unmarshal sent data into logname, offset, and length
-      char logname[STORAGE_LOG_LEN+1];
-      strncpy(logname, (char*) message, STORAGE_LOG_LEN);
-      size_t logname_len = strnlen(logname, STORAGE_LOG_LEN);
-      // if the expected size of the message is greater than its length
-      if (logname_len + sizeof(size_t)*2 + 2 > message_length) {
-        printf("Failed to allocate enough memory\n");
-        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ENOMEM, true, true, 1);
+      // unmarshal sent data into offset, length and logname
+      // [offset][length][logname\0]
+      uint32_t offset;
+      uint16_t length;
+      size_t header_len = sizeof(offset) + sizeof(length);
+      if (message_length <= header_len) {
+        printf("Message length is too small\n");
+        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ESIZE, true, true, 1);
         return;
       }
-      size_t offset = *((size_t*) (message + logname_len + 1));
-      for (size_t i=0; i<sizeof(offset); i++) {
-        printf("%2x", *(message + logname_len + 1 + i));
-      }
-      printf("\n");
-      size_t length = *((size_t*) (message + logname_len + 2 + sizeof(size_t)));
-      for (size_t i=0; i<sizeof(length); i++) {
-        printf("%2x", *(message + logname_len + 2 + sizeof(offset) + i));
-      }
-      printf("\n");
-      //printf("%d %d %d\n", offset, length, logname_len);
+      memcpy(&offset, message, sizeof(offset));
+      memcpy(&length, message + sizeof(offset), sizeof(length));
+      char logname[STORAGE_LOG_LEN+1] = {0};
+      size_t name_space = message_length - header_len;
+      memcpy(logname, message + header_len, name_space < STORAGE_LOG_LEN ? name_space : STORAGE_LOG_LEN);
+
+      // reads are served a chunk at a time from one buffer
+      if (length > SIGNPOST_STORAGE_READ_CHUNK) length = SIGNPOST_STORAGE_READ_CHUNK;
 
       printf("Reading data\n");
       // read data from storage
-      size_t bytes_read= 0;
-      //XXX this is potentially dangerous, should eventually define limits:
-      uint8_t* data = (uint8_t*) malloc(length);
-      if (data == NULL) {
-        printf("Failed to allocate enough memory\n");
-        signpost_api_error_reply_repeating(source_address, api_type, message_type, TOCK_ENOMEM, true, true, 1);
-        return;
-      }
-
-      err = storage_read_data(logname, offset, data, length, length, &bytes_read);
-      if (err < TOCK_SUCCESS || bytes_read < length) {
+      size_t bytes_read = 0;
+      err = storage_read_data(logname, offset, read_chunk + sizeof(offset), length, length, &bytes_read);
+      if (err < TOCK_SUCCESS) {
         printf("Reading error: %d\n", err);
         signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
-        free(data);
         return;
       }
 
-      // send response
-      err = signpost_storage_read_reply(source_address, data, length);
-      free(data);
+      // send response, a short chunk tells the client the log ended
+      memcpy(read_chunk, &offset, sizeof(offset));
+      err = signpost_storage_read_reply(source_address, read_chunk, sizeof(offset) + bytes_read);
       if (err < TOCK_SUCCESS) {
         signpost_api_error_reply_repeating(source_address, api_type, message_type, err, true, true, 1);
-
         return;
       }
     }
@@ -316,6 +381,10 @@ static void storage_api_callback(uint8_t source_address,
         return;
       }
     }
+    else {
+      printf("Unknown storage message type %d\n", message_type);
+      signpost_api_error_reply_repeating(source_address, api_type, message_type, PORT_ENOSUPPORT, true, true, 1);
+    }
   } else if (frame_type == ResponseFrame) {
     // XXX unexpected, drop
   } else if (frame_type == ErrorFrame) {
@@ -380,5 +449,8 @@ int main (void) {
   //app_watchdog_start();
 
   printf("\nStorage Master initialization complete\n");
+
+  // handle messages from the loop
+  signpost_reactor_run();
 }
 
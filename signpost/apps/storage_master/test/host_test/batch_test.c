@@ -0,0 +1,157 @@
+// Resend test for storage master batch writes
+//
+// Fails a batch partway through by putting a directory where one of its
+// logs should be, then resends it under the same token and checks that only
+// the logs it had not reached are appended, and that every record is
+// acknowledged as if the batch had gone through the first time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff.h"
+#include "host_disk.h"
+#include "signpost_storage.h"
+#include "storage_batch.h"
+#include "tock.h"
+
+#define LOGS 3
+#define MODULE 0x20
+#define OTHER_MODULE 0x21
+
+static const char* lognames[LOGS] = {"batch_a", "batch_b", "batch_c"};
+// records per log, and their lengths
+static const size_t counts[LOGS] = {2, 1, 1};
+static const uint16_t lengths[LOGS][2] = {{10, 20}, {30, 0}, {40, 0}};
+#define RECORDS 4
+
+static size_t sizes[LOGS];
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      failures++; \
+    } \
+  } while (0)
+
+// [token][log count] then for each log
+// [logname\0][record count][record lengths][record data]
+static size_t marshal(uint8_t* message, uint32_t token) {
+  size_t pos = 0;
+  memcpy(message, &token, sizeof(token));
+  pos += sizeof(token);
+  message[pos++] = LOGS;
+  for (size_t log = 0; log < LOGS; log++) {
+    size_t logname_len = strlen(lognames[log]);
+    memcpy(message + pos, lognames[log], logname_len + 1);
+    pos += logname_len + 1;
+    message[pos++] = counts[log];
+    size_t data_len = 0;
+    for (size_t i = 0; i < counts[log]; i++) {
+      memcpy(message + pos, &lengths[log][i], sizeof(uint16_t));
+      pos += sizeof(uint16_t);
+      data_len += lengths[log][i];
+    }
+    memset(message + pos, 'a' + log, data_len);
+    pos += data_len;
+  }
+  return pos;
+}
+
+static size_t log_len(size_t log) {
+  size_t len = 0;
+  for (size_t i = 0; i < counts[log]; i++) {
+    len += lengths[log][i];
+  }
+  return len;
+}
+
+// Check the records acknowledge the batch appended at the given log sizes
+static void check_records(const char* step, Storage_Record_t* records, size_t record_count,
+    const size_t* at) {
+  CHECK(record_count == RECORDS, "%s: %zu records, want %d", step, record_count, RECORDS);
+  if (record_count != RECORDS) return;
+
+  size_t r = 0;
+  for (size_t log = 0; log < LOGS; log++) {
+    size_t offset = at[log];
+    for (size_t i = 0; i < counts[log]; i++, r++) {
+      CHECK(!strcmp(records[r].logname, lognames[log]), "%s: record %zu is for %s, want %s",
+          step, r, records[r].logname, lognames[log]);
+      CHECK(records[r].offset == offset && records[r].length == lengths[log][i],
+          "%s: record %zu is %zu bytes at %zu, want %u at %zu", step, r,
+          records[r].length, records[r].offset, lengths[log][i], offset);
+      offset += lengths[log][i];
+    }
+  }
+}
+
+static void check_sizes(const char* step) {
+  CHECK(storage_sync() == TOCK_SUCCESS, "%s: sync failed", step);
+  for (size_t log = 0; log < LOGS; log++) {
+    FILINFO fno;
+    FRESULT res = f_stat(lognames[log], &fno);
+    size_t size = res == FR_OK ? fno.fsize : 0;
+    CHECK(size == sizes[log], "%s: %s is %zu bytes, want %zu", step, lognames[log], size, sizes[log]);
+  }
+}
+
+int main(void) {
+  if (host_disk_init(NULL, HOST_DISK_SECTORS) < 0 || storage_initialize() < TOCK_SUCCESS) {
+    printf("cannot set up the disk image\n");
+    return 1;
+  }
+
+  static uint8_t message[SIGNPOST_STORAGE_BATCH_MAX_LEN];
+  Storage_Record_t records[SIGNPOST_STORAGE_BATCH_MAX];
+  size_t record_count = 0;
+  size_t at[LOGS] = {0};
+  size_t message_len = marshal(message, 1);
+
+  // the second log can't be written, so the batch fails after the first
+  CHECK(f_mkdir(lognames[1]) == FR_OK, "cannot make a directory in the way");
+  int rc = storage_write_batch(MODULE, message, message_len, records, &record_count);
+  CHECK(rc < TOCK_SUCCESS, "batch with a log in the way succeeded");
+  sizes[0] += log_len(0);
+  check_sizes("failed batch");
+
+  // a resend picks up where it stopped
+  CHECK(f_unlink(lognames[1]) == FR_OK, "cannot remove the directory");
+  rc = storage_write_batch(MODULE, message, message_len, records, &record_count);
+  CHECK(rc == TOCK_SUCCESS, "resent batch failed: %d", rc);
+  check_records("resent batch", records, record_count, at);
+  sizes[1] += log_len(1);
+  sizes[2] += log_len(2);
+  check_sizes("resent batch");
+
+  // and once it has gone through, a resend appends nothing
+  rc = storage_write_batch(MODULE, message, message_len, records, &record_count);
+  CHECK(rc == TOCK_SUCCESS, "batch resent again failed: %d", rc);
+  check_records("batch resent again", records, record_count, at);
+  check_sizes("batch resent again");
+
+  // a new token, or the same token from another module, is a new batch
+  for (size_t log = 0; log < LOGS; log++) {
+    at[log] = sizes[log];
+    sizes[log] += log_len(log);
+  }
+  message_len = marshal(message, 2);
+  rc = storage_write_batch(MODULE, message, message_len, records, &record_count);
+  CHECK(rc == TOCK_SUCCESS, "new batch failed: %d", rc);
+  check_records("new batch", records, record_count, at);
+
+  for (size_t log = 0; log < LOGS; log++) {
+    at[log] = sizes[log];
+    sizes[log] += log_len(log);
+  }
+  message_len = marshal(message, 1);
+  rc = storage_write_batch(OTHER_MODULE, message, message_len, records, &record_count);
+  CHECK(rc == TOCK_SUCCESS, "batch from another module failed: %d", rc);
+  check_records("batch from another module", records, record_count, at);
+  check_sizes("new batches");
+
+  printf("%d batch checks failed\n", failures);
+  return failures == 0 ? 0 : 1;
+}
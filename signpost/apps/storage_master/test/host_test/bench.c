@@ -0,0 +1,459 @@
+// Storage master benchmarks
+//
+// Runs the storage manager's file handling against a simulated card and
+// reports what each workload costs in card time, sectors and syncs. Card
+// time comes from the latency model in host_disk, so results are repeatable
+// and comparable between changes on any machine. Each case runs in its own
+// process on a freshly formatted image.
+//
+//   bench [-i image] [-l call_us,read_us,write_us,sync_us] [suite...]
+//
+// Suites are append, durability, mixed, scan and fragmentation, all by
+// default.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ff.h"
+#include "host_disk.h"
+#include "host_stubs.h"
+#include "signpost_storage.h"
+#include "tock.h"
+
+#define BENCH_DISK_SECTORS 65536
+#define APPEND_BYTES (256*1024)
+#define MIXED_OPS 4000
+#define FRAGMENT_BYTES (2*1024*1024)
+
+// results go here, stdout is quieted while the storage code runs
+static FILE* report;
+
+typedef struct {
+  uint64_t disk_us;
+  uint64_t cpu_us;
+  host_disk_stats_t stats;
+} sample_t;
+
+static uint64_t cpu_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sample_begin(sample_t* sample) {
+  sample->disk_us = host_disk_time_us();
+  sample->cpu_us = cpu_now_us();
+  sample->stats = host_disk_stats;
+}
+
+static void sample_end(sample_t* sample) {
+  sample->disk_us = host_disk_time_us() - sample->disk_us;
+  sample->cpu_us = cpu_now_us() - sample->cpu_us;
+  sample->stats.sectors_read = host_disk_stats.sectors_read - sample->stats.sectors_read;
+  sample->stats.sectors_written = host_disk_stats.sectors_written - sample->stats.sectors_written;
+  sample->stats.read_calls = host_disk_stats.read_calls - sample->stats.read_calls;
+  sample->stats.write_calls = host_disk_stats.write_calls - sample->stats.write_calls;
+  sample->stats.syncs = host_disk_stats.syncs - sample->stats.syncs;
+}
+
+static double ms(uint64_t us) {
+  return us / 1000.0;
+}
+
+// KB per second of card time
+static double rate(size_t bytes, uint64_t us) {
+  return us == 0 ? 0 : (bytes / 1024.0) / (us / 1000000.0);
+}
+
+static void fail(const char* what, int32_t rc) {
+  fprintf(report, "%s failed: %d\n", what, (int)rc);
+  fflush(report);
+  _exit(1);
+}
+
+static void write_log(const char* name, uint8_t* buf, size_t len, uint8_t durability) {
+  size_t bytes_written = 0;
+  size_t offset = 0;
+  int32_t rc = storage_write_durable(name, buf, len, len, &bytes_written, &offset, durability);
+  if (rc < TOCK_SUCCESS || bytes_written != len) fail("write", rc);
+  if (durability == StorageDurabilityImmediate) {
+    rc = storage_flush_data(name);
+    if (rc < TOCK_SUCCESS) fail("flush", rc);
+  }
+  host_timers_run();
+}
+
+// Run fn in a child process on a fresh image
+static void run_case(void (*fn)(size_t), size_t arg) {
+  host_disk_restore();
+  fflush(stdout);
+  fflush(report);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stdout) == NULL) _exit(1);
+    int32_t rc = storage_initialize();
+    if (rc < TOCK_SUCCESS) fail("initialize", rc);
+    fn(arg);
+    fflush(report);
+    _exit(0);
+  }
+
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(report, "case failed\n");
+  }
+}
+
+/**************************************************************************/
+/* APPEND                                                                 */
+/**************************************************************************/
+
+static const size_t record_sizes[] = {16, 64, 256, 1024, 4096};
+static const char* durability_names[] = {"group", "immediate", "lazy"};
+
+static void append(size_t record_size, uint8_t durability, size_t total) {
+  static uint8_t buf[4096];
+  memset(buf, 0x5A, sizeof(buf));
+
+  sample_t sample;
+  sample_begin(&sample);
+  size_t records = total / record_size;
+  for (size_t i = 0; i < records; i++) {
+    write_log("append", buf, record_size, durability);
+  }
+  int32_t rc = storage_sync();
+  if (rc < TOCK_SUCCESS) fail("sync", rc);
+  sample_end(&sample);
+
+  size_t bytes = records * record_size;
+  fprintf(report, "%6zu %-10s %8zu %10.1f %8.1f %10.2f %8u %6u %8.1f\n",
+      record_size, durability_names[durability], records, ms(sample.disk_us), rate(bytes, sample.disk_us),
+      sample.stats.sectors_written / (bytes / 1024.0), sample.stats.write_calls, sample.stats.syncs,
+      ms(sample.cpu_us));
+}
+
+static void append_case(size_t i) {
+  append(record_sizes[i], StorageDurabilityGroup, APPEND_BYTES);
+}
+
+static void durability_case(size_t durability) {
+  // immediate writes are slow enough that fewer show the difference
+  append(64, durability, APPEND_BYTES / 8);
+}
+
+static void append_header(void) {
+  fprintf(report, "%6s %-10s %8s %10s %8s %10s %8s %6s %8s\n",
+      "record", "durability", "records", "card ms", "KB/s", "sectors/KB", "writes", "syncs", "cpu ms");
+}
+
+static void suite_append(void) {
+  fprintf(report, "\nAppend throughput by record size, %d KB to one log\n", APPEND_BYTES / 1024);
+  append_header();
+  for (size_t i = 0; i < sizeof(record_sizes) / sizeof(record_sizes[0]); i++) {
+    run_case(append_case, i);
+  }
+}
+
+static void suite_durability(void) {
+  fprintf(report, "\nAppend throughput by durability, %d KB to one log\n", APPEND_BYTES / 8 / 1024);
+  append_header();
+  for (size_t durability = StorageDurabilityGroup; durability <= StorageDurabilityLazy; durability++) {
+    run_case(durability_case, durability);
+  }
+}
+
+/**************************************************************************/
+/* MIXED                                                                  */
+/**************************************************************************/
+
+static const size_t mixed_logs[] = {2, 4, 8};
+
+static void mixed_case(size_t i) {
+  size_t logs = mixed_logs[i];
+  size_t sizes[8] = {0};
+  uint8_t buf[256];
+  memset(buf, 0xA5, sizeof(buf));
+  unsigned int seed = 1;
+  size_t reads = 0;
+  size_t read_bytes = 0;
+  size_t written_bytes = 0;
+
+  sample_t sample;
+  sample_begin(&sample);
+  for (size_t op = 0; op < MIXED_OPS; op++) {
+    size_t log = rand_r(&seed) % logs;
+    char name[STORAGE_LOG_LEN+1];
+    snprintf(name, sizeof(name), "mixed%zu", log);
+
+    if (sizes[log] < sizeof(buf) || rand_r(&seed) % 2) {
+      write_log(name, buf, 128, StorageDurabilityGroup);
+      sizes[log] += 128;
+      written_bytes += 128;
+    } else {
+      size_t offset = rand_r(&seed) % (sizes[log] - sizeof(buf) + 1);
+      size_t bytes_read = 0;
+      int32_t rc = storage_read_data(name, offset, buf, sizeof(buf), sizeof(buf), &bytes_read);
+      if (rc < TOCK_SUCCESS || bytes_read != sizeof(buf)) fail("read", rc);
+      reads++;
+      read_bytes += bytes_read;
+    }
+  }
+  int32_t rc = storage_sync();
+  if (rc < TOCK_SUCCESS) fail("sync", rc);
+  sample_end(&sample);
+
+  fprintf(report, "%6zu %8zu %8zu %10.1f %8.0f %10u %10u %8.1f\n",
+      logs, MIXED_OPS - reads, reads, ms(sample.disk_us),
+      sample.disk_us == 0 ? 0 : MIXED_OPS / (sample.disk_us / 1000000.0),
+      sample.stats.sectors_read, sample.stats.sectors_written, ms(sample.cpu_us));
+}
+
+static void suite_mixed(void) {
+  fprintf(report, "\nMixed 128 byte appends and 256 byte reads, %d operations, %d logs open at once\n",
+      MIXED_OPS, STORAGE_FILE_CACHE_LEN);
+  fprintf(report, "%6s %8s %8s %10s %8s %10s %10s %8s\n",
+      "logs", "writes", "reads", "card ms", "ops/s", "sect read", "sect wrote", "cpu ms");
+  for (size_t i = 0; i < sizeof(mixed_logs) / sizeof(mixed_logs[0]); i++) {
+    run_case(mixed_case, i);
+  }
+}
+
+/**************************************************************************/
+/* SCAN                                                                   */
+/**************************************************************************/
+
+static const size_t scan_files[] = {16, 64, 256};
+
+// List the directory from the card, as scans did before the index
+static void readdir_all(void) {
+  DIR dir;
+  static FILINFO fno;
+  if (f_opendir(&dir, "") != FR_OK) fail("opendir", TOCK_FAIL);
+  while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != 0) {
+  }
+  f_closedir(&dir);
+}
+
+static size_t scan_all(void) {
+  char after[STORAGE_LOG_LEN+1] = "";
+  size_t listed = 0;
+  bool more = true;
+  while (more) {
+    Storage_Record_t page[SIGNPOST_STORAGE_SCAN_PAGE];
+    size_t page_len = 0;
+    int32_t rc = storage_scan_page(after, "", page, &page_len, SIGNPOST_STORAGE_SCAN_PAGE, &more);
+    if (rc < TOCK_SUCCESS) fail("scan", rc);
+    if (page_len > 0) strcpy(after, page[page_len-1].logname);
+    listed += page_len;
+  }
+  return listed;
+}
+
+static void scan_case(size_t i) {
+  size_t files = scan_files[i];
+  uint8_t buf[32] = {0};
+  for (size_t file = 0; file < files; file++) {
+    char name[STORAGE_LOG_LEN+1];
+    snprintf(name, sizeof(name), "log%04zu", file);
+    write_log(name, buf, sizeof(buf), StorageDurabilityGroup);
+  }
+  int32_t rc = storage_sync();
+  if (rc < TOCK_SUCCESS) fail("sync", rc);
+
+  sample_t card, first, cached;
+  sample_begin(&card);
+  readdir_all();
+  sample_end(&card);
+  sample_begin(&first);
+  size_t listed = scan_all();
+  sample_end(&first);
+  sample_begin(&cached);
+  scan_all();
+  sample_end(&cached);
+
+  fprintf(report, "%6zu %6zu %12.1f %12.1f %12.1f %12.3f\n",
+      files, listed, ms(card.disk_us), ms(first.disk_us), ms(cached.disk_us), ms(cached.cpu_us));
+}
+
+static void suite_scan(void) {
+  fprintf(report, "\nFull scan by file count, in pages of %d\n", SIGNPOST_STORAGE_SCAN_PAGE);
+  fprintf(report, "%6s %6s %12s %12s %12s %12s\n",
+      "files", "listed", "readdir ms", "first ms", "indexed ms", "indexed cpu");
+  for (size_t i = 0; i < sizeof(scan_files) / sizeof(scan_files[0]); i++) {
+    run_case(scan_case, i);
+  }
+}
+
+/**************************************************************************/
+/* FRAGMENTATION                                                          */
+/**************************************************************************/
+
+#define FRAGMENT_LOGS 4
+#define FRAGMENT_RECORD 200
+// a log is rotated out, deleted and started again, after this much
+#define FRAGMENT_ROTATE (192*1024)
+
+static uint32_t fat_entry(FATFS* fs, uint32_t cluster) {
+  uint8_t sector[HOST_DISK_SECTOR_SIZE];
+  size_t width = fs->fs_type == FS_FAT32 ? 4 : 2;
+  size_t offset = cluster * width;
+  host_disk_peek(fs->fatbase + offset / HOST_DISK_SECTOR_SIZE, sector);
+  offset %= HOST_DISK_SECTOR_SIZE;
+  if (width == 2) return sector[offset] | sector[offset+1] << 8;
+  return (sector[offset] | sector[offset+1] << 8 | sector[offset+2] << 16 |
+      (uint32_t)sector[offset+3] << 24) & 0x0FFFFFFF;
+}
+
+// Runs of contiguous clusters in a file, on a synced card
+static size_t fragments(const char* name) {
+  FIL fp;
+  if (f_open(&fp, name, FA_READ) != FR_OK) return 0;
+  FATFS* fs = fp.obj.fs;
+  if (fs->fs_type == FS_FAT12) fail("fragments on FAT12", TOCK_FAIL);
+
+  size_t runs = 0;
+  uint32_t cluster = fp.obj.sclust;
+  uint32_t previous = 0;
+  while (cluster >= 2 && cluster < fs->n_fatent) {
+    if (cluster != previous + 1) runs++;
+    previous = cluster;
+    cluster = fat_entry(fs, cluster);
+  }
+  f_close(&fp);
+  return runs;
+}
+
+static void fragmentation_report(size_t written, size_t* generation, bool circular) {
+  int32_t rc = storage_sync();
+  if (rc < TOCK_SUCCESS) fail("sync", rc);
+
+  size_t runs = 0;
+  size_t bytes = 0;
+  size_t worst = 0;
+  for (size_t log = 0; log < FRAGMENT_LOGS; log++) {
+    char name[STORAGE_LOG_LEN+1];
+    size_t size = 0;
+    snprintf(name, sizeof(name), "frag%zu_%zu", log, generation[log]);
+    size_t log_runs = fragments(name);
+    FILINFO fno;
+    if (f_stat(name, &fno) == FR_OK) size = fno.fsize;
+    runs += log_runs;
+    bytes += size;
+    if (log_runs > worst) worst = log_runs;
+  }
+  fprintf(report, "%-10s %10zu %10.1f %10zu %12.1f\n", circular ? "circular" : "plain",
+      written / 1024, runs / (double)FRAGMENT_LOGS, worst, runs == 0 ? 0 : bytes / 1024.0 / runs);
+}
+
+static void fragmentation_case(size_t circular) {
+  size_t generation[FRAGMENT_LOGS] = {0};
+  size_t sizes[FRAGMENT_LOGS] = {0};
+  uint8_t buf[FRAGMENT_RECORD];
+  memset(buf, 0x3C, sizeof(buf));
+
+  for (size_t log = 0; circular && log < FRAGMENT_LOGS; log++) {
+    char name[STORAGE_LOG_LEN+1];
+    size_t start, end;
+    snprintf(name, sizeof(name), "frag%zu_0", log);
+    int32_t rc = storage_circular_create(name, FRAGMENT_ROTATE, &start, &end);
+    if (rc < TOCK_SUCCESS) fail("circular", rc);
+  }
+
+  // sensors logging side by side, each rotating its log once it is full
+  size_t written = 0;
+  unsigned int seed = 1;
+  while (written < FRAGMENT_BYTES) {
+    size_t log = rand_r(&seed) % FRAGMENT_LOGS;
+    char name[STORAGE_LOG_LEN+1];
+    snprintf(name, sizeof(name), "frag%zu_%zu", log, generation[log]);
+    if (!circular && sizes[log] >= FRAGMENT_ROTATE) {
+      int32_t rc = storage_del_data(name);
+      if (rc < TOCK_SUCCESS) fail("delete", rc);
+      generation[log]++;
+      sizes[log] = 0;
+      snprintf(name, sizeof(name), "frag%zu_%zu", log, generation[log]);
+    }
+    write_log(name, buf, sizeof(buf), StorageDurabilityGroup);
+    sizes[log] += sizeof(buf);
+    written += sizeof(buf);
+
+    if (written % (FRAGMENT_BYTES / 4) < sizeof(buf)) {
+      fragmentation_report(written, generation, circular);
+    }
+  }
+}
+
+static void suite_fragmentation(void) {
+  fprintf(report, "\nFragmentation of %d logs written side by side in %d byte records, rotated at %d KB\n",
+      FRAGMENT_LOGS, FRAGMENT_RECORD, FRAGMENT_ROTATE / 1024);
+  fprintf(report, "%-10s %10s %10s %10s %12s\n", "logs", "written KB", "runs/log", "worst", "KB/run");
+  run_case(fragmentation_case, false);
+  run_case(fragmentation_case, true);
+}
+
+/**************************************************************************/
+/* MAIN                                                                   */
+/**************************************************************************/
+
+typedef struct {
+  const char* name;
+  void (*run)(void);
+} suite_t;
+
+static const suite_t suites[] = {
+  {"append", suite_append},
+  {"durability", suite_durability},
+  {"mixed", suite_mixed},
+  {"scan", suite_scan},
+  {"fragmentation", suite_fragmentation},
+};
+#define SUITES (sizeof(suites) / sizeof(suites[0]))
+
+int main(int argc, char** argv) {
+  const char* image_path = NULL;
+  // rough figures for an SD card on SPI
+  host_disk_latency = (host_disk_latency_t) {
+    .call_us = 200,
+    .read_us = 600,
+    .write_us = 1200,
+    .sync_us = 0,
+  };
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:l:")) != -1) {
+    if (opt == 'i') {
+      image_path = optarg;
+    } else if (opt == 'l' && sscanf(optarg, "%u,%u,%u,%u", &host_disk_latency.call_us,
+          &host_disk_latency.read_us, &host_disk_latency.write_us, &host_disk_latency.sync_us) == 4) {
+      continue;
+    } else {
+      fprintf(stderr, "usage: %s [-i image] [-l call_us,read_us,write_us,sync_us] [suite...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  report = fdopen(dup(STDOUT_FILENO), "w");
+  if (report == NULL || host_disk_init(image_path, BENCH_DISK_SECTORS) < 0) {
+    fprintf(stderr, "cannot set up the disk image\n");
+    return 1;
+  }
+  fprintf(report, "Card model: %u us per command, %u us per sector read, %u us per sector written, %u us per sync\n",
+      host_disk_latency.call_us, host_disk_latency.read_us, host_disk_latency.write_us, host_disk_latency.sync_us);
+
+  for (size_t i = 0; i < SUITES; i++) {
+    bool selected = optind == argc;
+    for (int arg = optind; arg < argc; arg++) {
+      if (!strcmp(argv[arg], suites[i].name)) selected = true;
+    }
+    if (selected) suites[i].run();
+  }
+
+  fflush(report);
+  return 0;
+}
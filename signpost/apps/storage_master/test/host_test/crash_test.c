@@ -0,0 +1,296 @@
+// Crash consistency test for storage master writes
+//
+// Runs a fixed mix of immediate, group commit and lazy writes against an in
+// memory FatFs image, cutting power after every possible number of sector
+// writes. After each cut the image is mounted again and every log checked:
+// it must hold everything its durability class promised, and nothing but a
+// prefix of what was written to it. A circular log, written many times
+// round, must hold a window of the newest data it promised with no
+// overwritten bytes inside it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ff.h"
+#include "host_disk.h"
+#include "host_stubs.h"
+#include "signpost_storage.h"
+#include "tock.h"
+
+#define LOGS 4
+#define OPS 320
+#define MAX_RECORD_LEN 300
+// writes between group commit timer firings
+#define TIMER_PERIOD_OPS 16
+// not a whole number of sectors, so the wrap falls inside one
+#define CIRCULAR_LOG 3
+#define CIRCULAR_CAPACITY 1500
+
+static const char* lognames[LOGS] = {"immediate", "group", "lazy", "circular"};
+static const uint8_t durabilities[LOGS] = {
+  StorageDurabilityImmediate, StorageDurabilityGroup, StorageDurabilityLazy, StorageDurabilityGroup,
+};
+
+// Circular log header, as signpost_storage.c lays it out
+#define CIRCULAR_MAGIC 0x4C435053
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t capacity;
+  uint32_t start;
+  uint32_t end;
+  uint32_t check;
+} circular_header_t;
+
+// Shared with the child running the writes
+typedef struct {
+  size_t durable[LOGS];     // must survive a crash
+  size_t acked[LOGS];       // acknowledged
+  size_t attempted[LOGS];   // acknowledged plus the write in progress
+  uint32_t sectors_written;
+} progress_t;
+
+static progress_t* progress;
+
+static uint8_t pattern(size_t log, size_t offset) {
+  return (offset * 31 + (offset >> 8) + log * 101) & 0xff;
+}
+
+static void workload(void) {
+  if (storage_initialize() < TOCK_SUCCESS) _exit(2);
+  size_t start = 0;
+  size_t end = 0;
+  if (storage_circular_create(lognames[CIRCULAR_LOG], CIRCULAR_CAPACITY, &start, &end) < TOCK_SUCCESS) _exit(5);
+  if (host_disk_crashed()) _exit(0);
+
+  unsigned int seed = 1;
+  uint8_t buf[MAX_RECORD_LEN];
+  for (int op = 0; op < OPS; op++) {
+    size_t log = rand_r(&seed) % LOGS;
+    size_t len = 1 + rand_r(&seed) % MAX_RECORD_LEN;
+    for (size_t i = 0; i < len; i++) {
+      buf[i] = pattern(log, progress->acked[log] + i);
+    }
+
+    progress->attempted[log] = progress->acked[log] + len;
+    size_t bytes_written = 0;
+    size_t offset = 0;
+    int32_t rc = storage_write_durable(lognames[log], buf, len, len, &bytes_written, &offset, durabilities[log]);
+    if (rc < TOCK_SUCCESS || bytes_written != len || offset != progress->acked[log]) _exit(3);
+    if (durabilities[log] == StorageDurabilityImmediate) {
+      if (storage_flush_data(lognames[log]) < TOCK_SUCCESS) _exit(4);
+    }
+    if (host_disk_crashed()) _exit(0);
+
+    progress->acked[log] += len;
+    if (durabilities[log] == StorageDurabilityImmediate) {
+      progress->durable[log] = progress->acked[log];
+    }
+
+    if (op % TIMER_PERIOD_OPS == TIMER_PERIOD_OPS - 1) {
+      // every log is synced when the timer fires
+      host_timers_fire();
+      if (host_disk_crashed()) _exit(0);
+      for (size_t i = 0; i < LOGS; i++) {
+        progress->durable[i] = progress->acked[i];
+      }
+    }
+  }
+
+  progress->sectors_written = host_disk_stats.sectors_written;
+  _exit(0);
+}
+
+static int run(long crash_after) {
+  host_disk_restore();
+  memset(progress, 0, sizeof(progress_t));
+  fflush(stdout);
+
+  pid_t pid = fork();
+  if (pid < 0) return -1;
+  if (pid == 0) {
+    // the storage code is chatty
+    if (freopen("/dev/null", "w", stdout) == NULL) _exit(2);
+    host_disk_crash_after(crash_after);
+    workload();
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) < 0) return -1;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("crash after %ld: writer failed with status %d\n", crash_after, status);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_log(long crash_after, size_t log) {
+  FIL fp;
+  size_t size = 0;
+  FRESULT res = f_open(&fp, lognames[log], FA_READ);
+  if (res == FR_OK) {
+    size = f_size(&fp);
+  } else if (res != FR_NO_FILE) {
+    printf("crash after %ld: cannot open %s: %d\n", crash_after, lognames[log], res);
+    return -1;
+  }
+
+  int rc = 0;
+  if (size < progress->durable[log]) {
+    printf("crash after %ld: %s lost data, %zu bytes of %zu durable\n",
+        crash_after, lognames[log], size, progress->durable[log]);
+    rc = -1;
+  } else if (size > progress->attempted[log]) {
+    printf("crash after %ld: %s grew to %zu bytes, only %zu written\n",
+        crash_after, lognames[log], size, progress->attempted[log]);
+    rc = -1;
+  }
+
+  for (size_t offset = 0; rc == 0 && offset < size; ) {
+    uint8_t buf[HOST_DISK_SECTOR_SIZE];
+    UINT bytes_read = 0;
+    res = f_read(&fp, buf, sizeof(buf), &bytes_read);
+    if (res != FR_OK || bytes_read == 0) {
+      printf("crash after %ld: cannot read %s at %zu: %d\n", crash_after, lognames[log], offset, res);
+      rc = -1;
+      break;
+    }
+    for (UINT i = 0; i < bytes_read; i++) {
+      if (buf[i] != pattern(log, offset + i)) {
+        printf("crash after %ld: %s is corrupt at %zu\n", crash_after, lognames[log], offset + i);
+        rc = -1;
+        break;
+      }
+    }
+    offset += bytes_read;
+  }
+
+  if (res == FR_OK) f_close(&fp);
+  return rc;
+}
+
+static int check_circular(long crash_after, size_t log) {
+  FIL fp;
+  FRESULT res = f_open(&fp, lognames[log], FA_READ);
+  if (res == FR_NO_FILE && progress->attempted[log] == 0) return 0;
+  if (res != FR_OK) {
+    printf("crash after %ld: cannot open %s: %d\n", crash_after, lognames[log], res);
+    return -1;
+  }
+
+  // the header sector, then the data
+  static uint8_t buf[HOST_DISK_SECTOR_SIZE + CIRCULAR_CAPACITY];
+  UINT bytes_read = 0;
+  res = f_read(&fp, buf, sizeof(buf), &bytes_read);
+  f_close(&fp);
+  if (res != FR_OK) {
+    printf("crash after %ld: cannot read %s: %d\n", crash_after, lognames[log], res);
+    return -1;
+  }
+
+  circular_header_t header;
+  memcpy(&header, buf, sizeof(header));
+  if (bytes_read < sizeof(buf) || header.magic != CIRCULAR_MAGIC || header.capacity != CIRCULAR_CAPACITY ||
+      header.check != ~(header.magic ^ header.capacity ^ header.start ^ header.end)) {
+    // only a log still being made may be without one
+    if (progress->attempted[log] == 0) return 0;
+    printf("crash after %ld: %s has no header\n", crash_after, lognames[log]);
+    return -1;
+  }
+
+  size_t start = header.start;
+  size_t end = header.end;
+  // every write can drop up to a sector more than it overwrites
+  size_t keep = CIRCULAR_CAPACITY - MAX_RECORD_LEN - HOST_DISK_SECTOR_SIZE;
+  if (keep > end) keep = end;
+  if (end < start || end - start > CIRCULAR_CAPACITY) {
+    printf("crash after %ld: %s holds %zu to %zu\n", crash_after, lognames[log], start, end);
+    return -1;
+  }
+  if (end < progress->durable[log]) {
+    printf("crash after %ld: %s lost data, ends at %zu of %zu durable\n",
+        crash_after, lognames[log], end, progress->durable[log]);
+    return -1;
+  }
+  if (end > progress->attempted[log]) {
+    printf("crash after %ld: %s ends at %zu, only %zu written\n",
+        crash_after, lognames[log], end, progress->attempted[log]);
+    return -1;
+  }
+  if (end - start < keep) {
+    printf("crash after %ld: %s keeps only %zu to %zu\n", crash_after, lognames[log], start, end);
+    return -1;
+  }
+
+  for (size_t offset = start; offset < end; offset++) {
+    if (buf[HOST_DISK_SECTOR_SIZE + offset % CIRCULAR_CAPACITY] != pattern(log, offset)) {
+      printf("crash after %ld: %s is corrupt at %zu, holding %zu to %zu\n",
+          crash_after, lognames[log], offset, start, end);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// The filesystem must still take new files
+static int check_writable(long crash_after) {
+  FIL fp;
+  uint8_t buf[2*HOST_DISK_SECTOR_SIZE + 17];
+  memset(buf, 0xA5, sizeof(buf));
+  UINT done = 0;
+  if (f_open(&fp, "after", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK ||
+      f_write(&fp, buf, sizeof(buf), &done) != FR_OK || done != sizeof(buf) ||
+      f_close(&fp) != FR_OK) {
+    printf("crash after %ld: filesystem is not writable\n", crash_after);
+    return -1;
+  }
+  return 0;
+}
+
+static int check(long crash_after) {
+  FATFS fs;
+  FRESULT res = f_mount(&fs, "", 1);
+  if (res != FR_OK) {
+    printf("crash after %ld: cannot mount: %d\n", crash_after, res);
+    return -1;
+  }
+
+  int rc = 0;
+  for (size_t log = 0; log < LOGS; log++) {
+    int log_rc = log == CIRCULAR_LOG ? check_circular(crash_after, log) : check_log(crash_after, log);
+    if (log_rc < 0) rc = -1;
+  }
+  if (rc == 0) rc = check_writable(crash_after);
+
+  f_mount(NULL, "", 0);
+  return rc;
+}
+
+int main(int argc, char** argv) {
+  long step = argc > 1 ? strtol(argv[1], NULL, 0) : 1;
+  if (step < 1) step = 1;
+
+  progress = mmap(NULL, sizeof(progress_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (progress == MAP_FAILED || host_disk_init(NULL, HOST_DISK_SECTORS) < 0) {
+    printf("cannot set up the disk image\n");
+    return 1;
+  }
+
+  // count the sectors the whole run writes, then cut power at each
+  if (run(-1) < 0 || check(-1) < 0) return 1;
+  long total = progress->sectors_written;
+
+  long failures = 0;
+  long points = 0;
+  for (long crash_after = 0; crash_after < total; crash_after += step) {
+    points++;
+    if (run(crash_after) < 0 || check(crash_after) < 0) failures++;
+  }
+
+  printf("%ld of %ld crash points consistent, %ld sectors written per run\n",
+      points - failures, points, total);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "diskio.h"
+#include "ff.h"
+#include "host_disk.h"
+
+host_disk_stats_t host_disk_stats;
+host_disk_latency_t host_disk_latency;
+
+static uint8_t* image = NULL;
+static uint8_t* saved = NULL;
+static size_t image_sectors = 0;
+static uint64_t time_us = 0;
+static long write_budget = -1;
+static bool crashed = false;
+
+int host_disk_init(const char* path, size_t sectors) {
+  size_t bytes = sectors * HOST_DISK_SECTOR_SIZE;
+  if (path == NULL) {
+    image = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  } else {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, bytes) < 0) {
+      perror(path);
+      return -1;
+    }
+    image = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+  }
+  saved = malloc(bytes);
+  if (image == MAP_FAILED || saved == NULL) return -1;
+  memset(image, 0, bytes);
+  image_sectors = sectors;
+
+  BYTE work[_MAX_SS];
+  FRESULT res = f_mkfs("", FM_ANY, 0, work, sizeof(work));
+  if (res != FR_OK) {
+    fprintf(stderr, "mkfs failed: %d\n", res);
+    return -1;
+  }
+  host_disk_save();
+  host_disk_reset_stats();
+  return 0;
+}
+
+void host_disk_save(void) {
+  memcpy(saved, image, image_sectors * HOST_DISK_SECTOR_SIZE);
+}
+
+void host_disk_restore(void) {
+  memcpy(image, saved, image_sectors * HOST_DISK_SECTOR_SIZE);
+  write_budget = -1;
+  crashed = false;
+  host_disk_reset_stats();
+}
+
+void host_disk_reset_stats(void) {
+  memset(&host_disk_stats, 0, sizeof(host_disk_stats));
+  time_us = 0;
+}
+
+uint64_t host_disk_time_us(void) {
+  return time_us;
+}
+
+void host_disk_peek(uint32_t sector, uint8_t* buf) {
+  if (sector < image_sectors) {
+    memcpy(buf, image + (size_t)sector * HOST_DISK_SECTOR_SIZE, HOST_DISK_SECTOR_SIZE);
+  }
+}
+
+void host_disk_crash_after(long sectors) {
+  write_budget = sectors;
+  crashed = false;
+}
+
+bool host_disk_crashed(void) {
+  return crashed;
+}
+
+DSTATUS disk_status(BYTE pdrv) {
+  return pdrv == 0 && image != NULL ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_initialize(BYTE pdrv) {
+  return disk_status(pdrv);
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE* buff, DWORD sector, UINT count) {
+  if (pdrv != 0 || sector + count > image_sectors) return RES_PARERR;
+
+  memcpy(buff, image + (size_t)sector * HOST_DISK_SECTOR_SIZE, (size_t)count * HOST_DISK_SECTOR_SIZE);
+  host_disk_stats.read_calls++;
+  host_disk_stats.sectors_read += count;
+  time_us += host_disk_latency.call_us + (uint64_t)count * host_disk_latency.read_us;
+  return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, DWORD sector, UINT count) {
+  if (pdrv != 0 || sector + count > image_sectors) return RES_PARERR;
+
+  // sectors of a multiple block write land in order, so power can be lost
+  // part way through one
+  for (UINT i = 0; i < count; i++) {
+    if (write_budget == 0) crashed = true;
+    if (crashed) break;
+    if (write_budget > 0) write_budget--;
+    memcpy(image + ((size_t)sector + i) * HOST_DISK_SECTOR_SIZE,
+        buff + (size_t)i * HOST_DISK_SECTOR_SIZE, HOST_DISK_SECTOR_SIZE);
+  }
+  host_disk_stats.write_calls++;
+  host_disk_stats.sectors_written += count;
+  time_us += host_disk_latency.call_us + (uint64_t)count * host_disk_latency.write_us;
+  return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
+  if (pdrv != 0) return RES_PARERR;
+
+  switch (cmd) {
+    case CTRL_SYNC:
+      host_disk_stats.syncs++;
+      time_us += host_disk_latency.sync_us;
+      return RES_OK;
+    case GET_SECTOR_COUNT:
+      *(DWORD*)buff = image_sectors;
+      return RES_OK;
+    case GET_SECTOR_SIZE:
+      *(WORD*)buff = HOST_DISK_SECTOR_SIZE;
+      return RES_OK;
+    case GET_BLOCK_SIZE:
+      *(DWORD*)buff = 1;
+      return RES_OK;
+    default:
+      return RES_PARERR;
+  }
+}
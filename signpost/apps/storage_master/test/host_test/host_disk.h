@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A FatFs disk in memory standing in for the SD card
+//
+// The image is shared with forked children, so a child can run the storage
+// code against it and the parent can look at what the child left behind.
+// It can also be backed by a file, to keep it or look at it afterwards.
+//
+// Every access advances a simulated clock by what it would have cost on a
+// card, following host_disk_latency, so benchmarks report card time rather
+// than how fast the host copies memory.
+
+#define HOST_DISK_SECTOR_SIZE 512
+#ifndef HOST_DISK_SECTORS
+#define HOST_DISK_SECTORS 8192
+#endif
+
+typedef struct {
+  uint32_t sectors_read;
+  uint32_t sectors_written;
+  uint32_t read_calls;
+  uint32_t write_calls;
+  uint32_t syncs;
+} host_disk_stats_t;
+
+// Microseconds each access costs. All zero unless set.
+typedef struct {
+  uint32_t call_us;         // per disk_read or disk_write call, command overhead
+  uint32_t read_us;         // per sector read
+  uint32_t write_us;        // per sector written
+  uint32_t sync_us;         // per CTRL_SYNC
+} host_disk_latency_t;
+
+extern host_disk_stats_t host_disk_stats;
+extern host_disk_latency_t host_disk_latency;
+
+// Allocate an image of sectors, in path if it is not NULL, and format it
+// with an empty filesystem
+int host_disk_init(const char* path, size_t sectors);
+
+// Save the image, and restore it to what was saved
+void host_disk_save(void);
+void host_disk_restore(void);
+
+// Clear the stats and the simulated clock
+void host_disk_reset_stats(void);
+// Simulated time spent on the disk
+uint64_t host_disk_time_us(void);
+
+// Copy a sector out without counting it
+void host_disk_peek(uint32_t sector, uint8_t* buf);
+
+// Lose power after another sectors are written. Writes after that are
+// dropped, as if the card had lost power, but still report success so the
+// code under test carries on as it would on the device. Negative never
+// loses power.
+void host_disk_crash_after(long sectors);
+bool host_disk_crashed(void);
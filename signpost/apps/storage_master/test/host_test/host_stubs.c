@@ -0,0 +1,64 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "host_disk.h"
+#include "host_stubs.h"
+#include "signpost_reactor.h"
+#include "timer.h"
+
+#define HOST_TIMERS 4
+
+static signpost_reactor_timer_t* timers[HOST_TIMERS];
+
+static uint32_t now_ms(void) {
+  return host_disk_time_us() / 1000;
+}
+
+void signpost_reactor_timer_start(signpost_reactor_timer_t* timer, uint32_t ms,
+        signpost_reactor_handler_t handler, void* ud) {
+  if (timer->active) signpost_reactor_timer_cancel(timer);
+
+  timer->deadline = now_ms() + ms;
+  timer->handler = handler;
+  timer->ud = ud;
+  timer->active = true;
+  for (size_t i = 0; i < HOST_TIMERS; i++) {
+    if (timers[i] == NULL) {
+      timers[i] = timer;
+      return;
+    }
+  }
+}
+
+void signpost_reactor_timer_cancel(signpost_reactor_timer_t* timer) {
+  for (size_t i = 0; i < HOST_TIMERS; i++) {
+    if (timers[i] == timer) timers[i] = NULL;
+  }
+  timer->active = false;
+}
+
+static bool timers_run(bool all) {
+  bool fired = false;
+  for (size_t i = 0; i < HOST_TIMERS; i++) {
+    signpost_reactor_timer_t* timer = timers[i];
+    if (timer == NULL) continue;
+    if (!all && (int32_t)(timer->deadline - now_ms()) > 0) continue;
+    timers[i] = NULL;
+    timer->active = false;
+    timer->handler(0, timer->ud);
+    fired = true;
+  }
+  return fired;
+}
+
+bool host_timers_fire(void) {
+  return timers_run(true);
+}
+
+void host_timers_run(void) {
+  timers_run(false);
+}
+
+void delay_ms(__attribute__ ((unused)) uint32_t ms) {
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Reactor timers do not run on their own on the host. Tests fire them.
+// Timers are started on the simulated disk clock.
+
+// Run every started timer now, as if their time had come. Returns whether
+// any were started.
+bool host_timers_fire(void);
+
+// Run the timers whose time has come on the simulated disk clock
+void host_timers_run(void);
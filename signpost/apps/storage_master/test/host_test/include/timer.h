@@ -0,0 +1,5 @@
+#pragma once
+
+#include "tock.h"
+
+void delay_ms(uint32_t ms);
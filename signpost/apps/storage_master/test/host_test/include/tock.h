@@ -0,0 +1,19 @@
+#pragma once
+
+// Just enough of libtock for the storage master code to build on a host
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TOCK_SUCCESS 0
+#define TOCK_FAIL -1
+#define TOCK_EBUSY -2
+#define TOCK_EALREADY -3
+#define TOCK_EOFF -4
+#define TOCK_ERESERVE -5
+#define TOCK_EINVAL -6
+#define TOCK_ESIZE -7
+#define TOCK_ECANCEL -8
+#define TOCK_ENOMEM -9
+#define TOCK_ENOSUPPORT -10
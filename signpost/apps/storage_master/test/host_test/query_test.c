@@ -0,0 +1,260 @@
+// Range query and aggregate test for storage master logs
+//
+// Writes a timed log long enough to be indexed and a log of fixed length
+// records, then checks range queries against a walk of every record, empty
+// ranges included, and checks the count, sum, min, max and histogram of
+// aggregates against values computed here.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff.h"
+#include "host_disk.h"
+#include "signpost_storage.h"
+#include "tock.h"
+
+// several index intervals, so queries go through the index
+#define TIMED_RECORDS (STORAGE_INDEX_INTERVAL * 4 + 5)
+#define FIRST_TIME 1000
+#define FIXED_RECORDS 50
+#define FIXED_RECORD_LEN 6
+
+static const char* timed_log = "timed";
+static const char* fixed_log = "fixed";
+
+static uint32_t timestamps[TIMED_RECORDS];
+static int16_t timed_values[TIMED_RECORDS];
+static size_t timed_offsets[TIMED_RECORDS+1];
+static uint32_t fixed_values[FIXED_RECORDS];
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      failures++; \
+    } \
+  } while (0)
+
+static void write_timed(void) {
+  for (size_t i = 0; i < TIMED_RECORDS; i++) {
+    // pairs of records share a stamp, with a gap between pairs
+    timestamps[i] = FIRST_TIME + 3 * (i / 2);
+    timed_values[i] = (int16_t)((i * 37) % 200) - 100;
+
+    // the value, then padding so records differ in length
+    uint8_t data[2 + 4] = {0};
+    size_t len = 2 + i % 5;
+    memcpy(data, &timed_values[i], sizeof(int16_t));
+
+    size_t offset = 0;
+    size_t record_len = 0;
+    int32_t rc = storage_write_timed(timed_log, timestamps[i], data, len, &offset, &record_len);
+    CHECK(rc == TOCK_SUCCESS, "timed write %zu failed: %d", i, rc);
+    CHECK(offset == timed_offsets[i], "timed write %zu at %zu, want %zu", i, offset, timed_offsets[i]);
+    timed_offsets[i+1] = offset + record_len;
+  }
+}
+
+static void write_fixed(void) {
+  for (size_t i = 0; i < FIXED_RECORDS; i++) {
+    // [u16 tag][u32 value]
+    fixed_values[i] = i * 1000003u % 70000;
+    uint8_t data[FIXED_RECORD_LEN];
+    uint16_t tag = i;
+    memcpy(data, &tag, sizeof(tag));
+    memcpy(data + sizeof(tag), &fixed_values[i], sizeof(uint32_t));
+
+    size_t bytes_written = 0;
+    size_t offset = 0;
+    int32_t rc = storage_write_data(fixed_log, data, sizeof(data), sizeof(data), &bytes_written, &offset);
+    CHECK(rc == TOCK_SUCCESS && bytes_written == sizeof(data), "fixed write %zu failed: %d", i, rc);
+  }
+}
+
+// Index of the first record stamped at or after bound
+static size_t first_at(uint64_t bound) {
+  size_t i = 0;
+  while (i < TIMED_RECORDS && timestamps[i] < bound) i++;
+  return i;
+}
+
+static void check_range(uint32_t start, uint32_t end) {
+  size_t first = first_at(start);
+  size_t last = first_at((uint64_t) end + 1);
+  if (last < first) last = first;
+  size_t want_offset = timed_offsets[first];
+  size_t want_length = timed_offsets[last] - timed_offsets[first];
+
+  size_t offset = 0;
+  size_t length = 0;
+  int32_t rc = storage_query_range(timed_log, start, end, &offset, &length);
+  CHECK(rc == TOCK_SUCCESS, "query %lu-%lu failed: %d", (unsigned long) start, (unsigned long) end, rc);
+  CHECK(offset == want_offset && length == want_length,
+      "query %lu-%lu is %zu bytes at %zu, want %zu at %zu", (unsigned long) start, (unsigned long) end,
+      length, offset, want_length, want_offset);
+}
+
+static void expect_add(signpost_storage_aggregate_query_t* query, signpost_storage_aggregate_t* want, int64_t value) {
+  if (want->count == 0 || value < want->min) want->min = value;
+  if (want->count == 0 || value > want->max) want->max = value;
+  want->count++;
+  want->sum += value;
+  if (query->histogram_bins > 0) {
+    size_t bin = 0;
+    // bins are equal slices of [min, max), clamped at both ends
+    int64_t span = (int64_t) query->histogram_max - query->histogram_min;
+    while (bin + 1 < query->histogram_bins &&
+        (value - query->histogram_min) * query->histogram_bins >= (int64_t)(bin + 1) * span) {
+      bin++;
+    }
+    want->histogram[bin]++;
+  }
+}
+
+static void check_aggregate(const char* what, const char* log, size_t offset, size_t length,
+    signpost_storage_aggregate_query_t* query, signpost_storage_aggregate_t* want) {
+  signpost_storage_aggregate_t result;
+  int32_t rc = storage_aggregate(log, offset, length, query, &result);
+  CHECK(rc == TOCK_SUCCESS, "%s: aggregate failed: %d", what, rc);
+  CHECK(result.count == want->count, "%s: count %lu, want %lu", what,
+      (unsigned long) result.count, (unsigned long) want->count);
+  CHECK(result.sum == want->sum, "%s: sum %lld, want %lld", what, (long long) result.sum, (long long) want->sum);
+  if (want->count > 0) {
+    CHECK(result.min == want->min && result.max == want->max, "%s: min %lld max %lld, want %lld and %lld",
+        what, (long long) result.min, (long long) result.max, (long long) want->min, (long long) want->max);
+  }
+  for (size_t bin = 0; bin < SIGNPOST_STORAGE_HISTOGRAM_BINS; bin++) {
+    CHECK(result.histogram[bin] == want->histogram[bin], "%s: bin %zu holds %lu, want %lu", what, bin,
+        (unsigned long) result.histogram[bin], (unsigned long) want->histogram[bin]);
+  }
+}
+
+// Aggregate the timed records stamped from start to end
+static void check_timed_aggregate(uint32_t start, uint32_t end, uint8_t bins, int32_t min, int32_t max) {
+  char what[64];
+  snprintf(what, sizeof(what), "timed %lu-%lu", (unsigned long) start, (unsigned long) end);
+
+  size_t offset = 0;
+  size_t length = 0;
+  if (storage_query_range(timed_log, start, end, &offset, &length) < TOCK_SUCCESS) return;
+
+  signpost_storage_aggregate_query_t query = {
+    .record_len = 0,
+    .field_offset = 0,
+    .field_type = StorageFieldI16,
+    .histogram_bins = bins,
+    .histogram_min = min,
+    .histogram_max = max,
+  };
+  signpost_storage_aggregate_t want = {0};
+  for (size_t i = 0; i < TIMED_RECORDS; i++) {
+    if (timestamps[i] >= start && timestamps[i] <= end) {
+      expect_add(&query, &want, timed_values[i]);
+    }
+  }
+  check_aggregate(what, timed_log, offset, length, &query, &want);
+}
+
+static void check_fixed_aggregates(void) {
+  signpost_storage_aggregate_query_t query = {
+    .record_len = FIXED_RECORD_LEN,
+    .field_offset = sizeof(uint16_t),
+    .field_type = StorageFieldU32,
+    .histogram_bins = SIGNPOST_STORAGE_HISTOGRAM_BINS,
+    .histogram_min = 10000,
+    .histogram_max = 60000,
+  };
+
+  // the whole log, and a range starting partway
+  for (size_t from = 0; from < FIXED_RECORDS; from += FIXED_RECORDS / 2 + 3) {
+    signpost_storage_aggregate_t want = {0};
+    for (size_t i = from; i < FIXED_RECORDS; i++) {
+      expect_add(&query, &want, fixed_values[i]);
+    }
+    char what[32];
+    snprintf(what, sizeof(what), "fixed from %zu", from);
+    check_aggregate(what, fixed_log, from * FIXED_RECORD_LEN, (FIXED_RECORDS - from) * FIXED_RECORD_LEN,
+        &query, &want);
+  }
+
+  // a record cut by the end of the range is left out
+  signpost_storage_aggregate_t want = {0};
+  for (size_t i = 0; i < 3; i++) {
+    expect_add(&query, &want, fixed_values[i]);
+  }
+  check_aggregate("fixed cut short", fixed_log, 0, 4 * FIXED_RECORD_LEN - 1, &query, &want);
+
+  // a range past the end of the log stops at the end
+  memset(&want, 0, sizeof(want));
+  for (size_t i = 0; i < FIXED_RECORDS; i++) {
+    expect_add(&query, &want, fixed_values[i]);
+  }
+  check_aggregate("fixed past the end", fixed_log, 0, 2 * FIXED_RECORDS * FIXED_RECORD_LEN, &query, &want);
+
+  // empty ranges, and a field that doesn't fit in a record
+  memset(&want, 0, sizeof(want));
+  check_aggregate("fixed empty", fixed_log, 10 * FIXED_RECORD_LEN, 0, &query, &want);
+  check_aggregate("fixed after the end", fixed_log, FIXED_RECORDS * FIXED_RECORD_LEN, FIXED_RECORD_LEN,
+      &query, &want);
+  query.field_offset = FIXED_RECORD_LEN - 1;
+  check_aggregate("fixed field too far", fixed_log, 0, FIXED_RECORDS * FIXED_RECORD_LEN, &query, &want);
+
+  // bad queries are refused
+  signpost_storage_aggregate_t result;
+  query.field_offset = 0;
+  query.field_type = StorageFieldI32 + 1;
+  CHECK(storage_aggregate(fixed_log, 0, FIXED_RECORD_LEN, &query, &result) == TOCK_EINVAL,
+      "unknown field type accepted");
+  query.field_type = StorageFieldU8;
+  query.histogram_bins = SIGNPOST_STORAGE_HISTOGRAM_BINS + 1;
+  CHECK(storage_aggregate(fixed_log, 0, FIXED_RECORD_LEN, &query, &result) == TOCK_EINVAL,
+      "too many histogram bins accepted");
+}
+
+int main(void) {
+  if (host_disk_init(NULL, HOST_DISK_SECTORS) < 0 || storage_initialize() < TOCK_SUCCESS) {
+    printf("cannot set up the disk image\n");
+    return 1;
+  }
+
+  write_timed();
+  write_fixed();
+  uint32_t last_time = timestamps[TIMED_RECORDS-1];
+
+  // ranges on record stamps, between them, and across index entries
+  check_range(0, UINT32_MAX);
+  check_range(FIRST_TIME, FIRST_TIME);
+  check_range(FIRST_TIME + 3, FIRST_TIME + 3 * 40);
+  check_range(FIRST_TIME + 1, FIRST_TIME + 3 * 40 - 1);
+  check_range(FIRST_TIME + 3 * 16, FIRST_TIME + 3 * 16 + 2);
+  check_range(0, FIRST_TIME);
+  check_range(last_time, UINT32_MAX);
+  for (uint32_t start = FIRST_TIME - 2; start <= last_time + 2; start += 7) {
+    check_range(start, start + 50);
+  }
+
+  // and ranges with nothing in them
+  check_range(0, FIRST_TIME - 1);
+  check_range(last_time + 1, UINT32_MAX);
+  check_range(FIRST_TIME + 1, FIRST_TIME + 2);
+  check_range(FIRST_TIME + 3 * 20, FIRST_TIME + 3 * 10);
+
+  // a log that doesn't exist has no range
+  size_t offset = 0;
+  size_t length = 0;
+  CHECK(storage_query_range("missing", 0, UINT32_MAX, &offset, &length) < TOCK_SUCCESS,
+      "query of a missing log succeeded");
+
+  check_timed_aggregate(0, UINT32_MAX, SIGNPOST_STORAGE_HISTOGRAM_BINS, -100, 100);
+  check_timed_aggregate(FIRST_TIME + 3 * 5, FIRST_TIME + 3 * 37, 8, -100, 100);
+  // values outside the histogram go in the end bins
+  check_timed_aggregate(0, UINT32_MAX, 4, -20, 20);
+  check_timed_aggregate(FIRST_TIME + 1, FIRST_TIME + 2, 4, -20, 20);
+  check_fixed_aggregates();
+
+  printf("%d query checks failed\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+// Directory index test for storage master scans
+//
+// Creates, grows and deletes logs, and checks that paging through a scan
+// lists exactly the files on the card, in name order, with their current
+// sizes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff.h"
+#include "host_disk.h"
+#include "signpost_storage.h"
+#include "tock.h"
+
+#define LOGS 40
+#define PAGE 3
+
+static size_t sizes[LOGS];
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      failures++; \
+    } \
+  } while (0)
+
+static void logname(size_t log, char* name) {
+  // two groups of names to filter on
+  snprintf(name, STORAGE_LOG_LEN, "%s%02zu", log % 2 ? "audio" : "radar", log);
+}
+
+static void write_log(size_t log, size_t len) {
+  char name[STORAGE_LOG_LEN+1];
+  uint8_t buf[100] = {0};
+  size_t bytes_written = 0;
+  size_t offset = 0;
+  logname(log, name);
+  int32_t rc = storage_write_data(name, buf, len, len, &bytes_written, &offset);
+  CHECK(rc == TOCK_SUCCESS && bytes_written == len, "write %s failed: %d", name, rc);
+  sizes[log] += len;
+}
+
+// Page through the scan and compare it with what was written
+static void check_scan(const char* prefix) {
+  char after[STORAGE_LOG_LEN+1] = "";
+  char last[STORAGE_LOG_LEN+1] = "";
+  size_t listed = 0;
+  bool more = true;
+
+  while (more) {
+    Storage_Record_t page[PAGE];
+    size_t page_len = 0;
+    int32_t rc = storage_scan_page(after, prefix, page, &page_len, PAGE, &more);
+    CHECK(rc == TOCK_SUCCESS, "scan failed: %d", rc);
+    if (rc < TOCK_SUCCESS) return;
+    CHECK(page_len == PAGE || !more, "short page of %zu with more to come", page_len);
+
+    for (size_t i = 0; i < page_len; i++) {
+      const char* name = page[i].logname;
+      CHECK(strncmp(name, prefix, strlen(prefix)) == 0, "%s does not start with '%s'", name, prefix);
+      CHECK(strcmp(last, name) < 0, "%s listed after %s", name, last);
+      strcpy(last, name);
+
+      size_t log = strtoul(name + 5, NULL, 10);
+      CHECK(log < LOGS && sizes[log] > 0, "%s should not be listed", name);
+      if (log < LOGS) {
+        CHECK(page[i].length == sizes[log], "%s is %zu bytes, want %zu", name, page[i].length, sizes[log]);
+      }
+      listed++;
+    }
+    if (page_len > 0) strcpy(after, page[page_len-1].logname);
+  }
+
+  size_t expected = 0;
+  for (size_t log = 0; log < LOGS; log++) {
+    char name[STORAGE_LOG_LEN+1];
+    logname(log, name);
+    if (sizes[log] > 0 && strncmp(name, prefix, strlen(prefix)) == 0) expected++;
+  }
+  CHECK(listed == expected, "listed %zu logs for '%s', want %zu", listed, prefix, expected);
+}
+
+int main(void) {
+  if (host_disk_init(NULL, HOST_DISK_SECTORS) < 0 || storage_initialize() < TOCK_SUCCESS) {
+    printf("cannot set up the disk image\n");
+    return 1;
+  }
+
+  // files already on the card are read into the index on first use
+  for (size_t log = 0; log < LOGS / 2; log++) {
+    write_log(log, 1 + log);
+  }
+  check_scan("");
+
+  // and it follows writes and deletes from then on
+  for (size_t log = LOGS / 4; log < LOGS; log++) {
+    write_log(log, 10 + log);
+  }
+  for (size_t log = 0; log < LOGS; log += 3) {
+    char name[STORAGE_LOG_LEN+1];
+    logname(log, name);
+    CHECK(storage_del_data(name) == TOCK_SUCCESS, "delete %s failed", name);
+    sizes[log] = 0;
+  }
+  check_scan("");
+  check_scan("radar");
+  check_scan("audio1");
+  check_scan("none");
+
+  // sizes match the card once synced
+  CHECK(storage_sync() == TOCK_SUCCESS, "sync failed");
+  for (size_t log = 0; log < LOGS; log++) {
+    char name[STORAGE_LOG_LEN+1];
+    FILINFO fno;
+    logname(log, name);
+    FRESULT res = f_stat(name, &fno);
+    if (sizes[log] == 0) {
+      CHECK(res == FR_NO_FILE, "%s still on the card", name);
+    } else {
+      CHECK(res == FR_OK && fno.fsize == sizes[log], "%s is %lu bytes on the card, want %zu",
+          name, (unsigned long)fno.fsize, sizes[log]);
+    }
+  }
+
+  printf("%d scan checks failed\n", failures);
+  return failures == 0 ? 0 : 1;
+}
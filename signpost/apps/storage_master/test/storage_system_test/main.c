@@ -16,6 +16,7 @@
 #include "signpost_storage.h"
 #include "storage_master.h"
 #include "port_signpost.h"
+#include "signpost_reactor.h"
 
 #define UNUSED_PARAMETER(x) (void)(x)
 
@@ -161,5 +162,8 @@ int main (void) {
   //app_watchdog_start();
 
   printf("\nStorage Master initialization complete\n");
+
+  // handle messages from the loop
+  signpost_reactor_run();
 }
 
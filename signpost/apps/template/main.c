@@ -10,6 +10,7 @@
 #include <tock.h>
 
 #include "signpost_api.h"
+#include "signpost_reactor.h"
 
 int main(void) {
     int rc;
@@ -29,6 +30,7 @@ int main(void) {
     while(true) {
         /* YOUR CODE GOES HERE */
 
-        delay_ms(1000);
+        // sleep in the event loop so messages to this module are handled
+        signpost_reactor_delay_ms(1000);
     }
 }
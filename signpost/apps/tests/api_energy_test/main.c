@@ -9,6 +9,21 @@
 #include <tock.h>
 
 #include "signpost_api.h"
+#include "signpost_reactor.h"
+
+static void print_energy(const char* title, signpost_energy_information_t* info) {
+  printf("%s:\n", title);
+  printf("    energy used: %-4lu uWh\n", info->energy_used_since_reset_uWh);
+  printf("   energy limit: %-4lu uWh\n", info->energy_limit_uWh);
+  printf("          time : %-4lu s\n",  info->time_since_reset_s);
+  printf("  mJ limit warn: %-4u %%\n",  info->energy_limit_warning_threshold);
+  printf("  mJ limit crit: %-4u %%\n",  info->energy_limit_critical_threshold);
+  printf("\n");
+}
+
+static void energy_notify_cb(signpost_energy_information_t* info) {
+  print_energy("Energy Notification", info);
+}
 
 int main (void) {
   printf("\n\n[Test] API: Energy\n");
@@ -25,23 +40,26 @@ int main (void) {
 
   signpost_energy_information_t info;
 
-  while (true) {
-    printf("\nQuery Energy\n");
-    printf(  "============\n\n");
-    rc = signpost_energy_query(&info);
+  printf("\nQuery Energy\n");
+  printf(  "============\n\n");
+  rc = signpost_energy_query(&info);
+  if (rc < TOCK_SUCCESS) {
+    printf("Error querying energy: %d\n\n", rc);
+  } else {
+    print_energy("Energy Query Result", &info);
+  }
+
+  // the controller pushes on threshold crossings and every 60s after this
+  printf("\nSubscribe Energy\n");
+  printf(  "================\n\n");
+  do {
+    rc = signpost_energy_subscribe(60, energy_notify_cb);
     if (rc < TOCK_SUCCESS) {
-      printf("Error querying energy: %d\n\n", rc);
-    } else {
-      printf("Energy Query Result:\n");
-      printf("    energy used: %-4lu uWh\n", info.energy_used_since_reset_uWh);
-      printf("   energy limit: %-4lu uWh\n", info.energy_limit_uWh);
-      printf("          time : %-4lu s\n",  info.time_since_reset_s);
-      printf("  mJ limit warn: %-4u %%\n",  info.energy_limit_warning_threshold);
-      printf("  mJ limit crit: %-4u %%\n",  info.energy_limit_critical_threshold);
-      printf("\n");
+      printf("Error subscribing to energy: %d. Sleeping 5s.\n", rc);
+      delay_ms(5000);
     }
+  } while (rc < TOCK_SUCCESS);
 
-    printf("Sleeping for 5s\n");
-    delay_ms(5000);
-  }
+  // notifications are delivered from the loop
+  signpost_reactor_run();
 }
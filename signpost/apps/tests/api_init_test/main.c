@@ -10,6 +10,7 @@
 #include "tock.h"
 
 #include "signpost_api.h"
+#include "signpost_reactor.h"
 #include "signbus_io_interface.h"
 
 #define INTERVAL_IN_MS 2000
@@ -29,7 +30,7 @@ int main(void) {
 
     int i = 0;
     while(1) {
-        delay_ms(INTERVAL_IN_MS);
+        signpost_reactor_delay_ms(INTERVAL_IN_MS);
         printf("doin' stuff %d\n", i++);
     }
 }
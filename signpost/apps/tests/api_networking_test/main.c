@@ -10,6 +10,7 @@
 #include <tock.h>
 
 #include "signpost_api.h"
+#include "signpost_reactor.h"
 
 static void downlink_cb(__attribute__ ((unused)) char* topic, uint8_t* data, uint8_t data_len) {
     printf("Received Downlink: %.*s\n",data_len, (char*)data);
@@ -39,7 +40,8 @@ int main (void) {
 
   const char* message = "Hello World!\n";
   while(1) {
-      delay_ms(5000);
+      // downlinks are delivered from the loop while waiting
+      signpost_reactor_delay_ms(5000);
       printf("About to send\n");
       //publishing to network_test/echo generate a downlink message for testing to the same topic
       int result = signpost_networking_publish("echo", (uint8_t*)message, strlen(message));
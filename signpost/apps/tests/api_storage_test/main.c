@@ -9,9 +9,16 @@
 #include <tock.h>
 
 #include "signpost_api.h"
+#include "signpost_reactor.h"
 
 #define DATA_SIZE 600
 static uint8_t data[DATA_SIZE] = {0};
+static uint8_t read_buf[256];
+
+#define BATCH_SIZE 6
+#define BATCH_RECORD_SIZE 64
+static Storage_Write_t batch[BATCH_SIZE];
+static Storage_Record_t batch_records[BATCH_SIZE];
 
 int main (void) {
   int err;
@@ -41,10 +48,47 @@ int main (void) {
       printf("Wrote successfully!\n");
 #pragma GCC diagnostic pop
     }
+
+    // read the buffer back a chunk at a time
+    if (err >= TOCK_SUCCESS) {
+      Storage_Read_Cursor_t cursor;
+      signpost_storage_read_open(&cursor, &record);
+      size_t total = 0;
+      int len;
+      while ((len = signpost_storage_read_next(&cursor, read_buf, sizeof(read_buf))) > 0) {
+        if (memcmp(read_buf, data + total, len)) {
+          printf("Read back wrong data at %u\n", total);
+        }
+        total += len;
+      }
+      if (len < TOCK_SUCCESS) {
+        printf("Error reading from storage: %d\n", len);
+      } else {
+        printf("Read back %u bytes\n", total);
+      }
+    }
+
+    // write a few samples to two logs in one message
+    printf("Writing batch!\n");
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+      batch[i].data = data + i*BATCH_RECORD_SIZE;
+      batch[i].len = BATCH_RECORD_SIZE;
+      batch[i].record = &batch_records[i];
+      strncpy(batch_records[i].logname, i % 2 ? "test_b" : "test_a", STORAGE_LOG_LEN);
+    }
+    err = signpost_storage_write_batch(batch, BATCH_SIZE);
+    if (err < TOCK_SUCCESS) {
+      printf("Error writing batch to storage: %d\n", err);
+    } else {
+      for (size_t i = 0; i < BATCH_SIZE; i++) {
+        printf("  %s: %u bytes at %u\n", batch_records[i].logname,
+            batch_records[i].length, batch_records[i].offset);
+      }
+    }
     printf("\n");
 
     // sleep for a second
-    delay_ms(1000);
+    signpost_reactor_delay_ms(1000);
   }
 }
 
@@ -9,6 +9,7 @@
 #include <tock.h>
 
 #include "signpost_api.h"
+#include "signpost_reactor.h"
 
 int main (void) {
   printf("\n\n[Test] API: Time & Location\n");
@@ -46,6 +47,6 @@ int main (void) {
     }
 
     printf("Sleeping for 5s\n\n");
-    delay_ms(5000);
+    signpost_reactor_delay_ms(5000);
   }
 }
@@ -14,6 +14,7 @@
 #include "signbus_protocol_layer.h"
 #include "signbus_io_interface.h"
 #include "signpost_entropy.h"
+#include "signpost_reactor.h"
 
 #define INTERVAL_IN_MS 2000
 
@@ -106,7 +107,8 @@ int main(void) {
         printf("signbus_app_recv_async error %d\n", rc);
     }
     while(1) {
-        delay_ms(INTERVAL_IN_MS);
+        // received messages are delivered from the loop while waiting
+        signpost_reactor_delay_ms(INTERVAL_IN_MS);
         if (recent_message == false) {
             printf("RECEIVER: No message in %d ms\n", INTERVAL_IN_MS);
         } else {
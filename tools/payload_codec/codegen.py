@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+
+# Generate the C encoders/decoders and the JS decoders for signpost uplink
+# payloads from payloads.schema. See README.md.
+
+import argparse
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.normpath(os.path.join(HERE, '..', '..'))
+
+SCHEMA = os.path.join(HERE, 'payloads.schema')
+C_OUT = os.path.join(ROOT, 'signpost', 'apps', 'libsignpost', 'signpost_payloads.h')
+JS_OUT = os.path.join(ROOT, 'server', 'lab11', 'packet-parser', 'payloads.js')
+
+# name: (width in bytes, signed, C type, JS read method)
+TYPES = {
+    'u8':  (1, False, 'uint8_t',  'readUInt8({})'),
+    'i8':  (1, True,  'int8_t',   'readInt8({})'),
+    'u16': (2, False, 'uint16_t', 'readUInt16BE({})'),
+    'i16': (2, True,  'int16_t',  'readInt16BE({})'),
+    'u24': (3, False, 'uint32_t', 'readUIntBE({}, 3)'),
+    'u32': (4, False, 'uint32_t', 'readUInt32BE({})'),
+    'i32': (4, True,  'int32_t',  'readInt32BE({})'),
+}
+
+FIELD_RE = re.compile(r'^([A-Za-z_][A-Za-z0-9_]*)\s+([ui](?:8|16|24|32))(?:\[(\d+)\])?$')
+MESSAGE_RE = re.compile(r'^message\s+([a-z_][a-z0-9_]*)(?:\s+(0x[0-9a-fA-F]{1,2}|\d+))?$')
+
+
+class SchemaError(Exception):
+    pass
+
+
+class Field():
+    def __init__(self, name, type_name, count, offset):
+        self.name = name
+        self.type_name = type_name
+        self.width, self.signed, self.c_type, self.js_read = TYPES[type_name]
+        self.count = count
+        self.offset = offset
+
+    @property
+    def size(self):
+        return self.width * (self.count or 1)
+
+
+class Message():
+    def __init__(self, name, msg_type):
+        self.name = name
+        self.msg_type = msg_type
+        self.fields = []
+        self.min_length = None
+
+    @property
+    def header_length(self):
+        return 0 if self.msg_type is None else 1
+
+    @property
+    def length(self):
+        if not self.fields:
+            return self.header_length
+        last = self.fields[-1]
+        return last.offset + last.size
+
+    @property
+    def required_length(self):
+        return self.length if self.min_length is None else self.min_length
+
+
+def parse_schema(path):
+    messages = []
+    current = None
+    with open(path) as f:
+        for lineno, raw in enumerate(f, 1):
+            line = raw.split('#', 1)[0].strip()
+            if not line:
+                continue
+
+            def error(msg):
+                raise SchemaError('{}:{}: {}'.format(path, lineno, msg))
+
+            m = MESSAGE_RE.match(line)
+            if m:
+                msg_type = None if m.group(2) is None else int(m.group(2), 0)
+                if msg_type is not None and msg_type > 0xFF:
+                    error('message type does not fit in a byte')
+                if any(msg.name == m.group(1) for msg in messages):
+                    error('duplicate message ' + m.group(1))
+                current = Message(m.group(1), msg_type)
+                messages.append(current)
+                continue
+
+            if current is None:
+                error('field outside of a message')
+
+            if line == 'optional':
+                if current.min_length is not None:
+                    error('only one optional section is allowed')
+                current.min_length = current.length
+                continue
+
+            m = FIELD_RE.match(line)
+            if not m or m.group(2) not in TYPES:
+                error('cannot parse field "{}"'.format(line))
+            if any(fld.name == m.group(1) for fld in current.fields):
+                error('duplicate field ' + m.group(1))
+            count = None if m.group(3) is None else int(m.group(3))
+            if count == 0:
+                error('zero length array')
+            current.fields.append(Field(m.group(1), m.group(2), count, current.length))
+
+    for msg in messages:
+        if msg.length > 255:
+            raise SchemaError('{}: message {} is longer than a publish'.format(path, msg.name))
+    return messages
+
+
+def c_put(field, index, value):
+    offset = str(field.offset) if index is None else '{} + {}*{}'.format(field.offset, index, field.width)
+    if field.width == 1:
+        return 'buf[{}] = (uint8_t){};'.format(offset, value)
+    return 'signpost_payload_put(buf + {}, (uint32_t){}, {});'.format(offset, value, field.width)
+
+
+def c_get(field, index):
+    offset = str(field.offset) if index is None else '{} + {}*{}'.format(field.offset, index, field.width)
+    if field.width == 1:
+        return '({})buf[{}]'.format(field.c_type, offset)
+    return '({})signpost_payload_get(buf + {}, {})'.format(field.c_type, offset, field.width)
+
+
+def generate_c(messages):
+    out = []
+    w = out.append
+    w('// Generated by tools/payload_codec/codegen.py from payloads.schema.')
+    w('// Do not edit, change the schema and regenerate.')
+    w('')
+    w('#pragma once')
+    w('')
+    w('#ifdef __cplusplus')
+    w('extern "C" {')
+    w('#endif')
+    w('')
+    w('#include <stddef.h>')
+    w('#include <stdint.h>')
+    w('#include <string.h>')
+    w('#include "port_signpost.h"')
+    w('')
+    w('// Encoders return the encoded length, or PORT_ESIZE if buf is too short.')
+    w('// Decoders return the decoded length, or PORT_ESIZE if len is too short for')
+    w('// the required fields and PORT_EINVAL if the message type is wrong. Optional')
+    w('// fields missing from a short message are zeroed.')
+    w('')
+    w('static inline void signpost_payload_put(uint8_t* buf, uint32_t value, size_t width) {')
+    w('    for (size_t i = width; i > 0; i--) {')
+    w('        buf[i-1] = value & 0xFF;')
+    w('        value >>= 8;')
+    w('    }')
+    w('}')
+    w('')
+    w('static inline uint32_t signpost_payload_get(const uint8_t* buf, size_t width) {')
+    w('    uint32_t value = 0;')
+    w('    for (size_t i = 0; i < width; i++) {')
+    w('        value = (value << 8) | buf[i];')
+    w('    }')
+    w('    return value;')
+    w('}')
+
+    for msg in messages:
+        upper = 'SIGNPOST_PAYLOAD_' + msg.name.upper()
+        ctype = 'signpost_payload_{}_t'.format(msg.name)
+        w('')
+        w('/**************************************************************************/')
+        w('/* {:<70} */'.format(msg.name.upper()))
+        w('/**************************************************************************/')
+        w('')
+        if msg.msg_type is not None:
+            w('#define {}_TYPE 0x{:02x}'.format(upper, msg.msg_type))
+        w('#define {}_LEN {}'.format(upper, msg.length))
+        if msg.min_length is not None:
+            w('#define {}_MIN_LEN {}'.format(upper, msg.min_length))
+        w('')
+        w('typedef struct {')
+        for fld in msg.fields:
+            if fld.count:
+                w('    {} {}[{}];'.format(fld.c_type, fld.name, fld.count))
+            else:
+                w('    {} {};'.format(fld.c_type, fld.name))
+        w('}} {};'.format(ctype))
+        w('')
+
+        w('static inline int signpost_payload_{}_encode(const {}* msg, uint8_t* buf, size_t len) {{'.format(msg.name, ctype))
+        w('    if (len < {}_LEN) return PORT_ESIZE;'.format(upper))
+        if msg.msg_type is not None:
+            w('    buf[0] = {}_TYPE;'.format(upper))
+        for fld in msg.fields:
+            if fld.count:
+                w('    for (size_t i = 0; i < {}; i++) {{'.format(fld.count))
+                w('        ' + c_put(fld, 'i', 'msg->{}[i]'.format(fld.name)))
+                w('    }')
+            else:
+                w('    ' + c_put(fld, None, 'msg->' + fld.name))
+        w('    return {}_LEN;'.format(upper))
+        w('}')
+        w('')
+
+        required = upper + ('_MIN_LEN' if msg.min_length is not None else '_LEN')
+        w('static inline int signpost_payload_{}_decode({}* msg, const uint8_t* buf, size_t len) {{'.format(msg.name, ctype))
+        w('    if (len < {}) return PORT_ESIZE;'.format(required))
+        if msg.msg_type is not None:
+            w('    if (buf[0] != {}_TYPE) return PORT_EINVAL;'.format(upper))
+        if msg.min_length is not None:
+            w('    memset(msg, 0, sizeof({}));'.format(ctype))
+        optional = False
+        indent = '    '
+        for fld in msg.fields:
+            if msg.min_length is not None and not optional and fld.offset >= msg.min_length:
+                optional = True
+                w('    if (len < {}_LEN) return {}_MIN_LEN;'.format(upper, upper))
+            if fld.count:
+                w(indent + 'for (size_t i = 0; i < {}; i++) {{'.format(fld.count))
+                w(indent + '    msg->{}[i] = {};'.format(fld.name, c_get(fld, 'i')))
+                w(indent + '}')
+            else:
+                w(indent + 'msg->{} = {};'.format(fld.name, c_get(fld, None)))
+        w('    return {}_LEN;'.format(upper))
+        w('}')
+
+    w('')
+    w('#ifdef __cplusplus')
+    w('}')
+    w('#endif')
+    return '\n'.join(out) + '\n'
+
+
+def js_read(field, offset):
+    return 'buf.' + field.js_read.format(offset)
+
+
+def generate_js(messages):
+    out = []
+    w = out.append
+    w('// Generated by tools/payload_codec/codegen.py from payloads.schema.')
+    w('// Do not edit, change the schema and regenerate.')
+    w('//')
+    w('// Each decoder returns the raw field values, or null if the buffer is too')
+    w('// short for the required fields. Optional fields are left out if missing.')
+    w('// Message types are not checked here, the caller picks the layout.')
+    for msg in messages:
+        w('')
+        w('exports.{} = {{'.format(msg.name))
+        if msg.msg_type is not None:
+            w('    type: 0x{:02x},'.format(msg.msg_type))
+        w('    length: {},'.format(msg.length))
+        w('    min_length: {},'.format(msg.required_length))
+        w('    decode: function (buf) {')
+        w('        if (buf.length < {}) return null;'.format(msg.required_length))
+        w('        var msg = {};')
+        indent = '        '
+        optional = False
+        for fld in msg.fields:
+            if msg.min_length is not None and not optional and fld.offset >= msg.min_length:
+                optional = True
+                w('        if (buf.length < {}) return msg;'.format(msg.length))
+            if fld.count:
+                w(indent + 'msg.{} = new Array({});'.format(fld.name, fld.count))
+                w(indent + 'for (var i = 0; i < {}; i++) {{'.format(fld.count))
+                w(indent + '    msg.{}[i] = {};'.format(fld.name, js_read(fld, '{} + i*{}'.format(fld.offset, fld.width))))
+                w(indent + '}')
+            else:
+                w(indent + 'msg.{} = {};'.format(fld.name, js_read(fld, fld.offset)))
+        w('        return msg;')
+        w('    },')
+        w('};')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate signpost payload codecs')
+    parser.add_argument('--check', action='store_true',
+            help='fail if the generated files are out of date instead of writing them')
+    args = parser.parse_args()
+
+    try:
+        messages = parse_schema(SCHEMA)
+    except SchemaError as e:
+        print(e, file=sys.stderr)
+        return 1
+
+    outputs = [(C_OUT, generate_c(messages)), (JS_OUT, generate_js(messages))]
+    stale = False
+    for path, text in outputs:
+        current = None
+        if os.path.exists(path):
+            with open(path) as f:
+                current = f.read()
+        if current == text:
+            continue
+        if args.check:
+            print('{} is out of date, run {}'.format(os.path.relpath(path, ROOT),
+                os.path.relpath(__file__, ROOT)), file=sys.stderr)
+            stale = True
+        else:
+            with open(path, 'w') as f:
+                f.write(text)
+            print('Wrote ' + os.path.relpath(path, ROOT))
+
+    return 1 if stale else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
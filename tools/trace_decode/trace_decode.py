@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+
+# Decode signpost trace buffers into per-stage latencies. See README.md.
+
+import argparse
+import binascii
+import struct
+import sys
+
+RECORD = struct.Struct('<IBBH')
+PUBLISH_HEADER = struct.Struct('<BIH')
+PUBLISH_VERSION = 0x01
+END_FLAG = 0x80
+
+# must match signpost_trace_event_e in signpost_trace.h
+EVENTS = {
+    1: 'io_send',
+    2: 'io_fragment_write',
+    3: 'io_get_message',
+    4: 'cipher',
+    5: 'message_digest',
+    6: 'api_dispatch',
+    7: 'storage_write',
+}
+
+# must match signbus_api_type_t in signbus_app_layer.h
+APIS = {
+    1: 'initialization',
+    2: 'storage',
+    3: 'networking',
+    4: 'processing',
+    5: 'energy',
+    6: 'timelocation',
+    7: 'edison',
+    8: 'json',
+    9: 'watchdog',
+    10: 'debug',
+}
+
+
+class Trace():
+    def __init__(self):
+        self.frequency = None
+        self.records = []
+        self.dropped = 0
+
+    def add_records(self, raw):
+        if len(raw) % RECORD.size:
+            raise ValueError('trace data is not a whole number of records')
+        for offset in range(0, len(raw), RECORD.size):
+            self.records.append(RECORD.unpack_from(raw, offset))
+
+    def set_frequency(self, frequency):
+        if self.frequency is not None and self.frequency != frequency:
+            raise ValueError('trace mixes timer frequencies {} and {}'.format(self.frequency, frequency))
+        self.frequency = frequency
+
+
+def read_console(lines, trace):
+    """TRACE lines from signpost_trace_dump, anything else is skipped"""
+    for line in lines:
+        at = line.find('TRACE ')
+        if at < 0:
+            continue
+        fields = line[at:].split()
+        if fields[1] == 'BEGIN':
+            trace.set_frequency(int(fields[2]))
+            trace.dropped += int(fields[3])
+        elif fields[1] != 'END':
+            trace.add_records(binascii.unhexlify(fields[1]))
+
+
+def read_published(lines, trace):
+    """One hex encoded signpost_trace_publish payload per line"""
+    for line in lines:
+        line = line.strip()
+        if not line:
+            continue
+        raw = binascii.unhexlify(line)
+        version, frequency, dropped = PUBLISH_HEADER.unpack_from(raw)
+        if version != PUBLISH_VERSION:
+            raise ValueError('unknown trace publish version {}'.format(version))
+        trace.set_frequency(frequency)
+        trace.dropped += dropped
+        trace.add_records(raw[PUBLISH_HEADER.size:])
+
+
+def stage_name(event, arg):
+    name = EVENTS.get(event, 'event{}'.format(event))
+    if event == 6:
+        name += ' ' + APIS.get(arg >> 8, 'api{}'.format(arg >> 8))
+    return name
+
+
+def pair(trace):
+    """Match each end with the latest open begin of the same event"""
+    open_stages = {}
+    durations = {}
+    unmatched = 0
+    for timestamp, event, _, arg in trace.records:
+        stage = event & ~END_FLAG
+        if not event & END_FLAG:
+            open_stages.setdefault(stage, []).append((timestamp, arg))
+            continue
+        if not open_stages.get(stage):
+            unmatched += 1
+            continue
+        begin, begin_arg = open_stages[stage].pop()
+        ticks = (timestamp - begin) & 0xFFFFFFFF
+        durations.setdefault(stage_name(stage, begin_arg), []).append(ticks)
+    unmatched += sum(len(stages) for stages in open_stages.values())
+    return durations, unmatched
+
+
+def percentile(values, fraction):
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def report(trace, out):
+    if trace.frequency is None:
+        print('No trace found', file=out)
+        return 1
+
+    durations, unmatched = pair(trace)
+    to_ms = 1000.0 / trace.frequency
+
+    print('{} records at {} Hz, {} dropped, {} unmatched'.format(
+        len(trace.records), trace.frequency, trace.dropped, unmatched), file=out)
+    print('{:<28} {:>6} {:>10} {:>9} {:>9} {:>9} {:>9}'.format(
+        'stage', 'count', 'total ms', 'mean ms', 'p50 ms', 'p90 ms', 'max ms'), file=out)
+    for name in sorted(durations, key=lambda n: -sum(durations[n])):
+        values = sorted(durations[name])
+        total = sum(values)
+        print('{:<28} {:>6} {:>10.2f} {:>9.2f} {:>9.2f} {:>9.2f} {:>9.2f}'.format(
+            name, len(values), total * to_ms, total * to_ms / len(values),
+            percentile(values, 0.5) * to_ms, percentile(values, 0.9) * to_ms,
+            values[-1] * to_ms), file=out)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-stage latencies from a signpost trace')
+    parser.add_argument('input', nargs='?', type=argparse.FileType('r'), default=sys.stdin,
+            help='console log with TRACE lines, or published payloads with --published')
+    parser.add_argument('--published', action='store_true',
+            help='input is one hex payload from signpost_trace_publish per line')
+    args = parser.parse_args()
+
+    trace = Trace()
+    try:
+        if args.published:
+            read_published(args.input, trace)
+        else:
+            read_console(args.input, trace)
+    except (ValueError, IndexError, struct.error, binascii.Error) as e:
+        print('Could not read trace: {}'.format(e), file=sys.stderr)
+        return 1
+    return report(trace, sys.stdout)
+
+
+if __name__ == '__main__':
+    sys.exit(main())